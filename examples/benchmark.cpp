@@ -0,0 +1,657 @@
+/**
+ * @file benchmark.cpp
+ * @brief 各処理(MFCC, VAD, DTW)の1回あたりのサイクル数, 時間およびヒープの最大使用量を計測します
+ * @details
+ * 結果はCSV(1行目はヘッダ)で標準出力に出力します。
+ * ESP32ではArduinoのスケッチとして、ホスト環境ではCMakeのsimplevox_benchmarkとしてビルドします。
+ * 入力は固定の乱数系列による合成音声のため、同じ環境では同じ条件で比較できます。
+ */
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "simplevox.h"
+
+#if defined(ESP_PLATFORM)
+#include <esp_cpu.h>
+#include <esp_idf_version.h>
+#include <esp_timer.h>
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#define readCycles() esp_cpu_get_cycle_count()
+#else
+#define readCycles() esp_cpu_get_ccount()
+#endif
+#else
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define readCycles() __rdtsc()    // TSC(基準クロック)のため、周波数が変動する環境では目安
+#else
+#define readCycles() 0
+#endif
+#endif
+
+constexpr int kAudioTimeMs = 1000;
+constexpr int kCalculateCalls = 20;
+constexpr int kCreateCalls = 3;
+constexpr int kDtwCalls = 3;
+constexpr int kFftNums[] = {256, 512, 1024};
+constexpr int kMelChannels[] = {20, 24, 40};
+constexpr int kCoefNums[] = {12, 16};
+constexpr int kSampleRates[] = {8000, 16000};
+constexpr int kInputRates[] = {32000, 44100, 48000};
+constexpr int kChannelNums[] = {1, 2, 4};
+constexpr int kTemplateLengths[] = {25, 50, 100, 200};
+constexpr int kAccuracyTemplates = 8;
+constexpr int kBatchTemplates = 16;
+constexpr int kEnvelopeRadius = 2;
+constexpr int kBatchWorkers = 2;
+
+/**
+ * @brief ヒープの使用量(operator newとplatform::allocate()の合計)
+ * @details 各領域の先頭に確保サイズを保持し、解放時に差し引く
+ */
+std::atomic<size_t> heapBytes(0);
+std::atomic<size_t> heapPeakBytes(0);
+constexpr size_t kHeaderSize = 16;
+
+void* trackAllocation(void* block, size_t size)
+{
+  if (block == nullptr) { return nullptr; }
+  *static_cast<size_t*>(block) = size;
+  const size_t current = (heapBytes += size);
+  size_t peak = heapPeakBytes.load();
+  while (current > peak && !heapPeakBytes.compare_exchange_weak(peak, current)) {}
+  return static_cast<uint8_t*>(block) + kHeaderSize;
+}
+
+void* untrackAllocation(void* ptr)
+{
+  auto* block = static_cast<uint8_t*>(ptr) - kHeaderSize;
+  heapBytes -= *reinterpret_cast<size_t*>(block);
+  return block;
+}
+
+void* trackedAllocate(size_t size, uint32_t caps)
+{
+#if defined(ESP_PLATFORM)
+  return trackAllocation(heap_caps_malloc(size + kHeaderSize, caps), size);
+#else
+  (void)caps;
+  return trackAllocation(malloc(size + kHeaderSize), size);
+#endif
+}
+
+void trackedDeallocate(void* ptr)
+{
+#if defined(ESP_PLATFORM)
+  heap_caps_free(untrackAllocation(ptr));
+#else
+  free(untrackAllocation(ptr));
+#endif
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+  return trackAllocation(malloc(size + kHeaderSize), size);
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void* operator new(size_t size)
+{
+  auto* ptr = operator new(size, std::nothrow);
+  if (ptr == nullptr) { abort(); }
+  return ptr;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept
+{
+  if (ptr == nullptr) { return; }
+  free(untrackAllocation(ptr));
+}
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { operator delete(ptr); }
+
+uint64_t readMicros()
+{
+#if defined(ESP_PLATFORM)
+  return esp_timer_get_time();
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct Measurement
+{
+  double cycles;      ///< 1回あたりのサイクル数
+  double micros;      ///< 1回あたりの時間[us]
+  size_t peakBytes;   ///< 1回の呼び出し中に増加したヒープの最大値
+};
+
+/**
+ * @brief 指定した処理をcalls回呼び出して計測します
+ */
+template <typename F>
+Measurement measure(int calls, F&& fn)
+{
+  uint64_t cycles = 0;
+  uint64_t micros = 0;
+  size_t peakBytes = 0;
+  for (int i = 0; i < calls; i++)
+  {
+    const size_t baseBytes = heapBytes.load();
+    heapPeakBytes = baseBytes;
+    const uint64_t beginMicros = readMicros();
+    const uint32_t beginCycles = readCycles();
+    fn(i);
+    cycles += (uint32_t)(readCycles() - beginCycles);
+    micros += readMicros() - beginMicros;
+    if (heapPeakBytes.load() - baseBytes > peakBytes)
+    {
+      peakBytes = heapPeakBytes.load() - baseBytes;
+    }
+  }
+  return {(double)cycles / calls, (double)micros / calls, peakBytes};
+}
+
+void printHeader()
+{
+  printf("kernel,arithmetic,sample_rate,fft_num,mel_channel,coef_num,frames,calls,cycles,us,peak_heap_bytes\n");
+}
+
+void printResult(const char* kernel, const char* arithmetic, int sampleRate, int fftNum, int melChannel,
+                 int coefNum, int frames, int calls, const Measurement& result)
+{
+  printf("%s,%s,%d,%d,%d,%d,%d,%d,%.0f,%.2f,%u\n", kernel, arithmetic, sampleRate, fftNum, melChannel,
+         coefNum, frames, calls, result.cycles, result.micros, (unsigned)result.peakBytes);
+}
+
+/**
+ * @brief 無音, 有声音, 無音の順に並んだ合成音声を作成します
+ */
+void makeAudio(int16_t* audio, int length, int sampleRate)
+{
+  uint32_t seed = 12345;
+  for (int i = 0; i < length; i++)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    const int noise = (int)(seed >> 24) - 128;
+    const bool isVoiced = (i >= length / 4 && i < length * 3 / 4);
+    const double t = (double)i / sampleRate;
+    const double voice = isVoiced
+                       ? 6000 * sin(2 * M_PI * 220 * t) + 3000 * sin(2 * M_PI * 660 * t) + 1500 * sin(2 * M_PI * 1800 * t)
+                       : 0;
+    audio[i] = (int16_t)(voice + noise);
+  }
+}
+
+void benchMfcc(const int16_t* audio, int length, int sampleRate, simplevox::MfccArithmetic arithmetic)
+{
+  const char* arithmeticName = (arithmetic == simplevox::MfccArithmetic::Float) ? "float" : "fixed";
+  for (int fftNum : kFftNums)
+  {
+    for (int melChannel : kMelChannels)
+    {
+      for (int coefNum : kCoefNums)
+      {
+        simplevox::MfccConfig config;
+        config.fft_num = fftNum;
+        config.mel_channel = melChannel;
+        config.coef_num = coefNum;
+        config.sample_rate = sampleRate;
+        config.frame_time_ms = fftNum * 1000 / sampleRate;
+        config.arithmetic = arithmetic;
+        simplevox::MfccEngine engine;
+        if (!engine.init(config)) { continue; }
+
+        const int frameNum = engine.frameNum(length);
+        std::unique_ptr<float[]> mfccs(new float[frameNum * coefNum]);
+        std::unique_ptr<int16_t[]> normalized(new int16_t[frameNum * coefNum]);
+        const int hopLength = config.hop_length();
+
+        const auto calculate = measure(kCalculateCalls, [&](int i) {
+          const int frame = i % frameNum;
+          engine.calculate(&audio[frame * hopLength], &mfccs[frame * coefNum]);
+        });
+        printResult("mfcc_calculate", arithmeticName, sampleRate, fftNum, melChannel, coefNum, 1,
+                    kCalculateCalls, calculate);
+
+        const auto create = measure(kCreateCalls, [&](int) {
+          delete engine.create(audio, length);
+        });
+        printResult("mfcc_create", arithmeticName, sampleRate, fftNum, melChannel, coefNum, frameNum,
+                    kCreateCalls, create);
+
+        for (int i = 0; i < frameNum; i++)
+        {
+          engine.calculate(&audio[i * hopLength], &mfccs[i * coefNum]);
+        }
+        const auto normalize = measure(kCreateCalls, [&](int) {
+          engine.normalize(mfccs.get(), frameNum, coefNum, normalized.get());
+        });
+        printResult("mfcc_normalize", arithmeticName, sampleRate, fftNum, melChannel, coefNum, frameNum,
+                    kCreateCalls, normalize);
+        engine.deinit();
+      }
+    }
+  }
+}
+
+#if __cplusplus >= 201402L
+/**
+ * @brief StaticMfccEngineとMfccEngine(同じ構成)の1フレームあたりのMFCCの算出を比較します
+ * @details
+ * 時間を計測した後、全フレームのMFCC(floatおよびint16)の差の最大値と、
+ * 全て一致(ビット単位)したかを"#"で始まる行に出力します。
+ */
+template <int FftNum, int MelChannel, int CoefNum, int SampleRate>
+void benchStaticMfcc(const int16_t* audio, int length)
+{
+  using StaticEngine = simplevox::StaticMfccEngine<FftNum, MelChannel, CoefNum, SampleRate>;
+  std::unique_ptr<StaticEngine> staticEngine(new StaticEngine());
+  if (!staticEngine->init()) { return; }
+  simplevox::MfccEngine engine;
+  if (!engine.init(staticEngine->config())) { return; }
+
+  const int frameNum = StaticEngine::frameNum(length);
+  constexpr int kHopLength = StaticEngine::kHopLength;
+  float mfcc[CoefNum];
+  float staticMfcc[CoefNum];
+  const auto calculate = measure(kCalculateCalls, [&](int i) {
+    staticEngine->calculate(&audio[(i % frameNum) * kHopLength], staticMfcc);
+  });
+  printResult("mfcc_calculate_static", "float", SampleRate, FftNum, MelChannel, CoefNum, 1,
+              kCalculateCalls, calculate);
+
+  float maxDiff = 0;
+  int maxFixedDiff = 0;
+  for (int i = 0; i < frameNum; i++)
+  {
+    const int16_t* frame = &audio[i * kHopLength];
+    int16_t fixedMfcc[CoefNum];
+    int16_t staticFixedMfcc[CoefNum];
+    engine.calculate(frame, mfcc);
+    staticEngine->calculate(frame, staticMfcc);
+    engine.calculate(frame, fixedMfcc);
+    staticEngine->calculate(frame, staticFixedMfcc);
+    for (int j = 0; j < CoefNum; j++)
+    {
+      maxDiff = fmaxf(maxDiff, fabsf(mfcc[j] - staticMfcc[j]));
+      maxFixedDiff = std::max(maxFixedDiff, abs(fixedMfcc[j] - staticFixedMfcc[j]));
+    }
+  }
+  printf("# static_mfcc,%d,%d,%d,%d,%d,%g,%d,%d\n", SampleRate, FftNum, MelChannel, CoefNum, frameNum,
+         maxDiff, maxFixedDiff, (maxDiff == 0 && maxFixedDiff == 0) ? 1 : 0);
+  engine.deinit();
+  staticEngine->deinit();
+}
+
+void benchStaticMfccs()
+{
+  printf("# static_mfcc,sample_rate,fft_num,mel_channel,coef_num,frames,max_abs_diff,max_fixed_diff,bit_exact\n");
+  for (int sampleRate : kSampleRates)
+  {
+    const int length = kAudioTimeMs * sampleRate / 1000;
+    std::unique_ptr<int16_t[]> audio(new int16_t[length]);
+    makeAudio(audio.get(), length, sampleRate);
+    if (sampleRate == 8000)
+    {
+      benchStaticMfcc<256, 24, 12, 8000>(audio.get(), length);
+    }
+    else
+    {
+      benchStaticMfcc<512, 24, 12, 16000>(audio.get(), length);
+    }
+  }
+}
+#endif
+
+void benchVad(const int16_t* audio, int length, int sampleRate)
+{
+  simplevox::VadConfig config;
+  config.sample_rate = sampleRate;
+  simplevox::VadEngine engine;
+  if (!engine.init(config)) { return; }
+
+  const int frameLength = config.frame_length();
+  const int frameNum = length / frameLength;
+  const auto process = measure(frameNum, [&](int i) {
+    engine.process(&audio[i * frameLength]);
+  });
+  printResult("vad_process", "-", sampleRate, 0, 0, 0, 1, frameNum, process);
+
+  std::unique_ptr<int16_t[]> dest(new int16_t[length]);
+  engine.reset();
+  const auto detect = measure(frameNum, [&](int i) {
+    engine.detect(dest.get(), length, &audio[i * frameLength]);
+  });
+  printResult("vad_detect", "-", sampleRate, 0, 0, 0, 1, frameNum, detect);
+  engine.deinit();
+}
+
+void benchDtw()
+{
+  constexpr int kCoefNum = 12;
+  simplevox::MfccEngine engine;
+  if (!engine.init(simplevox::MfccConfig())) { return; }
+
+  uint32_t seed = 54321;
+  for (int templateLength : kTemplateLengths)
+  {
+    std::unique_ptr<float[]> mfccs(new float[templateLength * kCoefNum]);
+    std::unique_ptr<simplevox::MfccFeature> features[2];
+    for (auto& feature : features)
+    {
+      for (int i = 0; i < templateLength * kCoefNum; i++)
+      {
+        seed = seed * 1664525u + 1013904223u;
+        mfccs[i] = (float)(seed >> 16) / 65536 - 0.5f;
+      }
+      feature.reset(engine.create(mfccs.get(), templateLength, kCoefNum));
+    }
+    if (!features[0] || !features[1]) { continue; }
+
+    const auto dtw = measure(kDtwCalls, [&](int) {
+      simplevox::calcDTW(*features[0], *features[1]);
+    });
+    printResult("calc_dtw", "-", 0, 0, 0, kCoefNum, templateLength, kDtwCalls, dtw);
+
+    // DPの全行の内積(フレームごとのInnerProduct()と４フレームずつのInnerProduct4())
+    std::unique_ptr<int[]> innerRow(new int[templateLength]);
+    const auto innerScalar = measure(kDtwCalls, [&](int) {
+      for (int i = 0; i < templateLength; i++)
+      {
+        for (int j = 0; j < templateLength; j++)
+        {
+          innerRow[j] = simplevox::detail::InnerProduct(features[0]->feature(i), kCoefNum, features[1]->feature(j));
+        }
+      }
+    });
+    printResult("dtw_inner_product", "scalar", 0, 0, 0, kCoefNum, templateLength, kDtwCalls, innerScalar);
+    const auto innerBlocked = measure(kDtwCalls, [&](int) {
+      for (int i = 0; i < templateLength; i++)
+      {
+        simplevox::detail::InnerProductRow(features[0]->feature(i), *features[1], 0, templateLength, innerRow.get());
+      }
+    });
+    printResult("dtw_inner_product", "block4", 0, 0, 0, kCoefNum, templateLength, kDtwCalls, innerBlocked);
+
+    simplevox::DtwWorkspace workspace;
+    if (!workspace.init(templateLength)) { continue; }
+    const simplevox::MfccFeature* templates[] = {features[0].get()};
+    uint32_t distance;
+    const auto batch = measure(kDtwCalls, [&](int) {
+      simplevox::calcDTWBatch(templates, 1, *features[1], &distance, simplevox::DtwConfig(), workspace);
+    });
+    printResult("calc_dtw_workspace", "-", 0, 0, 0, kCoefNum, templateLength, kDtwCalls, batch);
+
+    std::unique_ptr<simplevox::MfccFeatureInt8> quantized;
+    const auto quantize = measure(1, [&](int) {
+      quantized.reset(simplevox::MfccEngine::quantize(*features[0]));
+    });
+    printResult("mfcc_quantize", "int8", 0, 0, 0, kCoefNum, templateLength, 1, quantize);
+    if (!quantized) { continue; }
+
+    const auto dtwInt8 = measure(kDtwCalls, [&](int) {
+      simplevox::calcDTW(*quantized, *features[1]);
+    });
+    printResult("calc_dtw", "int8", 0, 0, 0, kCoefNum, templateLength, kDtwCalls, dtwInt8);
+  }
+  engine.deinit();
+}
+
+/**
+ * @brief int8に量子化したテンプレートとint16のテンプレートのDTW距離の差を出力します
+ * @details
+ * 各長さについて、kAccuracyTemplates個のテンプレートと、テンプレート０に雑音を加えた特徴量を比較し、
+ * 距離の絶対誤差(平均, 最大)と最も近いテンプレートが一致したかを"#"で始まる行に出力します。
+ */
+void benchQuantization()
+{
+  constexpr int kCoefNum = 12;
+  simplevox::MfccEngine engine;
+  if (!engine.init(simplevox::MfccConfig())) { return; }
+
+  printf("# quantization,frames,templates,mean_abs_error,max_abs_error,best_match_agree\n");
+  uint32_t seed = 98765;
+  const auto random = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return (float)(seed >> 16) / 65536 - 0.5f;
+  };
+  for (int templateLength : kTemplateLengths)
+  {
+    std::unique_ptr<float[]> mfccs(new float[kAccuracyTemplates * templateLength * kCoefNum]);
+    std::unique_ptr<simplevox::MfccFeature> templates[kAccuracyTemplates];
+    std::unique_ptr<simplevox::MfccFeatureInt8> quantized[kAccuracyTemplates];
+    const simplevox::MfccFeature* templatePtrs[kAccuracyTemplates];
+    const simplevox::MfccFeatureInt8* quantizedPtrs[kAccuracyTemplates];
+    bool isCreated = true;
+    for (int k = 0; k < kAccuracyTemplates && isCreated; k++)
+    {
+      float* mfcc = &mfccs[k * templateLength * kCoefNum];
+      for (int i = 0; i < templateLength * kCoefNum; i++)
+      {
+        mfcc[i] = random();
+      }
+      templates[k].reset(engine.create(mfcc, templateLength, kCoefNum));
+      quantized[k].reset(templates[k] ? simplevox::MfccEngine::quantize(*templates[k]) : nullptr);
+      templatePtrs[k] = templates[k].get();
+      quantizedPtrs[k] = quantized[k].get();
+      isCreated = templates[k] && quantized[k];
+    }
+    if (!isCreated) { continue; }
+
+    std::unique_ptr<float[]> queryMfccs(new float[templateLength * kCoefNum]);
+    for (int i = 0; i < templateLength * kCoefNum; i++)
+    {
+      queryMfccs[i] = mfccs[i] + 0.5f * random();
+    }
+    std::unique_ptr<simplevox::MfccFeature> query(engine.create(queryMfccs.get(), templateLength, kCoefNum));
+    if (!query) { continue; }
+
+    uint32_t distances[kAccuracyTemplates];
+    uint32_t distancesInt8[kAccuracyTemplates];
+    const int best = simplevox::calcDTWBatch(templatePtrs, kAccuracyTemplates, *query, distances);
+    const int bestInt8 = simplevox::calcDTWBatch(quantizedPtrs, kAccuracyTemplates, *query, distancesInt8);
+    double errorSum = 0;
+    uint32_t errorMax = 0;
+    for (int k = 0; k < kAccuracyTemplates; k++)
+    {
+      const uint32_t error = (distances[k] > distancesInt8[k]) ? distances[k] - distancesInt8[k]
+                                                              : distancesInt8[k] - distances[k];
+      errorSum += error;
+      errorMax = (error > errorMax) ? error : errorMax;
+    }
+    printf("# int8,%d,%d,%.2f,%u,%d\n", templateLength, kAccuracyTemplates, errorSum / kAccuracyTemplates,
+           (unsigned)errorMax, (best == bestInt8) ? 1 : 0);
+  }
+  engine.deinit();
+}
+
+/**
+ * @brief 下限値による枝刈りの有無でcalcDTWBatch()を比較します
+ * @details 特徴量は隣接フレーム間に相関を持たせた乱数系列(MFCCの時間変化を模したもの)とします
+ */
+void benchLowerBound()
+{
+  constexpr int kCoefNum = 12;
+  simplevox::MfccEngine engine;
+  if (!engine.init(simplevox::MfccConfig())) { return; }
+
+  uint32_t seed = 24680;
+  const auto random = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return (float)(seed >> 16) / 65536 - 0.5f;
+  };
+  for (int templateLength : kTemplateLengths)
+  {
+    std::unique_ptr<float[]> mfccs(new float[kBatchTemplates * templateLength * kCoefNum]);
+    std::unique_ptr<simplevox::MfccFeature> templates[kBatchTemplates];
+    simplevox::DtwEnvelope envelopes[kBatchTemplates];
+    const simplevox::MfccFeature* templatePtrs[kBatchTemplates];
+    const simplevox::DtwEnvelope* envelopePtrs[kBatchTemplates];
+    bool isCreated = true;
+    for (int k = 0; k < kBatchTemplates && isCreated; k++)
+    {
+      float* mfcc = &mfccs[k * templateLength * kCoefNum];
+      for (int i = 0; i < templateLength * kCoefNum; i++)
+      {
+        mfcc[i] = ((i >= kCoefNum) ? 0.9f * mfcc[i - kCoefNum] : 0) + random();
+      }
+      templates[k].reset(engine.create(mfcc, templateLength, kCoefNum));
+      isCreated = templates[k] && envelopes[k].init(*templates[k], kEnvelopeRadius);
+      templatePtrs[k] = templates[k].get();
+      envelopePtrs[k] = &envelopes[k];
+    }
+    if (!isCreated) { continue; }
+
+    std::unique_ptr<float[]> queryMfccs(new float[templateLength * kCoefNum]);
+    for (int i = 0; i < templateLength * kCoefNum; i++)
+    {
+      queryMfccs[i] = mfccs[i] + 0.5f * random();
+    }
+    std::unique_ptr<simplevox::MfccFeature> query(engine.create(queryMfccs.get(), templateLength, kCoefNum));
+    simplevox::DtwWorkspace workspace;
+    if (!query || !workspace.init(templateLength)) { continue; }
+
+    simplevox::DtwConfig config;
+    config.band_width = templateLength / 10 + 1;
+    uint32_t distances[kBatchTemplates];
+    const auto batch = measure(kDtwCalls, [&](int) {
+      simplevox::calcDTWBatch(templatePtrs, kBatchTemplates, *query, distances, config, workspace);
+    });
+    printResult("calc_dtw_batch", "-", 0, 0, 0, kCoefNum, templateLength, kDtwCalls, batch);
+
+    const auto pruned = measure(kDtwCalls, [&](int) {
+      simplevox::calcDTWBatch(templatePtrs, envelopePtrs, kBatchTemplates, *query, distances, config, workspace);
+    });
+    printResult("calc_dtw_batch", "lb", 0, 0, 0, kCoefNum, templateLength, kDtwCalls, pruned);
+
+    simplevox::DtwWorkerPool pool;
+    simplevox::DtwPoolConfig poolConfig;
+    poolConfig.worker_num = kBatchWorkers;
+    if (!pool.init(templateLength, poolConfig)) { continue; }
+    const auto parallel = measure(kDtwCalls, [&](int) {
+      simplevox::calcDTWBatch(templatePtrs, envelopePtrs, kBatchTemplates, *query, distances, config, pool);
+    });
+    printResult("calc_dtw_batch", "lb_pool", 0, 0, 0, kCoefNum, templateLength, kDtwCalls, parallel);
+  }
+  engine.deinit();
+}
+
+/**
+ * @brief 録音のレートから16kHzへの変換(10msの入力ごと)
+ */
+void benchDecimator()
+{
+  for (int inputRate : kInputRates)
+  {
+    simplevox::DecimatorConfig config;
+    config.input_rate = inputRate;
+    config.output_rate = 16000;
+    simplevox::Decimator decimator;
+    if (!decimator.init(config)) { continue; }
+
+    const int length = kAudioTimeMs * inputRate / 1000;
+    const int frameLength = inputRate / 100;
+    const int frameNum = length / frameLength;
+    std::unique_ptr<int16_t[]> audio(new int16_t[length]);
+    std::unique_ptr<int16_t[]> output(new int16_t[config.output_rate / 100]);
+    makeAudio(audio.get(), length, inputRate);
+    const auto process = measure(frameNum, [&](int i) {
+      decimator.process(&audio[i * frameLength], frameLength, output.get());
+    });
+    printResult("decimate", "-", inputRate, 0, 0, 0, 1, frameNum, process);
+    decimator.deinit();
+  }
+}
+
+/**
+ * @brief インターリーブされた複数チャンネルのVAD, MFCCおよび照合(10msのフレームごと)
+ */
+void benchMultiChannel(const int16_t* audio, int length)
+{
+  simplevox::KwsConfig config;
+  const int frameLength = config.vad_config.frame_length();
+  const int frameNum = length / frameLength;
+  for (int channelNum : kChannelNums)
+  {
+    simplevox::MultiKeywordSpotter spotter;
+    if (!spotter.init(config, channelNum)) { continue; }
+    std::unique_ptr<simplevox::MfccFeature> feature(spotter.mfcc().create(&audio[length / 4], length / 2));
+    const simplevox::MfccFeature* templates[] = {feature.get()};
+    if (!feature || !spotter.setTemplates(templates, 1)) { continue; }
+
+    // 全チャンネルに同じ音声を振幅を変えて入力する
+    std::unique_ptr<int16_t[]> interleaved(new int16_t[length * channelNum]);
+    for (int i = 0; i < length; i++)
+    {
+      for (int ch = 0; ch < channelNum; ch++)
+      {
+        interleaved[i * channelNum + ch] = audio[i] / (ch + 1);
+      }
+    }
+    char name[8];
+    snprintf(name, sizeof(name), "%dch", channelNum);
+    const auto process = measure(frameNum, [&](int i) {
+      spotter.process(&interleaved[i * frameLength * channelNum]);
+    });
+    printResult("kws_multi", name, config.vad_config.sample_rate, config.mfcc_config.fft_num,
+                config.mfcc_config.mel_channel, config.mfcc_config.coef_num, 1, frameNum, process);
+  }
+}
+
+void runBenchmark()
+{
+  simplevox::platform::setAllocator({trackedAllocate, trackedDeallocate});
+  printHeader();
+  for (int sampleRate : kSampleRates)
+  {
+    const int length = kAudioTimeMs * sampleRate / 1000;
+    std::unique_ptr<int16_t[]> audio(new int16_t[length]);
+    makeAudio(audio.get(), length, sampleRate);
+    benchMfcc(audio.get(), length, sampleRate, simplevox::MfccArithmetic::Float);
+    benchMfcc(audio.get(), length, sampleRate, simplevox::MfccArithmetic::FixedPoint);
+    benchVad(audio.get(), length, sampleRate);
+    if (sampleRate == 16000)
+    {
+      benchMultiChannel(audio.get(), length);
+    }
+  }
+#if __cplusplus >= 201402L
+  benchStaticMfccs();
+#endif
+  benchDecimator();
+  benchDtw();
+  benchLowerBound();
+  benchQuantization();
+  printf("# done\n");
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(1000);
+  runBenchmark();
+}
+
+void loop()
+{
+  delay(1000);
+}
+#else
+int main()
+{
+  runBenchmark();
+  return 0;
+}
+#endif
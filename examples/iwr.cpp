@@ -11,9 +11,10 @@
 #define file_name "/wakeword.bin"
 constexpr int kSampleRate = 16000;
 constexpr int audioLength = kSampleRate * 3;  // 3 seconds
-constexpr int kRxBufferNum = 3;
+constexpr int kMicQueueNum = 2;    // M5.Mic.record()が同時に保持できる録音の数
+constexpr int kRxFrameNum = 8;
 int16_t* rawAudio;
-int16_t* rxBuffer;
+simplevox::AudioRing micRing;
 ns_handle_t nsInst;
 simplevox::VadEngine vadEngine;
 simplevox::MfccEngine mfccEngine;
@@ -24,20 +25,44 @@ LGFX_Button cmpButton;
 
 /**
  * @brief １フレームの録音を行い読み取り可能なバッファを返します
- * @return  読み取り可能な１フレーム分のバッファ
+ * @details
+ * 録音はAudioRing上に予約した領域へ直接行い、録音が完了したフレームのみを読み出す。
+ * 返したバッファは次の呼び出しまで上書きされない。
+ * @return  読み取り可能な１フレーム分のバッファ(録音が完了していない場合はnullptr)
  */
 int16_t* rxMic()
 {
-  static int rxIndex = 0;
+  static int recordingNum = 0;
+  static bool isHolding = false;
   const int frameLength = vadEngine.config().frame_length();
 
-  if (!M5.Mic.record(&rxBuffer[frameLength * rxIndex], frameLength, kSampleRate))
+  if (isHolding)
   {
-    return nullptr;
+    micRing.releaseRead(frameLength);
+    isHolding = false;
   }
-  rxIndex++;
-  rxIndex = (rxIndex >= kRxBufferNum) ? 0 : rxIndex;
-  return &rxBuffer[rxIndex * frameLength];
+  // 録音が完了したフレームを確定する
+  while (recordingNum > M5.Mic.isRecording())
+  {
+    micRing.commitWrite();
+    recordingNum--;
+  }
+  // 空きがあれば次のフレームの録音を開始する
+  while (recordingNum < kMicQueueNum)
+  {
+    auto* dest = micRing.acquireWrite(frameLength);
+    if (dest == nullptr) { break; }
+    if (!M5.Mic.record(dest, frameLength, kSampleRate))
+    {
+      micRing.cancelWrite();
+      break;
+    }
+    recordingNum++;
+  }
+
+  auto* data = micRing.acquireRead(frameLength);
+  isHolding = (data != nullptr);
+  return data;
 }
 
 
@@ -48,7 +73,7 @@ void setup() {
   mfccConfig.sample_rate = kSampleRate;
   constexpr uint32_t memCaps = (CONFIG_SPIRAM) ? (MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM) : MALLOC_CAP_8BIT;
   rawAudio = (int16_t*)heap_caps_malloc(audioLength * sizeof(*rawAudio), memCaps);
-  rxBuffer = (int16_t*)heap_caps_malloc(kRxBufferNum * vadConfig.frame_length() * sizeof(*rxBuffer), MALLOC_CAP_8BIT);
+  micRing.init(kRxFrameNum * vadConfig.frame_length(), vadConfig.frame_length(), MALLOC_CAP_8BIT);
 
   M5.begin();
   int w = M5.Lcd.width();
@@ -11,13 +11,12 @@
 #define file_name "/wakeword.bin"
 constexpr int kSampleRate = 16000;
 constexpr int audioLength = kSampleRate * 3;  // 3 seconds
-constexpr int kRxBufferNum = 3;
+constexpr int kMicQueueNum = 2;    // M5.Mic.record()が同時に保持できる録音の数
+constexpr int kRxFrameNum = 8;
 int16_t* rawAudio;
-int16_t* rxBuffer;
-int16_t* rawBuffer;
+simplevox::AudioRing micRing;
 ns_handle_t nsInst;
-simplevox::VadEngine vadEngine;
-simplevox::MfccEngine mfccEngine;
+simplevox::KeywordSpotter spotter;
 simplevox::MfccFeature* mfcc = nullptr;
 
 LGFX_Button regButton;
@@ -26,108 +25,67 @@ LGFX_Button cmpButton;
 /**
  * @brief 1サンプリングごとにMFCCを算出するexample
  * @details
- * VAD -> Buffer -> MFCCの流れで逐次的にMFCCの算出を行う。
+ * KeywordSpotterによりVAD -> MFCC -> DTWの流れで逐次的にMFCCの算出と照合を行う。
  * この例では参考のためにREGISTではraw dataを残しているが、
  * COMPAREの処理だけにすればraw dataは必要なくなるためメモリサイズの削減が可能となる。
- * 処理としてHangbeforeおよびPreDetection時間のデータ処理が複雑な点と
- * frame_lengthがVADとMFCCで異なり、１つの処理単位がhop_lengthである点など
- * 構造を理解していないと分からない処理が多いのが難点…。
+ * REGISTでもKeywordSpotter::createFeature()を利用すればraw dataなしで登録が可能。
  */
 
-/**
- * @brief 除算を行い演算結果を切り上げます（正の整数）
- * @param[in] dividend  被除数
- * @param[in]  divisor   除数
- * @return 切り上げた整数(3/2 -> 2)
- */
-constexpr int divCeil(int dividend, int divisor)
-{
-  return (dividend + divisor - 1) / divisor;
-}
-
 /**
  * @brief １フレームの録音を行い読み取り可能なバッファを返します
- * @return  読み取り可能な１フレーム分のバッファ
+ * @details
+ * 録音はAudioRing上に予約した領域へ直接行い、録音が完了したフレームのみを読み出す。
+ * 返したバッファは次の呼び出しまで上書きされない。
+ * @return  読み取り可能な１フレーム分のバッファ(録音が完了していない場合はnullptr)
  */
 int16_t* rxMic()
 {
-  static int rxIndex = 0;
-  const int frameLength = vadEngine.config().frame_length();
+  static int recordingNum = 0;
+  static bool isHolding = false;
+  const int frameLength = spotter.config().vad_config.frame_length();
 
-  if (!M5.Mic.record(&rxBuffer[frameLength * rxIndex], frameLength, kSampleRate))
+  if (isHolding)
   {
-    return nullptr;
+    micRing.releaseRead(frameLength);
+    isHolding = false;
   }
-  rxIndex++;
-  rxIndex = (rxIndex >= kRxBufferNum) ? 0 : rxIndex;
-  return &rxBuffer[rxIndex * frameLength];
-}
-
-int rawBufferMaxSize;
-int rawBufferSize;
-void raw_init(int length)
-{
-  rawBufferMaxSize = length;
-  rawBufferSize = 0;
-  rawBuffer = (int16_t*)heap_caps_calloc(rawBufferMaxSize, sizeof(*rawBuffer), MALLOC_CAP_8BIT);
-}
-
-int raw_size() { return rawBufferSize; }
-void raw_reset() { rawBufferSize = 0; }
-int16_t* raw_front() { return rawBuffer; }
-
-void raw_pushBack(const int16_t* src, int length)
-{
-  if (rawBufferSize + length <= rawBufferMaxSize)
+  // 録音が完了したフレームを確定する
+  while (recordingNum > M5.Mic.isRecording())
   {
-    std::copy_n(src, length, &rawBuffer[rawBufferSize]);
-    rawBufferSize += length;
+    micRing.commitWrite();
+    recordingNum--;
+  }
+  // 空きがあれば次のフレームの録音を開始する
+  while (recordingNum < kMicQueueNum)
+  {
+    auto* dest = micRing.acquireWrite(frameLength);
+    if (dest == nullptr) { break; }
+    if (!M5.Mic.record(dest, frameLength, kSampleRate))
+    {
+      micRing.cancelWrite();
+      break;
+    }
+    recordingNum++;
   }
-}
-
-void raw_popFront(int length)
-{
-  std::copy_n(&rawBuffer[length], rawBufferSize - length, rawBuffer);
-  rawBufferSize -= length;
-}
-
-float* features;
-int mfccFrameNum;
-int mfccCoefNum;
-int mfccBeforeFrameNum;
-void feature_init(const simplevox::MfccConfig& mfccConfig, const simplevox::VadConfig& vadConfig, int maxTimeMs)
-{
-  const int maxLength = maxTimeMs * mfccConfig.sample_rate / 1000;
-  mfccFrameNum = (maxLength - (mfccConfig.frame_length() - mfccConfig.hop_length())) / mfccConfig.hop_length();
-  mfccCoefNum = mfccConfig.coef_num;
-  features = (float*)heap_caps_malloc(sizeof(*features) * mfccFrameNum * mfccCoefNum, MALLOC_CAP_8BIT);
 
-  // VADのHangbeforeおよびPreDetectionに相当するデータサイズを算出
-  const int vadBeforeLength = 
-            vadConfig.frame_length() *
-            ( divCeil(vadConfig.before_length(), vadConfig.frame_length())
-            + divCeil(vadConfig.decision_length(), vadConfig.frame_length()));
-  // VADのBefore区間に相当するフレーム数を算出
-  mfccBeforeFrameNum = (vadBeforeLength - (mfccConfig.frame_length() - mfccConfig.hop_length())) / mfccConfig.hop_length();
+  auto* data = micRing.acquireRead(frameLength);
+  isHolding = (data != nullptr);
+  return data;
 }
 
-float* feature_get(int number) { return &features[number * mfccCoefNum]; }
-
 constexpr uint32_t memCaps = (CONFIG_SPIRAM) ? (MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM) : MALLOC_CAP_8BIT;
 
 void setup() {
   M5.Display.println("Setup !!");
 
-  auto vadConfig = vadEngine.config();
-  vadConfig.sample_rate = kSampleRate;
-  auto mfccConfig = mfccEngine.config();
-  mfccConfig.sample_rate = kSampleRate;
+  simplevox::KwsConfig kwsConfig;
+  kwsConfig.vad_config.sample_rate = kSampleRate;
+  kwsConfig.mfcc_config.sample_rate = kSampleRate;
+  kwsConfig.max_time_ms = 3000;
+  kwsConfig.threshold = 180;  // 180未満で一致と判定, しきい値は要調整
 
   rawAudio = (int16_t*)heap_caps_malloc(audioLength * sizeof(*rawAudio), memCaps);
-  rxBuffer = (int16_t*)heap_caps_malloc(kRxBufferNum * vadConfig.frame_length() * sizeof(*rxBuffer), MALLOC_CAP_8BIT);
-  
-  raw_init(mfccConfig.frame_length() + vadConfig.frame_length());
-  feature_init(mfccConfig, vadConfig, 3000);
+  micRing.init(kRxFrameNum * kwsConfig.vad_config.frame_length(), kwsConfig.vad_config.frame_length(), MALLOC_CAP_8BIT);
 
   M5.begin();
   int w = M5.Lcd.width();
@@ -151,20 +109,15 @@ void setup() {
   M5.Mic.begin();
 
 
-  nsInst = ns_pro_create(vadConfig.frame_time_ms, 1, vadConfig.sample_rate);
+  nsInst = ns_pro_create(kwsConfig.vad_config.frame_time_ms, 1, kwsConfig.vad_config.sample_rate);
   if (nsInst == NULL)
   {
     M5.Display.println("Failed to initialize ns.");
     while(true) delay(10);
   }
-  if (!vadEngine.init(vadConfig))
+  if (!spotter.init(kwsConfig))
   {
-    M5.Display.println("Failed to initialize vad.");
-    while(true) delay(10);
-  }
-  if (!mfccEngine.init(mfccConfig))
-  {
-    M5.Display.println("Failed to initialize mfcc.");
+    M5.Display.println("Failed to initialize spotter.");
     while(true) delay(10);
   }
   
@@ -172,7 +125,8 @@ void setup() {
   if (SPIFFS.exists(file_name))
   {
     M5.Display.println("File exists !!");
-    mfcc = mfccEngine.loadFile(base_path file_name);
+    mfcc = spotter.mfcc().loadFile(base_path file_name);
+    spotter.setTemplates(&mfcc, (mfcc != nullptr) ? 1 : 0);
   }
 
   M5.Display.println("Start !!");
@@ -205,7 +159,7 @@ void loop() {
 
   if (mode < 0) // 検出した音声を再生しMFCCを登録及びファイルに保存します
   {
-    int length = vadEngine.detect(rawAudio, audioLength, data);
+    int length = spotter.vad().detect(rawAudio, audioLength, data);
     if (length <= 0) { return; }
     M5.Mic.end();
     if (M5.Speaker.begin())
@@ -217,66 +171,31 @@ void loop() {
     M5.Mic.begin();
 
     if (mfcc != nullptr){ delete mfcc; }
-    mfcc = mfccEngine.create(rawAudio, length);
+    mfcc = spotter.mfcc().create(rawAudio, length);
 
     if (mfcc)
     {
-      mfccEngine.saveFile(base_path file_name, *mfcc);
+      spotter.mfcc().saveFile(base_path file_name, *mfcc);
     }
+    spotter.setTemplates(&mfcc, (mfcc != nullptr) ? 1 : 0);
 
-    vadEngine.reset();
+    spotter.reset();
     mode = 0;
   }
   else  // 登録したMFCCと検出した音声のMFCCを比較します
   {
     if (mfcc == nullptr) { return; }
 
-    static int mfccFrameCount = 0;
-    const auto state = vadEngine.process(data);
-    const int vadFrameLength = vadEngine.config().frame_length();
-    const int mfccFrameLength = mfccEngine.config().frame_length();
-    const int mfccHopLength = mfccEngine.config().hop_length();
-
-    // Silence以上ならrawBufferにデータを追加
-    if (state >= simplevox::VadState::Silence)
-    {
-      raw_pushBack(data, vadFrameLength);
-    }
-
-    // rawBufferにMFCCのframe_length()以上のデータがある場合はMFCCを算出
-    while (raw_size() >= mfccFrameLength && mfccFrameCount < mfccFrameNum)
-    {
-      // feature_pushBack
-      mfccEngine.calculate(raw_front(), feature_get(mfccFrameCount));
-      mfccFrameCount++;
-
-      raw_popFront(mfccHopLength);  // hop_length分シフト
-    }
-
-    // Speech以前(Silence, PreDetection)の場合はmfccBeforeFrameNumを超えた分は取り除く(シフトする)
-    if (state < simplevox::VadState::Speech && mfccFrameCount > mfccBeforeFrameNum)
+    const auto event = spotter.process(data);
+    if (event != simplevox::KwsEvent::None)
     {
-      const int shiftCount = mfccFrameCount - mfccBeforeFrameNum;
-      const int shiftLength = shiftCount * mfccCoefNum;
-      std::copy_n(&features[shiftLength], mfccFrameCount * mfccCoefNum - shiftLength, features);
-      mfccFrameCount -= shiftCount;
-    }
-
-    // 検出完了もしくは最大フレームに到達した場合は判定終了
-    if (state == simplevox::VadState::Detected
-        || (state >= simplevox::VadState::Speech && mfccFrameNum <= mfccFrameCount))
-    {
-      std::unique_ptr<simplevox::MfccFeature> feature(mfccEngine.create(features, mfccFrameCount, mfccCoefNum));
-      const auto dist = simplevox::calcDTW(*mfcc, *feature);
       char cbuf[64];
-      char pass = (dist < 180) ? '!': '?';  // 180未満で一致と判定, しきい値は要調整
-      sprintf(cbuf, "Dist: %6lu, %c", dist, pass);
+      char pass = (event == simplevox::KwsEvent::Match) ? '!': '?';
+      sprintf(cbuf, "Dist: %6lu, %c", spotter.distance(), pass);
       M5.Display.drawString(cbuf, 0, 50);
 
-      raw_reset();
-      mfccFrameCount = 0;
-      vadEngine.reset();
+      spotter.reset();
       mode = 0;
-    }    
+    }
   }
 }
@@ -0,0 +1,111 @@
+#include <M5Unified.h>
+
+#include <atomic>
+
+#include <esp_ns.h>
+#include <SPIFFS.h>
+
+#include "simplevox.h"
+
+#define base_path "/spiffs"
+#define file_name "/wakeword.bin"
+constexpr int kSampleRate = 16000;
+ns_handle_t nsInst;
+simplevox::KeywordSpotter spotter;
+simplevox::KwsPipeline pipeline;
+simplevox::MfccFeature* mfcc = nullptr;
+
+std::atomic<int> eventCount(0);
+std::atomic<uint32_t> lastDistance(0);
+std::atomic<bool> lastMatched(false);
+
+/**
+ * @brief 録音+VADと、MFCC+DTWを別々のコアで実行するexample
+ * @details
+ * KwsPipelineにより録音とVADをコア0、MFCCの算出と照合をコア1のタスクで実行する。
+ * 照合中も録音は継続されるため、照合に時間がかかってもフレームの取りこぼしが発生しない。
+ * テンプレートは iwr_advnced などで登録したファイル(/spiffs/wakeword.bin)を使用する。
+ * 判定結果は照合タスクから通知されるため、画面の更新はloop()で行う。
+ */
+
+/**
+ * @brief １フレームの録音とノイズ抑制を行います(録音タスクから呼ばれる)
+ */
+bool captureFrame(int16_t* dest, int length, void* /* user_data */)
+{
+  if (!M5.Mic.record(dest, length, kSampleRate)) { return false; }
+  while (M5.Mic.isRecording()) { vTaskDelay(1); }
+  ns_process(nsInst, dest, dest);
+  return true;
+}
+
+/**
+ * @brief 判定結果を保持します(照合タスクから呼ばれる)
+ */
+void onResult(simplevox::KwsEvent event, simplevox::KeywordSpotter& kws, void* /* user_data */)
+{
+  lastDistance = kws.distance();
+  lastMatched = (event == simplevox::KwsEvent::Match);
+  eventCount++;
+}
+
+void setup() {
+  M5.begin();
+  M5.Display.println("Setup !!");
+
+  simplevox::KwsConfig kwsConfig;
+  kwsConfig.vad_config.sample_rate = kSampleRate;
+  kwsConfig.mfcc_config.sample_rate = kSampleRate;
+  kwsConfig.max_time_ms = 3000;
+  kwsConfig.threshold = 180;  // 180未満で一致と判定, しきい値は要調整
+
+  auto micConfig = M5.Mic.config();
+  micConfig.stereo = false;
+  micConfig.sample_rate = kSampleRate;
+  M5.Mic.config(micConfig);
+  M5.Mic.begin();
+
+  nsInst = ns_pro_create(kwsConfig.vad_config.frame_time_ms, 1, kwsConfig.vad_config.sample_rate);
+  if (nsInst == NULL)
+  {
+    M5.Display.println("Failed to initialize ns.");
+    while(true) delay(10);
+  }
+  if (!spotter.init(kwsConfig))
+  {
+    M5.Display.println("Failed to initialize spotter.");
+    while(true) delay(10);
+  }
+
+  SPIFFS.begin(true);
+  mfcc = spotter.mfcc().loadFile(base_path file_name);
+  if (mfcc == nullptr)
+  {
+    M5.Display.println("Template not found.");
+    while(true) delay(10);
+  }
+  spotter.setTemplates(&mfcc, 1);
+
+  if (!pipeline.start(spotter, captureFrame, onResult))
+  {
+    M5.Display.println("Failed to start pipeline.");
+    while(true) delay(10);
+  }
+
+  M5.Display.println("Start !!");
+}
+
+void loop() {
+  static int displayedCount = 0;
+  const int count = eventCount;
+  if (count != displayedCount)
+  {
+    char cbuf[64];
+    sprintf(cbuf, "Dist: %6lu, %c", (unsigned long)lastDistance.load(), lastMatched ? '!' : '?');
+    M5.Display.drawString(cbuf, 0, 50);
+    sprintf(cbuf, "Dropped: %6lu", (unsigned long)pipeline.droppedFrames());
+    M5.Display.drawString(cbuf, 0, 80);
+    displayedCount = count;
+  }
+  delay(10);
+}
@@ -1,31 +1,57 @@
 #include <M5Unified.h>
 
+#include "simplevox_ring.h"
 #include "simplevox_vad.h"
 
 int soundLength;
 int16_t* sound;
-constexpr int kRxBufferNum = 3;
+constexpr int kMicQueueNum = 2;    // M5.Mic.record()が同時に保持できる録音の数
+constexpr int kRxFrameNum = 8;
 constexpr int kSampleRate = 16000;
-int16_t* rxBuffer;
+simplevox::AudioRing micRing;
 simplevox::VadConfig vadConfig;
 simplevox::VadEngine vadEngine;
 
 /**
  * @brief １フレームの録音を行い読み取り可能なバッファを返します
- * @return  読み取り可能な１フレーム分のバッファ
+ * @details
+ * 録音はAudioRing上に予約した領域へ直接行い、録音が完了したフレームのみを読み出す。
+ * 返したバッファは次の呼び出しまで上書きされない。
+ * @return  読み取り可能な１フレーム分のバッファ(録音が完了していない場合はnullptr)
  */
 int16_t* rxMic()
 {
-  static int rxIndex = 0;
+  static int recordingNum = 0;
+  static bool isHolding = false;
   const int frameLength = vadConfig.frame_length();
 
-  if (!M5.Mic.record(&rxBuffer[frameLength * rxIndex], frameLength, kSampleRate))
+  if (isHolding)
   {
-    return nullptr;
+    micRing.releaseRead(frameLength);
+    isHolding = false;
   }
-  rxIndex++;
-  rxIndex = (rxIndex >= kRxBufferNum) ? 0 : rxIndex;
-  return &rxBuffer[rxIndex * frameLength];
+  // 録音が完了したフレームを確定する
+  while (recordingNum > M5.Mic.isRecording())
+  {
+    micRing.commitWrite();
+    recordingNum--;
+  }
+  // 空きがあれば次のフレームの録音を開始する
+  while (recordingNum < kMicQueueNum)
+  {
+    auto* dest = micRing.acquireWrite(frameLength);
+    if (dest == nullptr) { break; }
+    if (!M5.Mic.record(dest, frameLength, kSampleRate))
+    {
+      micRing.cancelWrite();
+      break;
+    }
+    recordingNum++;
+  }
+
+  auto* data = micRing.acquireRead(frameLength);
+  isHolding = (data != nullptr);
+  return data;
 }
 
 /**
@@ -64,7 +90,7 @@ void setup() {
 
   soundLength = 3 * kSampleRate;
   sound = (int16_t*)heap_caps_malloc(sizeof(*sound) * soundLength, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
-  rxBuffer = (int16_t*)heap_caps_malloc(sizeof(*rxBuffer) * kRxBufferNum * frameLength, MALLOC_CAP_8BIT);
+  micRing.init(kRxFrameNum * frameLength, frameLength, MALLOC_CAP_8BIT);
 
   M5.begin();
 
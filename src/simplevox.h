@@ -10,8 +10,19 @@
 #ifndef SIMPLEVOX_H_
 #define SIMPLEVOX_H_
 
+#include "utility/simplevox_decimator.h"
 #include "utility/simplevox_dtw.h"
+#include "utility/simplevox_kws.h"
 #include "utility/simplevox_mfcc.h"
+#include "utility/simplevox_multi_kws.h"
+#include "utility/simplevox_partition.h"
+#include "utility/simplevox_pipeline.h"
+#include "utility/simplevox_platform.h"
+#include "utility/simplevox_ring.h"
+#include "utility/simplevox_sdtw.h"
+#if __cplusplus >= 201402L
+#include "utility/simplevox_static_mfcc.h"     // C++14以降(constexprのループを用いるため)
+#endif
 #include "utility/simplevox_vad.h"
 
 #endif // SIMPLEVOX_H_
\ No newline at end of file
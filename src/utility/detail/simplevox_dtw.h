@@ -12,72 +12,245 @@
 
 #include "../simplevox_dtw.h"
 
+#include <algorithm>
+#include <atomic>
+#include <limits.h>
 #include <math.h>
 #include <memory>
+#include <new>
 
 namespace simplevox
 {
 namespace detail
 {
+    constexpr int kDistanceCoef = 1000;
+
+    /**
+     * @brief   dtwStats()に１回分のDPの結果を加えます
+     */
+    void AddDtwStats(uint64_t cell_count, bool is_abandoned);
+
+    /**
+     * @brief   dtwStats()に下限値によりDPを省略したテンプレートを１つ加えます
+     */
+    void AddDtwPrunedStats();
+
     int InnerProduct(const int16_t* vec1, int n, const int16_t* vec2);
+    int InnerProduct(const int16_t* vec1, int n, const int8_t* vec2);
+    int InnerProduct(const int8_t* vec1, int n, const int16_t* vec2);
+    int InnerProduct(const int8_t* vec1, int n, const int8_t* vec2);
     inline int InnerProduct(const int16_t* vec, int n) { return InnerProduct(vec, n, vec); }
+    void InnerProduct4(const int16_t* vec, int n,
+                       const int16_t* vec0, const int16_t* vec1, const int16_t* vec2, const int16_t* vec3,
+                       int* dest);
+    void InnerProduct4(const int16_t* vec, int n,
+                       const int8_t* vec0, const int8_t* vec1, const int8_t* vec2, const int8_t* vec3,
+                       int* dest);
+    void InnerProduct4(const int8_t* vec, int n,
+                       const int16_t* vec0, const int16_t* vec1, const int16_t* vec2, const int16_t* vec3,
+                       int* dest);
+    void InnerProduct4(const int8_t* vec, int n,
+                       const int8_t* vec0, const int8_t* vec1, const int8_t* vec2, const int8_t* vec3,
+                       int* dest);
+
+    /**
+     * @brief   ベクトルと特徴量のフレーム[begin, end)それぞれとの内積を求める
+     * @details ４フレームずつまとめて計算し、vecの読み出しを共有する
+     * @param[in]   vec     ベクトル(feature.dimension()個)
+     * @param[in]   feature 特徴量
+     * @param[in]   begin   開始フレーム
+     * @param[in]   end     終了フレーム(含まない)
+     * @param[out]  dest    内積の格納先(dest[begin]からdest[end - 1]に格納)
+     */
+    template <typename U, class T, typename V>
+    void InnerProductRow(const U* vec, const ISoundFeature<T, V> &feature, int begin, int end, int* dest)
+    {
+        const int dimension = feature.dimension();
+        int j = begin;
+        for (; j + 4 <= end; j += 4)
+        {
+            InnerProduct4(vec, dimension,
+                          feature.feature(j), feature.feature(j + 1), feature.feature(j + 2), feature.feature(j + 3),
+                          &dest[j]);
+        }
+        for (; j < end; j++)
+        {
+            dest[j] = InnerProduct(vec, dimension, feature.feature(j));
+        }
+    }
     float CosineDistancef(int inner12, int inner1, int inner2);
     uint32_t CosineDistance(int inner12, int inner1, int inner2);
-}
+
     /**
-     * @brief   ２つの特徴量の最小となるDTW距離を計算します
-     * @param[in]   feature1    特徴量１
-     * @param[in]   feature2    特徴量２
-     * @return  平均移動距離（0~2000, 全移動距離をステップ数で割ったもの）
-    */
-    template <class T1, class T2>
-    uint32_t calcDTW(const ISoundFeature<T1> &feature1, const ISoundFeature<T2> &feature2)
+     * @brief 0から2*kDistanceCoefの値をとるコサイン距離を求める
+     * @param[in] inner12           ベクトル１と２の内積
+     * @param[in] inverse_norm12    ベクトル１と２のノルムの逆数の積(kDistanceCoef倍したもの)
+     * @return 0 - 2000までの値, 大きいほど類似度が低い
+     * @note 平方根や除算を含まないためDPの各セルで用いる
+     */
+    inline uint32_t CosineDistance(int inner12, float inverse_norm12)
     {
-        using namespace simplevox::detail;
-        const int dimension = feature1.dimension();
-        if (dimension != feature2.dimension())
+        const float distance = kDistanceCoef - inner12 * inverse_norm12;
+        return (distance > 0) ? distance : 0;
+    }
+
+    /**
+     * @brief 特徴量のi番目のフレームのノルムの逆数(保持していない場合は算出する)
+     */
+    template <class T, typename V>
+    float InverseNorm(const ISoundFeature<T, V> &feature, int i)
+    {
+        const float* inverse_norms = feature.inverse_norms();
+        return (inverse_norms != nullptr)
+                ? inverse_norms[i]
+                : calcInverseNorm(feature.feature(i), feature.dimension());
+    }
+
+    /**
+     * @brief   ２つの特徴量がDTWで比較可能か
+     */
+    template <class T1, class T2, typename V1, typename V2>
+    bool IsComparable(const ISoundFeature<T1, V1> &feature1, const ISoundFeature<T2, V2> &feature2)
+    {
+        if (feature1.dimension() != feature2.dimension())
         {
-            return UINT32_MAX;
+            return false;
         }
         if (feature1.size() <= 0 || feature2.size() <= 0)
         {
-            return UINT32_MAX;
+            return false;
         }
         if (feature1.size() > 3 * feature2.size() || 3 * feature1.size() < feature2.size())
         {
-            return UINT32_MAX;
+            return false;
         }
+        return true;
+    }
 
-        std::unique_ptr<int16_t[]> step_counts(new (std::nothrow) int16_t [feature2.size()]);
-        std::unique_ptr<uint32_t[]> step_distances(new (std::nothrow) uint32_t[feature2.size()]);
-        if (!step_counts || !step_distances)
+    /**
+     * @brief   特徴量の各フレームのノルムの逆数を設定します
+     */
+    template <class T, typename V>
+    void SetupInverseNorms(const ISoundFeature<T, V> &feature, float* inverse_norm)
+    {
+        for (int j = 0; j < feature.size(); j++)
         {
-            return UINT32_MAX;
+            inverse_norm[j] = InverseNorm(feature, j);
+        }
+    }
+
+    /**
+     * @brief   Sakoe-Chibaバンドの幅(特徴量２のフレーム数)を算出します
+     * @return  バンドの幅, 制約なしの場合は特徴量２のフレーム数
+     * @note    経路が必ず存在するように傾き(特徴量の長さの比)を下限とします
+     */
+    inline int BandWidth(const DtwConfig& config, int size1, int size2)
+    {
+        if (config.band_width < 0 || size1 <= 1)
+        {
+            return size2;
         }
+        const int slope = (size2 - 1 + size1 - 2) / (size1 - 1);  // ceil((size2 - 1) / (size1 - 1))
+        return (config.band_width > slope) ? config.band_width : slope;
+    }
+
+    /**
+     * @brief   特徴量１のフレームiに対応する特徴量２の対角線上のフレーム
+     */
+    inline int BandCenter(int i, int size1, int size2)
+    {
+        return (size1 <= 1) ? 0 : (i * (size2 - 1) + (size1 - 1) / 2) / (size1 - 1);
+    }
+
+    /**
+     * @brief   DTW距離を計算します(比較可能であること, 作業領域は設定済みであること)
+     * @details
+     * 特徴量１のフレームiに対して、特徴量２のフレームjは対角線上の位置
+     * i * (N2 - 1) / (N1 - 1)からバンドの幅以内のみ評価します(範囲外は到達不可として扱う)。
+     * また、打ち切り距離が指定されている場合、各行の評価後にその行のいずれのセルを経由しても
+     * 打ち切り距離未満にならないことが確定すると計算を打ち切ります。
+     * セル(i, j)の累積距離をD、ステップ数をsとすると、最終的な平均移動距離は
+     * D / (s + (N1 - 1 - i) + (N2 - 1 - j))以上となるためこれを判定に用います。
+     * @param[in]   feature1    特徴量１
+     * @param[in]   feature2    特徴量２
+     * @param[in]   config      DTWのコンフィグ
+     * @param[in]   workspace   inverse_norm2()にfeature2の各フレームのノルムの逆数を設定した作業領域
+     * @return  平均移動距離, 打ち切った場合はUINT32_MAX
+     */
+    template <class T1, class T2, typename V1, typename V2>
+    uint32_t CalcDTW(const ISoundFeature<T1, V1> &feature1, const ISoundFeature<T2, V2> &feature2,
+                     const DtwConfig& config, DtwWorkspace& workspace)
+    {
+        constexpr uint32_t kUnreachable = UINT32_MAX;
+        const int size1 = feature1.size();
+        const int size2 = feature2.size();
+        const float* inverse_norm2 = workspace.inverse_norm2();
+        int* inner_row = workspace.inner_row();
+        int16_t* step_counts = workspace.step_counts();
+        uint32_t* step_distances = workspace.step_distances();
 
-        const auto inner1_0 = InnerProduct(feature1.feature(0), dimension);
-        const auto inner2_0 = InnerProduct(feature2.feature(0), dimension);
+        const int band_width = BandWidth(config, size1, size2);
+        const bool can_abandon = config.abandon_distance != UINT32_MAX;
+        const uint64_t abandon_distance = config.abandon_distance;
+
+        const float inverse_norm1_0 = kDistanceCoef * InverseNorm(feature1, 0);
+        int prev_lo = 0;
+        int prev_hi = (size1 <= 1) ? size2 - 1 : std::min(size2 - 1, BandCenter(0, size1, size2) + band_width);
+
+        InnerProductRow(feature1.feature(0), feature2, 0, prev_hi + 1, inner_row);
+#if SIMPLEVOX_ENABLE_STATS
+        uint64_t cell_count = prev_hi + 1;
+#endif
 
         // f1[0], f2[0]
-        step_distances[0] = 2 * CosineDistance(InnerProduct(feature1.feature(0), dimension, feature2.feature(0)), inner1_0, inner2_0);
+        step_distances[0] = 2 * CosineDistance(inner_row[0], inverse_norm1_0 * inverse_norm2[0]);
         step_counts[0] = 0;
 
-        for (int j = 1; j < feature2.size(); j++)   // f1[0], f2[j] | 1 <= j < N
+        for (int j = 1; j <= prev_hi; j++)   // f1[0], f2[j] | 1 <= j < N
         {
-            const auto inner12_j = InnerProduct(feature1.feature(0), dimension, feature2.feature(j));
-            const auto inner2_j = InnerProduct(feature2.feature(j), dimension);
-            step_distances[j] = step_distances[j - 1] + CosineDistance(inner12_j, inner1_0, inner2_j);
+            step_distances[j] = step_distances[j - 1] + CosineDistance(inner_row[j], inverse_norm1_0 * inverse_norm2[j]);
             step_counts[j] = j; // = step_counts[j - 1] + 1
         }
+        for (int j = prev_hi + 1; j < size2; j++)
+        {
+            step_distances[j] = kUnreachable;
+        }
 
-        const int last = feature2.size() - 1;
-        for (int i = 1; i < feature1.size(); i++)   // f1[i] | 1 <= i < N, f2[j] | 1 <= j < N
+        const int last = size2 - 1;
+        for (int i = 1; i < size1; i++)   // f1[i] | 1 <= i < N, f2[j] | lo <= j <= hi
         {
-            const auto inner1_i = InnerProduct(feature1.feature(i), dimension);
-            const auto inner12_i0 = InnerProduct(feature1.feature(i), dimension, feature2.feature(0));
-            uint32_t prev_step_dist = step_distances[0] + CosineDistance(inner12_i0, inner1_i, inner2_0);
-            int prev_step_count = step_counts[0] + 1;
-            for (int j = 1; j < feature2.size(); j++)
+            if (can_abandon)
+            {
+                bool is_alive = false;
+                const int rest_i = size1 - i;   // = (N1 - 1) - (i - 1)
+                for (int j = prev_lo; j <= prev_hi && !is_alive; j++)
+                {
+                    const uint64_t rest_steps = step_counts[j] + rest_i + (last - j);
+                    is_alive = step_distances[j] != kUnreachable
+                            && step_distances[j] < abandon_distance * rest_steps;
+                }
+                if (!is_alive)
+                {
+#if SIMPLEVOX_ENABLE_STATS
+                    AddDtwStats(cell_count, true);
+#endif
+                    return UINT32_MAX;
+                }
+            }
+
+            const int lo = std::max(0, BandCenter(i, size1, size2) - band_width);
+            const int hi = std::min(last, BandCenter(i, size1, size2) + band_width);
+            for (int j = prev_lo; j < lo - 1; j++)  // バンドから外れた前の行のセル(lo - 1はループ内で無効化)
+            {
+                step_distances[j] = kUnreachable;
+            }
+
+            const float inverse_norm1_i = kDistanceCoef * InverseNorm(feature1, i);
+            InnerProductRow(feature1.feature(i), feature2, lo, hi + 1, inner_row);
+            SIMPLEVOX_STATS_ADD(cell_count, hi - lo + 1);
+            uint32_t prev_step_dist = kUnreachable;
+            int prev_step_count = 0;
+            for (int j = lo; j <= hi; j++)
             {
                 uint32_t step_dist;
                 int step_count;
@@ -91,27 +264,607 @@ namespace detail
                     step_dist = prev_step_dist;
                     step_count = prev_step_count;
                 }
-                if (step_distances[j - 1] < step_dist)
+                if (j > 0 && step_distances[j - 1] < step_dist)
                 {
                     step_dist = step_distances[j - 1];
                     step_count = step_counts[j - 1];
                 }
 
-                const auto inner12_ij = InnerProduct(feature1.feature(i), dimension, feature2.feature(j));
-                const auto inner2_j = InnerProduct(feature2.feature(j), dimension);
-                step_dist += CosineDistance(inner12_ij, inner1_i, inner2_j);
-                step_count += 1;
-                step_distances[j - 1] = prev_step_dist;
-                step_counts[j - 1] = prev_step_count;
+                if (step_dist != kUnreachable)
+                {
+                    step_dist += CosineDistance(inner_row[j], inverse_norm1_i * inverse_norm2[j]);
+                    step_count += 1;
+                }
+                if (j > 0)
+                {
+                    step_distances[j - 1] = prev_step_dist;
+                    step_counts[j - 1] = prev_step_count;
+                }
                 prev_step_dist = step_dist;
                 prev_step_count = step_count;
             }
-            step_distances[last] = prev_step_dist;
-            step_counts[last] = prev_step_count;
+            step_distances[hi] = prev_step_dist;
+            step_counts[hi] = prev_step_count;
+            prev_lo = lo;
+            prev_hi = hi;
+        }
+#if SIMPLEVOX_ENABLE_STATS
+        AddDtwStats(cell_count, false);
+#endif
+
+        if (step_distances[last] == kUnreachable || step_counts[last] == 0)
+        {
+            return (size1 == 1 && size2 == 1) ? step_distances[0] / 2 : UINT32_MAX;
         }
         return step_distances[last] / step_counts[last];
     }
+
+    /**
+     * @brief   LB_KimおよびLB_KeoghによるDTW距離(平均移動距離)の下限値を求めます
+     * @details
+     * 経路は(0, 0)と(N1 - 1, N2 - 1)を必ず通り、特徴量２の各フレームをいずれかの行で１回以上通るため、
+     * 累積距離は始点(２倍)と終点の距離に、特徴量２のフレーム1~N2-2それぞれについての
+     * バンド内の特徴量１のフレームとの距離の下限(包絡線から算出)を加えたもの以上となります。
+     * ステップ数はN1 + N2 - 2以下であるため、これで割った値を下限値とします。
+     * @param[in]   feature1        特徴量１
+     * @param[in]   envelope        特徴量１の包絡線, nullptrまたは特徴量１と一致しない場合はLB_Kimのみ
+     * @param[in]   feature2        特徴量２
+     * @param[in]   config          DTWのコンフィグ
+     * @param[in]   inverse_norm2   特徴量２の各フレームのノルムの逆数
+     * @param[in]   bound           下限値がこの値以上となることが確定した時点で打ち切る
+     * @return  下限値(打ち切った場合はbound以上の値)
+     */
+    template <class T1, class T2, typename V1, typename V2>
+    uint32_t LowerBound(const ISoundFeature<T1, V1> &feature1, const DtwEnvelope* envelope,
+                        const ISoundFeature<T2, V2> &feature2, const DtwConfig& config,
+                        const float* inverse_norm2, uint32_t bound)
+    {
+        const int size1 = feature1.size();
+        const int size2 = feature2.size();
+        const uint64_t max_steps = size1 + size2 - 2;
+        if (max_steps == 0) { return 0; }
+        const int last1 = size1 - 1;
+        const int last2 = size2 - 1;
+        const int dimension = feature2.dimension();
+
+        // LB_Kim: 始点と終点
+        const float inverse_norm1_0 = kDistanceCoef * InverseNorm(feature1, 0);
+        const float inverse_norm1_last = kDistanceCoef * InverseNorm(feature1, last1);
+        uint64_t sum = 2 * CosineDistance(InnerProduct(feature1.feature(0), dimension, feature2.feature(0)),
+                                          inverse_norm1_0 * inverse_norm2[0])
+                     + CosineDistance(InnerProduct(feature1.feature(last1), dimension, feature2.feature(last2)),
+                                      inverse_norm1_last * inverse_norm2[last2]);
+        const uint64_t limit = (uint64_t)bound * max_steps;
+        if (envelope == nullptr || envelope->size() != size1 || envelope->dimension() != dimension || sum >= limit)
+        {
+            return sum / max_steps;
+        }
+
+        // LB_Keogh: 特徴量２のフレームjを評価する行[row_lo, row_hi]を半径radiusの包絡線で覆い、内積の上限を求める
+        const int band_width = BandWidth(config, size1, size2);
+        const int window = 2 * envelope->radius() + 1;
+        int row_lo = 0;
+        int row_hi = 0;
+        for (int j = 1; j < last2; j++)
+        {
+            while (BandCenter(row_lo, size1, size2) + band_width < j) { row_lo++; }
+            while (row_hi + 1 < size1 && BandCenter(row_hi + 1, size1, size2) - band_width <= j) { row_hi++; }
+            if (row_lo > row_hi) { continue; }
+
+            const V2* vec = feature2.feature(j);
+            int max_inner = INT_MIN;
+            for (int begin = row_lo; begin <= row_hi; begin += window)
+            {
+                const int center = std::min(begin + envelope->radius(), last1);
+                const int8_t* upper = envelope->upper(center);
+                const int8_t* lower = envelope->lower(center);
+                int inner = 0;
+                for (int k = 0; k < dimension; k++)
+                {
+                    const int v = vec[k];
+                    inner += v * ((v >= 0) ? upper[k] : lower[k]);
+                }
+                max_inner = std::max(max_inner, inner);
+            }
+            const float distance = kDistanceCoef
+                                 - max_inner * (kDistanceCoef * inverse_norm2[j] / DtwEnvelope::kScale);
+            if (distance > 1)
+            {
+                sum += (uint32_t)distance - 1;  // DPの各セルとの丸め誤差を考慮して１小さくする
+            }
+            if (sum >= limit) { break; }
+        }
+        return sum / max_steps;
+    }
+}
+
+namespace detail
+{
+    /**
+     * @brief   DtwWorkerPoolで分担するcalcDTWBatch()の状態
+     * @details
+     * 最小の距離は(距離 << 32 | テンプレートの番号)として保持し、アトミックに更新する。
+     * 同じ距離の場合は番号が小さいものが優先されるため、結果は逐次実行の場合と一致する。
+     */
+    template <class T1, class T2, typename V2>
+    struct ParallelBatch
+    {
+        const T1* const* templates;
+        const DtwEnvelope* const* envelopes;
+        int num;
+        const ISoundFeature<T2, V2>* query;
+        uint32_t* distances;
+        const DtwConfig* config;
+        DtwWorkerPool* pool;
+        int first;                      ///< 最初に算出するテンプレート(下限値が最小のもの)
+        std::atomic<int> next;          ///< 次に取り出す順番
+        std::atomic<uint64_t> best;     ///< 最小の距離と番号
+
+        /**
+         * @brief   各ワーカーで下限値を求め、distancesに一時的に保持する
+         */
+        static void Bound(void* arg, int worker)
+        {
+            auto* batch = static_cast<ParallelBatch*>(arg);
+            const ISoundFeature<T2, V2>& query = *batch->query;
+            DtwWorkspace& workspace = batch->pool->workspace(worker);
+            SetupInverseNorms(query, workspace.inverse_norm2());
+            for (int k = batch->next++; k < batch->num; k = batch->next++)
+            {
+                if (!IsComparable(*batch->templates[k], query)) { continue; }
+                const DtwEnvelope* envelope = (batch->envelopes != nullptr) ? batch->envelopes[k] : nullptr;
+                batch->distances[k] = LowerBound(*batch->templates[k], envelope, query, *batch->config,
+                                                 workspace.inverse_norm2(), batch->config->abandon_distance);
+            }
+        }
+
+        /**
+         * @brief   各ワーカーで下限値が最小の距離未満のテンプレートのDTW距離を求める
+         */
+        static void Match(void* arg, int worker)
+        {
+            auto* batch = static_cast<ParallelBatch*>(arg);
+            DtwWorkspace& workspace = batch->pool->workspace(worker);
+            for (int n = batch->next++; n < batch->num; n = batch->next++)
+            {
+                // first, 0, 1, ..., first - 1, first + 1, ...の順に取り出す
+                const int k = (n == 0) ? batch->first : ((n - 1 < batch->first) ? n - 1 : n);
+                uint32_t* distance = &batch->distances[k];
+                if (*distance == UINT32_MAX) { continue; }
+
+                uint32_t limit = batch->config->abandon_distance;
+                const uint64_t best = batch->best.load();
+                if (best != UINT64_MAX)
+                {
+                    const uint32_t best_distance = best >> 32;
+                    const int best_index = best & UINT32_MAX;
+                    limit = std::min(limit, (k < best_index) ? best_distance + 1 : best_distance);
+                }
+                if (*distance >= limit)
+                {
+                    *distance = UINT32_MAX;
+                    AddDtwPrunedStats();
+                    continue;
+                }
+
+                DtwConfig bounded_config = *batch->config;
+                bounded_config.abandon_distance = limit;
+                *distance = CalcDTW(*batch->templates[k], *batch->query, bounded_config, workspace);
+                if (*distance >= limit) { continue; }
+
+                const uint64_t candidate = (uint64_t)*distance << 32 | (uint32_t)k;
+                uint64_t current = batch->best.load();
+                while (candidate < current && !batch->best.compare_exchange_weak(current, candidate)) {}
+            }
+        }
+    };
+}
+
+    template <class T, typename V>
+    bool DtwEnvelope::init(const ISoundFeature<T, V> &feature, int radius)
+    {
+        using namespace simplevox::detail;
+        const int frame_num = feature.size();
+        const int dimension = feature.dimension();
+        int8_t* upper = prepare(frame_num, dimension, radius);
+        if (upper == nullptr) { return false; }
+        int8_t* lower = &upper[frame_num * dimension];
+
+        std::unique_ptr<float[]> inverse_norms(new (std::nothrow) float[frame_num]);
+        if (!inverse_norms)
+        {
+            deinit();
+            return false;
+        }
+        SetupInverseNorms(feature, inverse_norms.get());
+
+        for (int i = 0; i < frame_num; i++)
+        {
+            const int lo = std::max(0, i - radius);
+            const int hi = std::min(frame_num - 1, i + radius);
+            for (int k = 0; k < dimension; k++)
+            {
+                float max_val = -1;
+                float min_val = 1;
+                for (int m = lo; m <= hi; m++)
+                {
+                    const float value = feature.feature(m)[k] * inverse_norms[m];
+                    max_val = std::max(max_val, value);
+                    min_val = std::min(min_val, value);
+                }
+                upper[i * dimension + k] = (int8_t)std::min<float>(kScale, ceilf(max_val * kScale));
+                lower[i * dimension + k] = (int8_t)std::max<float>(-kScale, floorf(min_val * kScale));
+            }
+        }
+        return true;
+    }
+    /**
+     * @brief   ２つの特徴量の最小となるDTW距離を計算します
+     * @param[in]   feature1    特徴量１
+     * @param[in]   feature2    特徴量２
+     * @return  平均移動距離（0~2000, 全移動距離をステップ数で割ったもの）
+    */
+    template <class T1, class T2, typename V1, typename V2>
+    uint32_t calcDTW(const ISoundFeature<T1, V1> &feature1, const ISoundFeature<T2, V2> &feature2)
+    {
+        return calcDTW(feature1, feature2, DtwConfig());
+    }
+
+    /**
+     * @brief   ２つの特徴量の最小となるDTW距離を計算します
+     * @param[in]   feature1    特徴量１
+     * @param[in]   feature2    特徴量２
+     * @param[in]   config      バンドの幅や打ち切り距離などのコンフィグ
+     * @return  平均移動距離（0~2000）, 打ち切った場合や経路が存在しない場合はUINT32_MAX
+    */
+    template <class T1, class T2, typename V1, typename V2>
+    uint32_t calcDTW(const ISoundFeature<T1, V1> &feature1, const ISoundFeature<T2, V2> &feature2,
+                     const DtwConfig& config)
+    {
+        using namespace simplevox::detail;
+        if (!IsComparable(feature1, feature2))
+        {
+            return UINT32_MAX;
+        }
+
+        DtwWorkspace workspace;
+        if (!workspace.init(feature2.size()))
+        {
+            return UINT32_MAX;
+        }
+        SetupInverseNorms(feature2, workspace.inverse_norm2());
+        return CalcDTW(feature1, feature2, config, workspace);
+    }
+
+    /**
+     * @brief   DTW距離が最小となる経路を求めます(テンプレートの平均化などの登録時の処理用)
+     * @details 経路の選び方(同じ累積距離の場合の優先順位を含む)はcalcDTW()と同じです
+     * @param[in]   feature1    特徴量１
+     * @param[in]   feature2    特徴量２
+     * @param[in]   config      バンドの幅のコンフィグ(abandon_distanceは無視)
+     * @param[out]  path1       経路上の各セルの特徴量１のフレーム番号(始点から順に, size1 + size2 - 1個以上)
+     * @param[out]  path2       経路上の各セルの特徴量２のフレーム番号(path1と同じ個数)
+     * @return  経路のセル数, 比較できない場合や経路が存在しない場合, 確保に失敗した場合は0
+     * @note    size1 * size2バイトの作業領域をヒープに確保します
+     */
+    template <class T1, class T2, typename V1, typename V2>
+    int calcDTWPath(const ISoundFeature<T1, V1> &feature1, const ISoundFeature<T2, V2> &feature2,
+                    const DtwConfig& config, int16_t* path1, int16_t* path2)
+    {
+        using namespace simplevox::detail;
+        enum Step: uint8_t { Start, FromPrevRow, FromPrevColumn, FromDiagonal };
+        constexpr uint32_t kUnreachable = UINT32_MAX;
+        if (!IsComparable(feature1, feature2))
+        {
+            return 0;
+        }
+
+        const int size1 = feature1.size();
+        const int size2 = feature2.size();
+        std::unique_ptr<uint8_t[]> steps(new (std::nothrow) uint8_t[(size_t)size1 * size2]);
+        std::unique_ptr<uint32_t[]> prev_row(new (std::nothrow) uint32_t[size2]);
+        std::unique_ptr<uint32_t[]> curt_row(new (std::nothrow) uint32_t[size2]);
+        std::unique_ptr<float[]> inverse_norm2(new (std::nothrow) float[size2]);
+        std::unique_ptr<int[]> inner_row(new (std::nothrow) int[size2]);
+        if (!steps || !prev_row || !curt_row || !inverse_norm2 || !inner_row)
+        {
+            return 0;
+        }
+        SetupInverseNorms(feature2, inverse_norm2.get());
+
+        const int band_width = BandWidth(config, size1, size2);
+        const int last = size2 - 1;
+        for (int i = 0; i < size1; i++)
+        {
+            const int lo = std::max(0, BandCenter(i, size1, size2) - band_width);
+            const int hi = std::min(last, BandCenter(i, size1, size2) + band_width);
+            const float inverse_norm1_i = kDistanceCoef * InverseNorm(feature1, i);
+            InnerProductRow(feature1.feature(i), feature2, lo, hi + 1, inner_row.get());
+            uint8_t* row_steps = &steps[(size_t)i * size2];
+            for (int j = 0; j < size2; j++)
+            {
+                curt_row[j] = kUnreachable;
+            }
+            for (int j = lo; j <= hi; j++)
+            {
+                const uint32_t distance = CosineDistance(inner_row[j], inverse_norm1_i * inverse_norm2[j]);
+                if (i == 0 && j == 0)
+                {
+                    curt_row[0] = 2 * distance;
+                    row_steps[0] = Start;
+                    continue;
+                }
+
+                // calcDTW()と同じく前の行, 前の列, 斜めの順に比較する(前の行と前の列が等しい場合は前の列)
+                const uint32_t from_prev_row = (i > 0) ? prev_row[j] : kUnreachable;
+                const uint32_t from_prev_column = (j > 0) ? curt_row[j - 1] : kUnreachable;
+                const uint32_t from_diagonal = (i > 0 && j > 0) ? prev_row[j - 1] : kUnreachable;
+                uint32_t step_dist = from_prev_column;
+                uint8_t step = FromPrevColumn;
+                if (from_prev_row < step_dist)
+                {
+                    step_dist = from_prev_row;
+                    step = FromPrevRow;
+                }
+                if (from_diagonal < step_dist)
+                {
+                    step_dist = from_diagonal;
+                    step = FromDiagonal;
+                }
+                if (step_dist != kUnreachable)
+                {
+                    curt_row[j] = step_dist + distance;
+                    row_steps[j] = step;
+                }
+            }
+            std::swap(prev_row, curt_row);
+        }
+        if (prev_row[last] == kUnreachable)
+        {
+            return 0;
+        }
+
+        // 終点から辿り、始点からの順に並べ直す
+        int length = 0;
+        int i = size1 - 1;
+        int j = last;
+        while (true)
+        {
+            path1[length] = i;
+            path2[length] = j;
+            length++;
+            const uint8_t step = steps[(size_t)i * size2 + j];
+            if (step == Start) { break; }
+            if (step != FromPrevColumn) { i--; }
+            if (step != FromPrevRow) { j--; }
+        }
+        std::reverse(path1, path1 + length);
+        std::reverse(path2, path2 + length);
+        return length;
+    }
+
+    /**
+     * @brief   複数のテンプレートと１つの特徴量のDTW距離をまとめて計算します
+     * @details
+     * 特徴量(query)の各フレームの内積およびDPの作業領域は全テンプレートで共有されるため、
+     * calcDTW()をテンプレートの数だけ呼び出すよりも効率的です。
+     * @param[in]   templates   テンプレートの配列
+     * @param[in]   num         テンプレートの個数
+     * @param[in]   query       特徴量
+     * @param[out]  distances   各テンプレートとの距離(num個, 比較できない場合はUINT32_MAX)
+     * @return  最も距離が小さいテンプレートの番号, いずれとも比較できない場合は-1
+     */
+    template <class T1, class T2, typename V2>
+    int calcDTWBatch(const T1* const* templates, int num, const ISoundFeature<T2, V2> &query, uint32_t* distances)
+    {
+        return calcDTWBatch(templates, num, query, distances, DtwConfig());
+    }
+
+    /**
+     * @brief   複数のテンプレートと１つの特徴量のDTW距離をまとめて計算します
+     * @param[in]   templates   テンプレートの配列
+     * @param[in]   num         テンプレートの個数
+     * @param[in]   query       特徴量
+     * @param[out]  distances   各テンプレートとの距離(num個, 比較できない場合や打ち切った場合はUINT32_MAX)
+     * @param[in]   config      バンドの幅や打ち切り距離などのコンフィグ
+     * @return  最も距離が小さいテンプレートの番号, いずれとも比較できない場合は-1
+     */
+    template <class T1, class T2, typename V2>
+    int calcDTWBatch(const T1* const* templates, int num, const ISoundFeature<T2, V2> &query, uint32_t* distances,
+                     const DtwConfig& config)
+    {
+        DtwWorkspace workspace;
+        if (query.size() <= 0 || !workspace.init(query.size()))
+        {
+            for (int k = 0; k < num; k++)
+            {
+                distances[k] = UINT32_MAX;
+            }
+            return -1;
+        }
+        return calcDTWBatch(templates, num, query, distances, config, workspace);
+    }
+
+    /**
+     * @brief   事前に確保した作業領域を用いて複数のテンプレートとのDTW距離をまとめて計算します
+     * @param[in]   templates   テンプレートの配列
+     * @param[in]   num         テンプレートの個数
+     * @param[in]   query       特徴量
+     * @param[out]  distances   各テンプレートとの距離(num個, 比較できない場合や打ち切った場合はUINT32_MAX)
+     * @param[in]   config      バンドの幅や打ち切り距離などのコンフィグ
+     * @param[in]   workspace   作業領域(queryのフレーム数以上確保したもの)
+     * @return  最も距離が小さいテンプレートの番号, いずれとも比較できない場合やworkspaceが足りない場合は-1
+     * @note    ヒープの確保を行いません
+     */
+    template <class T1, class T2, typename V2>
+    int calcDTWBatch(const T1* const* templates, int num, const ISoundFeature<T2, V2> &query, uint32_t* distances,
+                     const DtwConfig& config, DtwWorkspace& workspace)
+    {
+        using namespace simplevox::detail;
+        for (int k = 0; k < num; k++)
+        {
+            distances[k] = UINT32_MAX;
+        }
+        if (query.size() <= 0 || query.size() > workspace.capacity())
+        {
+            return -1;
+        }
+        SetupInverseNorms(query, workspace.inverse_norm2());
+
+        int best_index = -1;
+        for (int k = 0; k < num; k++)
+        {
+            if (!IsComparable(*templates[k], query)) { continue; }
+
+            distances[k] = CalcDTW(*templates[k], query, config, workspace);
+            if (distances[k] == UINT32_MAX) { continue; }
+            if (best_index < 0 || distances[k] < distances[best_index])
+            {
+                best_index = k;
+            }
+        }
+        return best_index;
+    }
+
+    /**
+     * @brief   下限値による枝刈りを行いながら複数のテンプレートとのDTW距離をまとめて計算します
+     * @details
+     * 各テンプレートの下限値(LB_Kim, LB_Keogh)を求め、最も下限値が小さいテンプレートから算出した距離を
+     * 以降のテンプレートの打ち切り距離とします。下限値がその時点の最小の距離以上のテンプレートはDPを省略します。
+     * 最も距離が小さいテンプレートの番号は枝刈りを行わない場合と一致します(config.abandon_distance未満の場合)。
+     * @param[in]   templates   テンプレートの配列
+     * @param[in]   envelopes   各テンプレートの包絡線の配列(要素がnullptrの場合はLB_Kimのみ), nullptrの場合は全てLB_Kimのみ
+     * @param[in]   num         テンプレートの個数
+     * @param[in]   query       特徴量
+     * @param[out]  distances   各テンプレートとの距離(num個, 比較できない場合や打ち切った場合, 省略した場合はUINT32_MAX)
+     * @param[in]   config      バンドの幅や打ち切り距離などのコンフィグ
+     * @param[in]   workspace   作業領域(queryのフレーム数以上確保したもの)
+     * @return  最も距離が小さいテンプレートの番号, いずれとも比較できない場合やworkspaceが足りない場合は-1
+     * @note    ヒープの確保を行いません
+     */
+    template <class T1, class T2, typename V2>
+    int calcDTWBatch(const T1* const* templates, const DtwEnvelope* const* envelopes, int num,
+                     const ISoundFeature<T2, V2> &query, uint32_t* distances,
+                     const DtwConfig& config, DtwWorkspace& workspace)
+    {
+        using namespace simplevox::detail;
+        for (int k = 0; k < num; k++)
+        {
+            distances[k] = UINT32_MAX;
+        }
+        if (query.size() <= 0 || query.size() > workspace.capacity())
+        {
+            return -1;
+        }
+        const float* inverse_norm2 = workspace.inverse_norm2();
+        SetupInverseNorms(query, workspace.inverse_norm2());
+
+        // 下限値はdistancesに一時的に保持する(比較できないものはUINT32_MAXのまま)
+        int first = -1;
+        for (int k = 0; k < num; k++)
+        {
+            if (!IsComparable(*templates[k], query)) { continue; }
+            const DtwEnvelope* envelope = (envelopes != nullptr) ? envelopes[k] : nullptr;
+            distances[k] = LowerBound(*templates[k], envelope, query, config, inverse_norm2, config.abandon_distance);
+            if (first < 0 || distances[k] < distances[first])
+            {
+                first = k;
+            }
+        }
+        if (first < 0) { return -1; }
+
+        int best_index = -1;
+        uint32_t best_distance = UINT32_MAX;
+        for (int n = -1; n < num; n++)
+        {
+            const int k = (n < 0) ? first : n;
+            if ((n >= 0 && k == first) || distances[k] == UINT32_MAX) { continue; }
+
+            // 番号が小さいテンプレートは同じ距離でも優先されるため、打ち切り距離を１大きくする
+            uint32_t limit = config.abandon_distance;
+            if (best_index >= 0)
+            {
+                limit = std::min(limit, (k < best_index) ? best_distance + 1 : best_distance);
+            }
+            if (distances[k] >= limit)
+            {
+                distances[k] = UINT32_MAX;
+                AddDtwPrunedStats();
+                continue;
+            }
+
+            DtwConfig bounded_config = config;
+            bounded_config.abandon_distance = limit;
+            distances[k] = CalcDTW(*templates[k], query, bounded_config, workspace);
+            if (distances[k] < limit)
+            {
+                best_index = k;
+                best_distance = distances[k];
+            }
+        }
+        return best_index;
+    }
+
+    /**
+     * @brief   複数のコアで分担して(枝刈りを行いながら)複数のテンプレートとのDTW距離をまとめて計算します
+     * @details
+     * 下限値の算出とDTWのそれぞれで、各ワーカーがテンプレートを１つずつ取り出して計算します。
+     * 最小の距離は全ワーカーで共有され、以降に取り出したテンプレートの枝刈りと打ち切りに用いられます。
+     * 最も距離が小さいテンプレートの番号はDtwWorkspaceを用いる場合と一致しますが、
+     * 各テンプレートの距離(枝刈りや打ち切りの有無)は実行順により異なる場合があります。
+     * @param[in]   templates   テンプレートの配列
+     * @param[in]   envelopes   各テンプレートの包絡線の配列(要素がnullptrの場合はLB_Kimのみ), nullptrの場合は全てLB_Kimのみ
+     * @param[in]   num         テンプレートの個数
+     * @param[in]   query       特徴量
+     * @param[out]  distances   各テンプレートとの距離(num個, 比較できない場合や打ち切った場合, 省略した場合はUINT32_MAX)
+     * @param[in]   config      バンドの幅や打ち切り距離などのコンフィグ
+     * @param[in]   pool        ワーカーと作業領域(queryのフレーム数以上確保したもの)
+     * @return  最も距離が小さいテンプレートの番号, いずれとも比較できない場合やpoolの作業領域が足りない場合は-1
+     * @note    ヒープの確保を行いません
+     */
+    template <class T1, class T2, typename V2>
+    int calcDTWBatch(const T1* const* templates, const DtwEnvelope* const* envelopes, int num,
+                     const ISoundFeature<T2, V2> &query, uint32_t* distances,
+                     const DtwConfig& config, DtwWorkerPool& pool)
+    {
+        using namespace simplevox::detail;
+        for (int k = 0; k < num; k++)
+        {
+            distances[k] = UINT32_MAX;
+        }
+        if (query.size() <= 0 || query.size() > pool.capacity())
+        {
+            return -1;
+        }
+
+        ParallelBatch<T1, T2, V2> batch;
+        batch.templates = templates;
+        batch.envelopes = envelopes;
+        batch.num = num;
+        batch.query = &query;
+        batch.distances = distances;
+        batch.config = &config;
+        batch.pool = &pool;
+        batch.first = -1;
+        batch.next = 0;
+        batch.best = UINT64_MAX;
+        pool.run(ParallelBatch<T1, T2, V2>::Bound, &batch);
+
+        for (int k = 0; k < num; k++)
+        {
+            if (distances[k] != UINT32_MAX && (batch.first < 0 || distances[k] < distances[batch.first]))
+            {
+                batch.first = k;
+            }
+        }
+        if (batch.first < 0) { return -1; }
+
+        batch.next = 0;
+        pool.run(ParallelBatch<T1, T2, V2>::Match, &batch);
+        const uint64_t best = batch.best.load();
+        return (best == UINT64_MAX) ? -1 : (int)(best & UINT32_MAX);
+    }
 } // namespace simplevox
 
 
-#endif // DETAIL_SIMPLEVOX_DTW_H_
\ No newline at end of file
+#endif // DETAIL_SIMPLEVOX_DTW_H_
@@ -0,0 +1,197 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef DETAIL_SIMPLEVOX_KWS_H_
+#define DETAIL_SIMPLEVOX_KWS_H_
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../simplevox_mfcc.h"
+#include "../simplevox_vad.h"
+
+namespace simplevox
+{
+namespace detail
+{
+    /**
+     * @brief   KeywordSpotterおよびMultiKeywordSpotterの特徴量のフレーム数を求めます
+     * @param[in]   vad_config          VADのコンフィグ
+     * @param[in]   mfcc_config         MFCCのコンフィグ
+     * @param[in]   max_time_ms         音声区間の最大長
+     * @param[out]  before_frame_num    音声の検出前に保持するフレーム数(VADのHangbeforeおよびPreDetectionに相当)
+     * @param[out]  max_frame_num       音声区間の最大のフレーム数
+     * @return  コンフィグが有効ならtrue, そうでなければfalse
+     */
+    bool CalcFeatureFrameNum(const VadConfig& vad_config, const MfccConfig& mfcc_config, int max_time_ms,
+                             int* before_frame_num, int* max_frame_num);
+
+    /**
+     * @brief １チャンネル分の音声区間の特徴量(標準化前のMFCC)をVADの状態に合わせて保持するリング
+     * @details
+     * 音声の開始前(Silence, PreDetection)はbefore_frame_num個までの特徴量をリング上で保持し、
+     * Speech以降は標準化の統計量を逐次更新します。
+     */
+    class FeatureRing
+    {
+    private:
+        MfccStream mfcc_stream_;
+        MfccNormalizer normalizer_;
+        std::unique_ptr<float[]> features_;
+        int coef_num_ = 0;
+        int hop_length_ = 0;
+        int max_frame_num_ = 0;
+        int before_frame_num_ = 0;
+        int head_ = 0;
+        int count_ = 0;
+    public:
+        /**
+         * @brief   初期化処理を行います
+         * @param[in]   engine              MFCCの算出に用いるエンジン(初期化済みであること, 複数のリングで共有可)
+         * @param[in]   max_frame_num       保持する最大のフレーム数
+         * @param[in]   before_frame_num    音声の検出前に保持するフレーム数
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         */
+        bool init(MfccEngine& engine, int max_frame_num, int before_frame_num);
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   保持している特徴量と統計量を破棄します
+         */
+        void clear();
+
+        bool isInitialized() const { return features_ != nullptr; }
+
+        /**
+         * @brief   サウンドデータを追加し、VADの状態に合わせて特徴量を保持します
+         * @param[in]   data    サウンドデータ(VadConfig::frame_length()など任意の長さ)
+         * @param[in]   length  サウンドデータの長さ
+         * @param[in]   state   dataに対するVADの状態
+         */
+        void push(const int16_t* data, int length, VadState state);
+
+        /**
+         * @brief   保持しているフレーム数
+         */
+        int size() const { return count_; }
+
+        bool isFull() const { return count_ >= max_frame_num_; }
+
+        /**
+         * @brief   保持している古い方からindex番目のフレーム
+         */
+        const float* frame(int index) const { return &features_[((head_ + index) % max_frame_num_) * coef_num_]; }
+
+        const MfccNormalizer& normalizer() const { return normalizer_; }
+
+        /**
+         * @brief   保持しているフレームを先頭から連続して並べ直します
+         * @return  先頭のフレーム(size() * coef_num個)
+         */
+        const float* linearize();
+
+        /**
+         * @brief   保持しているフレームを並べ直して標準化し、照合用の特徴量を作成します
+         * @param[in]   engine  MFCCの算出に用いたエンジン
+         * @param[in]   arena   特徴量の格納先
+         * @param[out]  dest    作成した特徴量
+         * @return  作成に成功したらtrue, 失敗したらfalse
+         */
+        bool create(MfccEngine& engine, MfccArena& arena, MfccFeatureView* dest);
+    };
+
+    /**
+     * @brief 照合に用いるテンプレートと各テンプレートとのDTW距離, しきい値
+     */
+    class TemplateSet
+    {
+    private:
+        std::unique_ptr<MfccFeatureView[]> templates_;
+        std::unique_ptr<const MfccFeatureView*[]> template_ptrs_;  ///< calcDTWBatch()に渡すtemplates_の各要素
+        std::unique_ptr<uint32_t[]> distances_;
+        std::unique_ptr<uint32_t[]> thresholds_;    ///< テンプレートごとのしきい値(nullptrの場合は既定値)
+        int num_ = 0;
+    public:
+        /**
+         * @brief   テンプレートを設定します(失敗した場合は変更しません)
+         * @param[in]   templates   テンプレートの配列
+         * @param[in]   num         テンプレートの個数
+         * @return 設定成功ならtrue, 失敗ならfalse
+         * @note    テンプレートごとのしきい値は解除されます
+         */
+        template <class T>
+        bool assign(const T* const* templates, int num);
+
+        /**
+         * @brief   テンプレートごとのしきい値を設定します
+         * @param[in]   thresholds  size()個のしきい値, nullptrの場合は解除します
+         * @return 設定成功ならtrue, 失敗ならfalse
+         */
+        bool setThresholds(const uint32_t* thresholds);
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void clear();
+
+        int size() const { return num_; }
+        const MfccFeatureView* const* pointers() const { return template_ptrs_.get(); }
+        uint32_t* distances() { return distances_.get(); }
+        const uint32_t* distances() const { return distances_.get(); }
+
+        /**
+         * @brief   index番目のテンプレートのしきい値(設定されていない場合やindexが負の場合はdefault_threshold)
+         */
+        uint32_t threshold(int index, uint32_t default_threshold) const
+        {
+            return (thresholds_ && index >= 0) ? thresholds_[index] : default_threshold;
+        }
+    };
+
+    template <class T>
+    bool TemplateSet::assign(const T* const* templates, int num)
+    {
+        if (num < 0 || (num > 0 && templates == nullptr))
+        {
+            return false;
+        }
+
+        std::unique_ptr<MfccFeatureView[]> temp(new (std::nothrow) MfccFeatureView[std::max(num, 1)]);
+        std::unique_ptr<const MfccFeatureView*[]> temp_ptrs(new (std::nothrow) const MfccFeatureView*[std::max(num, 1)]);
+        std::unique_ptr<uint32_t[]> distances(new (std::nothrow) uint32_t[std::max(num, 1)]);
+        if (!temp || !temp_ptrs || !distances)
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+        for (int k = 0; k < num; k++)
+        {
+            temp[k] = MfccFeatureView(*templates[k]);
+            temp_ptrs[k] = &temp[k];
+        }
+        std::fill_n(distances.get(), num, UINT32_MAX);
+
+        templates_ = std::move(temp);
+        template_ptrs_ = std::move(temp_ptrs);
+        distances_ = std::move(distances);
+        thresholds_.reset();
+        num_ = num;
+        return true;
+    }
+} // namespace detail
+} // namespace simplevox
+
+#endif // DETAIL_SIMPLEVOX_KWS_H_
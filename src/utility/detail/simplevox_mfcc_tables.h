@@ -0,0 +1,246 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef DETAIL_SIMPLEVOX_MFCC_TABLES_H_
+#define DETAIL_SIMPLEVOX_MFCC_TABLES_H_
+
+#include <stdint.h>
+
+#include "../simplevox_mfcc.h"
+
+namespace simplevox
+{
+namespace detail
+{
+    /**
+     * @brief   MfccEngineと共有するFFTのテーブルを取得します(simplevox_mfcc.cpp)
+     */
+    bool AcquireMfccFftTable(MfccArithmetic arithmetic, int fft_num);
+
+    /**
+     * @brief   AcquireMfccFftTable()で取得したFFTのテーブルを解放します
+     */
+    void ReleaseMfccFftTable(MfccArithmetic arithmetic);
+
+    /**
+     * @brief   log2の近似(MfccConfig::fast_logと同じもの)
+     */
+    float FastLog2(float value);
+
+// 以下のテーブルの算出はconstexprのループを用いるため、C++14以降の場合のみ定義する(StaticMfccEngine用)
+#if __cplusplus >= 201402L
+    constexpr double kConstPi = 3.14159265358979323846;
+    constexpr double kConstLn2 = 0.69314718055994530942;
+    constexpr int kConstWindowCoef = 10000;
+    constexpr int kConstDctCoef = 10000;
+
+    /**
+     * @brief   コンパイル時に評価できるcos(倍精度)
+     */
+    constexpr double ConstCos(double x)
+    {
+        // [-π, π]に畳み込んでからテイラー展開する
+        const double turns = x / (2 * kConstPi);
+        const long long n = (long long)(turns >= 0 ? turns + 0.5 : turns - 0.5);
+        x -= n * 2 * kConstPi;
+        const double x2 = x * x;
+        double term = 1;
+        double sum = 1;
+        for (int k = 1; k < 30; k++)
+        {
+            term *= -x2 / ((2 * k - 1) * (2 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    /**
+     * @brief   コンパイル時に評価できる自然対数(倍精度, x > 0)
+     */
+    constexpr double ConstLog(double x)
+    {
+        // x = m * 2^e (1 <= m < 2)とし, ln(m) = 2 * atanh((m - 1) / (m + 1))を級数で求める
+        int exponent = 0;
+        while (x >= 2) { x /= 2; exponent++; }
+        while (x < 1) { x *= 2; exponent--; }
+        const double y = (x - 1) / (x + 1);
+        const double y2 = y * y;
+        double term = y;
+        double sum = 0;
+        for (int k = 1; k < 60; k += 2)
+        {
+            sum += term / k;
+            term *= y2;
+        }
+        return 2 * sum + exponent * kConstLn2;
+    }
+
+    /**
+     * @brief   コンパイル時に評価できる指数関数(倍精度)
+     */
+    constexpr double ConstExp(double x)
+    {
+        // x = k * ln2 + rとし, e^rをテイラー展開する
+        const long long k = (long long)(x / kConstLn2 + (x >= 0 ? 0.5 : -0.5));
+        const double r = x - k * kConstLn2;
+        double term = 1;
+        double sum = 1;
+        for (int n = 1; n < 30; n++)
+        {
+            term *= r / n;
+            sum += term;
+        }
+        for (long long i = 0; i < k; i++) { sum *= 2; }
+        for (long long i = 0; i > k; i--) { sum /= 2; }
+        return sum;
+    }
+
+    /**
+     * @brief   roundf()と同じ丸め(0から遠い方へ)
+     */
+    constexpr int ConstRound(float value)
+    {
+        const int truncated = (int)value;
+        const float fraction = value - truncated;
+        if (fraction >= 0.5f) { return truncated + 1; }
+        if (fraction <= -0.5f) { return truncated - 1; }
+        return truncated;
+    }
+
+    // 以下はsimplevox_mfcc.cppの各テーブルの算出と同じ演算順序(float)で求める
+    constexpr float ConstHzToMel(float freq)
+    {
+        return 2595.0f * (float)ConstLog(freq / 700.0f + 1.0f);
+    }
+
+    constexpr float ConstMelToHz(float mel_freq)
+    {
+        return 700.0f * ((float)ConstExp(mel_freq / 2595.0f) - 1.0f);
+    }
+
+    /**
+     * @brief   Mel-Filterの三角波の始点, 中心位置, 終点(SetupMelFilter()と同じ)
+     */
+    template <int FftNum, int MelChannel, int SampleRate>
+    struct MelPositions
+    {
+        int16_t value[MelChannel + 2] = {};
+
+        constexpr MelPositions()
+        {
+            const int fn = SampleRate / 2;
+            const float mel_fn = ConstHzToMel(fn);
+            const float delta_mel = mel_fn / (MelChannel + 1);
+            const float delta_freq = (float)SampleRate / FftNum;
+            for (int i = 1; i <= MelChannel; i++)
+            {
+                const float center_mel = i * delta_mel;
+                const float center_freq = ConstMelToHz(center_mel);
+                value[i] = ConstRound(center_freq / delta_freq);
+            }
+            value[0] = 0;
+            value[MelChannel + 1] = FftNum / 2;
+        }
+
+        /**
+         * @brief   重みの総数(MelWeightNum()と同じ)
+         */
+        constexpr int weightNum() const
+        {
+            return value[MelChannel + 1] + value[MelChannel] - value[1] - value[0];
+        }
+    };
+
+    /**
+     * @brief   StaticMfccEngineのテーブル(MfccEngine::init()で算出するものと同じ値)
+     */
+    template <int FftNum, int MelChannel, int CoefNum, int SampleRate, int FrameTimeMs, MelNormalize Normalize>
+    struct MfccTables
+    {
+        static constexpr int kFrameLength = FrameTimeMs * SampleRate / 1000;
+        static constexpr MelPositions<FftNum, MelChannel, SampleRate> kPositions = {};
+        static constexpr int kWeightNum = kPositions.weightNum();
+
+        int16_t window[kFrameLength] = {};
+        int16_t mel_begin[MelChannel] = {};
+        int16_t mel_length[MelChannel] = {};
+        float mel_weight[kWeightNum] = {};
+        int16_t dct[CoefNum * MelChannel] = {};
+
+        constexpr MfccTables()
+        {
+            // SetupHammingWindow()
+            for (int i = 0; i < kFrameLength; i++)
+            {
+                const float c = (float)ConstCos((float)(2 * kConstPi * i / (kFrameLength - 1)));
+                window[i] = ConstRound(kConstWindowCoef * (0.54f - 0.46f * c));
+            }
+
+            // SetupMelWeight()
+            const int16_t* position = kPositions.value;
+            const float delta_freq = (float)SampleRate / FftNum;
+            int offset = 0;
+            for (int i = 1; i <= MelChannel; i++)
+            {
+                mel_begin[i - 1] = position[i - 1];
+                mel_length[i - 1] = position[i + 1] - position[i - 1];
+
+                // 隣接する位置が等しい(区間が空の)場合は0除算となるため、逆数は区間がある場合のみ求める
+                const int head = offset;
+                float coef = 0;
+                if (position[i] > position[i - 1])
+                {
+                    const float increment = 1.0f / (position[i] - position[i - 1]);
+                    for (int j = position[i - 1]; j < position[i]; j++)
+                    {
+                        coef += increment;
+                        mel_weight[offset++] = coef;
+                    }
+                }
+                if (position[i + 1] > position[i])
+                {
+                    const float decrement = 1.0f / (position[i + 1] - position[i]);
+                    for (int j = position[i]; j < position[i + 1]; j++)
+                    {
+                        coef -= decrement;
+                        mel_weight[offset++] = coef;
+                    }
+                }
+
+                if (Normalize == MelNormalize::Slaney && mel_length[i - 1] > 0)
+                {
+                    const float scale = 2.0f / (mel_length[i - 1] * delta_freq);
+                    for (int j = 0; j < mel_length[i - 1]; j++)
+                    {
+                        mel_weight[head + j] *= scale;
+                    }
+                }
+            }
+
+            // SetupDctTable()
+            for (int i = 0; i < CoefNum; i++)
+            {
+                for (int j = 0; j < MelChannel; j++)
+                {
+                    const float c = (float)ConstCos((float)(kConstPi / MelChannel * (j + 0.5f) * (i + 1)));
+                    dct[i * MelChannel + j] = ConstRound(kConstDctCoef * c);
+                }
+            }
+        }
+    };
+
+    template <int FftNum, int MelChannel, int CoefNum, int SampleRate, int FrameTimeMs, MelNormalize Normalize>
+    constexpr MelPositions<FftNum, MelChannel, SampleRate>
+        MfccTables<FftNum, MelChannel, CoefNum, SampleRate, FrameTimeMs, Normalize>::kPositions;
+#endif // __cplusplus >= 201402L
+
+} // namespace detail
+} // namespace simplevox
+
+#endif // DETAIL_SIMPLEVOX_MFCC_TABLES_H_
@@ -0,0 +1,238 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#include "simplevox_decimator.h"
+
+#include <algorithm>
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+    constexpr int kMaxPhaseNum = 160;
+    constexpr int kMinTapNum = 4;
+    constexpr int kMaxTapNum = 128;
+    constexpr int kCoefShift = 15;
+    constexpr double kKaiserBeta = 7.0;     // 阻止域の減衰は約70dB
+
+    int Gcd(int a, int b)
+    {
+        while (b != 0)
+        {
+            const int r = a % b;
+            a = b;
+            b = r;
+        }
+        return a;
+    }
+
+    /**
+     * @brief 第1種変形ベッセル関数(0次)
+     */
+    double BesselI0(double x)
+    {
+        double term = 1;
+        double sum = 1;
+        for (int k = 1; k < 30; k++)
+        {
+            term *= (x / (2 * k)) * (x / (2 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    /**
+     * @brief カイザー窓による低域通過フィルタを作成し、フェーズごとに分けてQ15で格納します
+     */
+    bool SetupCoefs(int up, int tap_num, double cutoff, int16_t* coefs)
+    {
+        // cutoffはL倍のレートで正規化した遮断周波数(ナイキスト周波数が0.5)
+        const int length = up * tap_num;
+        const double center = (length - 1) / 2.0;
+        const double inverse_i0 = 1.0 / BesselI0(kKaiserBeta);
+        std::unique_ptr<double[]> phase_coefs(new (std::nothrow) double[tap_num]);
+        if (!phase_coefs)
+        {
+            return false;
+        }
+
+        for (int p = 0; p < up; p++)
+        {
+            double sum = 0;
+            for (int j = 0; j < tap_num; j++)
+            {
+                const double x = p + j * up - center;
+                const double ratio = x / (center + 0.5);
+                const double window = BesselI0(kKaiserBeta * sqrt(std::max(0.0, 1 - ratio * ratio))) * inverse_i0;
+                const double sinc = (x == 0) ? 1.0 : sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x);
+                phase_coefs[j] = 2 * cutoff * sinc * window;
+                sum += phase_coefs[j];
+            }
+
+            // 直流利得が1となるように正規化し、丸め誤差は最大の係数で吸収する
+            int16_t* dest = &coefs[p * tap_num];
+            int total = 0;
+            int peak = 0;
+            for (int j = 0; j < tap_num; j++)
+            {
+                // 新しいサンプルほど小さい遅延のため、古いサンプル側から並べる
+                const int value = lround(phase_coefs[tap_num - 1 - j] / sum * (1 << kCoefShift));
+                dest[j] = std::min(INT16_MAX, std::max(INT16_MIN, value));
+                total += dest[j];
+                if (abs(dest[j]) > abs(dest[peak])) { peak = j; }
+            }
+            const int corrected = dest[peak] + (1 << kCoefShift) - total;
+            if (corrected < INT16_MIN || corrected > INT16_MAX)
+            {
+                return false;
+            }
+            dest[peak] = corrected;
+        }
+        return true;
+    }
+
+    /**
+     * @brief tap_num個のサンプルと係数の積和をQ15から戻し、int16_tの範囲に丸めます
+     */
+    int16_t Convolve(const int16_t* data, const int16_t* coefs, int tap_num)
+    {
+        int32_t sum = 1 << (kCoefShift - 1);
+        for (int j = 0; j < tap_num; j++)
+        {
+            sum += (int32_t)data[j] * coefs[j];
+        }
+        sum >>= kCoefShift;
+        return std::min<int32_t>(INT16_MAX, std::max<int32_t>(INT16_MIN, sum));
+    }
+}
+
+namespace simplevox
+{
+    bool Decimator::init(const DecimatorConfig& config)
+    {
+        if (coefs_)
+        {
+            return false;
+        }
+
+        if (config.output_rate != 8000 && config.output_rate != 16000)
+        {
+            printf("Unsupported output rate: %d\n", config.output_rate);
+            return false;
+        }
+        if (config.input_rate <= config.output_rate)
+        {
+            printf("Input rate must be higher than output rate\n");
+            return false;
+        }
+        if (config.tap_num < kMinTapNum || config.tap_num > kMaxTapNum
+            || config.cutoff_percent <= 0 || config.cutoff_percent > 100)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+
+        const int gcd = Gcd(config.input_rate, config.output_rate);
+        const int up = config.output_rate / gcd;
+        const int down = config.input_rate / gcd;
+        if (up > kMaxPhaseNum)
+        {
+            printf("Unsupported rate conversion: %d -> %d\n", config.input_rate, config.output_rate);
+            return false;
+        }
+
+        std::unique_ptr<int16_t[]> coefs(new (std::nothrow) int16_t[up * config.tap_num]);
+        std::unique_ptr<int16_t[]> history(new (std::nothrow) int16_t[2 * config.tap_num]);
+        if (!coefs || !history)
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+        const double cutoff = 0.5 * config.cutoff_percent / 100 / down;
+        if (!SetupCoefs(up, config.tap_num, cutoff, coefs.get()))
+        {
+            printf("Failed to create filter\n");
+            return false;
+        }
+
+        config_ = config;
+        up_ = up;
+        down_ = down;
+        coefs_ = std::move(coefs);
+        history_ = std::move(history);
+        reset();
+        return true;
+    }
+
+    void Decimator::deinit()
+    {
+        coefs_.reset();
+        history_.reset();
+        up_ = 0;
+        down_ = 0;
+    }
+
+    void Decimator::reset()
+    {
+        if (!history_) { return; }
+        std::fill_n(history_.get(), 2 * config_.tap_num, 0);
+        history_pos_ = 0;
+        phase_ = 0;
+    }
+
+    int Decimator::outputLength(int length) const
+    {
+        if (!coefs_ || length <= 0) { return 0; }
+        const int span = length * up_;
+        return (phase_ < span) ? (span - phase_ + down_ - 1) / down_ : 0;
+    }
+
+    int Decimator::process(const int16_t* input, int length, int16_t* output)
+    {
+        if (!coefs_ || length <= 0) { return 0; }
+
+        const int tap_num = config_.tap_num;
+        int count = 0;
+
+        // 直前の入力と重なる先頭のtap_num - 1個は保持している入力に追加しながら算出する
+        const int head_length = std::min(length, tap_num - 1);
+        int i = 0;
+        for (; i < head_length; i++)
+        {
+            history_[history_pos_] = input[i];
+            history_[history_pos_ + tap_num] = input[i];
+            history_pos_ = (history_pos_ + 1 < tap_num) ? history_pos_ + 1 : 0;
+            for (; phase_ < up_; phase_ += down_)
+            {
+                output[count++] = Convolve(&history_[history_pos_], &coefs_[phase_ * tap_num], tap_num);
+            }
+            phase_ -= up_;
+        }
+
+        // 以降は入力の領域をそのまま参照する
+        for (; i < length; i++)
+        {
+            for (; phase_ < up_; phase_ += down_)
+            {
+                output[count++] = Convolve(&input[i - tap_num + 1], &coefs_[phase_ * tap_num], tap_num);
+            }
+            phase_ -= up_;
+        }
+
+        if (length >= tap_num)
+        {
+            memcpy(&history_[0], &input[length - tap_num], sizeof(*history_.get()) * tap_num);
+            memcpy(&history_[tap_num], &input[length - tap_num], sizeof(*history_.get()) * tap_num);
+            history_pos_ = 0;
+        }
+        return count;
+    }
+} // namespace simplevox
@@ -0,0 +1,105 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef SIMPLEVOX_DECIMATOR_H_
+#define SIMPLEVOX_DECIMATOR_H_
+
+#include <memory>
+#include <stdint.h>
+
+namespace simplevox
+{
+    struct DecimatorConfig
+    {
+        /**
+         * @brief 入力(I2Sなど)のサンプリングレート(32000Hz, 44100Hz, 48000Hzなど)
+         */
+        int input_rate = 48000;
+
+        /**
+         * @brief 出力(VadEngine, MfccEngine)のサンプリングレート(8000Hz or 16000Hz)
+         */
+        int output_rate = 16000;
+
+        /**
+         * @brief 各フェーズのタップ数(入力のサンプリングレートにおけるフィルタ長)
+         * @note
+         * 出力1サンプルあたりの積和の回数です。多いほど遷移帯域が狭くなります。
+         * 16kHzへの変換(cutoff_percent = 90)で測定した特性は以下のとおりです(44.1kHz / 48kHz)。
+         * - 64: 通過域(0〜6.4kHz)の低下は0.7dB / 0.9dB以内、出力の0〜7.2kHzに折り返す成分(8.8kHz以上)の減衰は72dB / 60dB以上
+         * - 32: 通過域の低下は2.5dB / 2.7dB以内、折り返す成分の減衰は22dB / 20dBのみ(VADやMFCCの帯域に聞き取れるエイリアスが残ります)
+         * 係数はL * tap_num個のint16_tのため、44.1kHzでは64で20KBを使用します(48kHzはL = 1のため128バイト)。
+         */
+        int tap_num = 64;
+
+        /**
+         * @brief 遮断周波数(利得が-6dBとなる周波数)[%] (出力のナイキスト周波数に対する割合, 90 -> 16000Hzで7200Hz)
+         */
+        int cutoff_percent = 90;
+    };
+
+    /**
+     * @brief 入力をVADやMFCCのサンプリングレートに変換するポリフェーズのデシメータ
+     * @details
+     * 出力のレートを入力のレートのL/M倍(既約分数)とし、低域通過フィルタの係数をL個のフェーズに分けて保持します。
+     * 出力の各サンプルは対応するフェーズの係数(tap_num個)のみで算出するため、入力をL倍のレートに補間する処理や
+     * 出力しないサンプルの計算は行いません(48kHz->16kHzではL = 1, M = 3, 44.1kHz->16kHzではL = 160, M = 441)。
+     * 直前の入力はtap_num個のみ保持するため、任意の長さの入力を逐次的に処理できます。
+     * 10msの入力(48kHzでは480サンプル)からは常に10ms分(16kHzでは160サンプル)が出力されるため、
+     * I2Sから読み出した領域から直接VadConfig::frame_length()分のフレームを作成できます。
+     * 係数はQ15の固定小数点数で、各フェーズの直流利得は1です。
+     */
+    class Decimator
+    {
+    private:
+        DecimatorConfig config_;
+        std::unique_ptr<int16_t[]> coefs_;      ///< フェーズごとの係数(古いサンプル側から, up_ * tap_num個)
+        std::unique_ptr<int16_t[]> history_;    ///< 直近の入力(末尾にミラーを持つ2 * tap_num個)
+        int up_ = 0;            ///< L
+        int down_ = 0;          ///< M
+        int history_pos_ = 0;   ///< history_の最も古いサンプルの位置
+        int phase_ = 0;         ///< 次の入力を基準とした次の出力の位置(L倍のレートにおける)
+    public:
+        /**
+         * @brief   指定したコンフィグに沿って初期化処理を行います(フィルタの係数を算出します)
+         * @param[in]   config  コンフィグ
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         * @note    Lは160以下である必要があります(44.1kHz -> 16kHzは160)
+         */
+        bool init(const DecimatorConfig& config);
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   保持している入力を破棄し、最初のサンプルから変換し直します
+         */
+        void reset();
+
+        DecimatorConfig config() const { return config_; }
+
+        /**
+         * @brief   次のprocess()でlength個を入力した場合の出力のサンプル数
+         */
+        int outputLength(int length) const;
+
+        /**
+         * @brief   サウンドデータを変換します
+         * @param[in]   input   入力のサウンドデータ(I2Sの読み出し先をそのまま指定できます)
+         * @param[in]   length  入力のサンプル数
+         * @param[out]  output  出力の格納先(outputLength(length)個)
+         * @return  出力したサンプル数
+         */
+        int process(const int16_t* input, int length, int16_t* output);
+    };
+} // namespace simplevox
+
+#endif // SIMPLEVOX_DECIMATOR_H_
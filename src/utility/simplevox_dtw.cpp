@@ -8,21 +8,31 @@
  */
 
 #include "simplevox_dtw.h"
+#include "simplevox_platform.h"
 
+#include <atomic>
 #include <math.h>
+#include <new>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
 namespace
 {
-    constexpr int kDistanceCoef = 1000;
-}
+#if SIMPLEVOX_ENABLE_STATS
+    std::atomic<uint64_t> dtw_call_count(0);
+    std::atomic<uint64_t> dtw_cell_count(0);
+    std::atomic<uint64_t> dtw_abandon_count(0);
+    std::atomic<uint64_t> dtw_pruned_count(0);
+#endif
 
-namespace simplevox
-{
-namespace detail
-{
+    constexpr uint8_t kEnvelopeTag = 8;     ///< DtwEnvelopeのイメージ(MfccTag::ENVELOPE1と同じ値)
 
-    int InnerProduct(const int16_t *vec1, int n, const int16_t *vec2)
+    /**
+     * @brief 内積を求める(要素の型の組み合わせごとにsimplevox::detail::InnerProduct()から呼び出す)
+     */
+    template <typename V1, typename V2>
+    int InnerProductOf(const V1* vec1, int n, const V2* vec2)
     {
         int val = 0;
         for (int i = 0; i < n; i++)
@@ -32,6 +42,325 @@ namespace detail
         return val;
     }
 
+    /**
+     * @brief １つのベクトルと４つのベクトルそれぞれの内積を求める(simplevox::detail::InnerProduct4()を参照)
+     */
+    template <typename V1, typename V2>
+    void InnerProduct4Of(const V1* vec, int n, const V2* vec0, const V2* vec1, const V2* vec2, const V2* vec3,
+                         int* dest)
+    {
+        int val0 = 0;
+        int val1 = 0;
+        int val2 = 0;
+        int val3 = 0;
+        for (int i = 0; i < n; i++)
+        {
+            const int v = vec[i];
+            val0 += v * vec0[i];
+            val1 += v * vec1[i];
+            val2 += v * vec2[i];
+            val3 += v * vec3[i];
+        }
+        dest[0] = val0;
+        dest[1] = val1;
+        dest[2] = val2;
+        dest[3] = val3;
+    }
+}
+
+namespace simplevox
+{
+    DtwStats dtwStats()
+    {
+        DtwStats stats;
+#if SIMPLEVOX_ENABLE_STATS
+        stats.call_count = dtw_call_count.load(std::memory_order_relaxed);
+        stats.cell_count = dtw_cell_count.load(std::memory_order_relaxed);
+        stats.abandon_count = dtw_abandon_count.load(std::memory_order_relaxed);
+        stats.pruned_count = dtw_pruned_count.load(std::memory_order_relaxed);
+#endif
+        return stats;
+    }
+
+    void resetDtwStats()
+    {
+#if SIMPLEVOX_ENABLE_STATS
+        dtw_call_count = 0;
+        dtw_cell_count = 0;
+        dtw_abandon_count = 0;
+        dtw_pruned_count = 0;
+#endif
+    }
+
+    bool DtwWorkspace::init(int max_size)
+    {
+        if (max_size <= 0) { return false; }
+        inverse_norm2_.reset(new (std::nothrow) float[max_size]);
+        inner_row_.reset(new (std::nothrow) int[max_size]);
+        step_counts_.reset(new (std::nothrow) int16_t[max_size]);
+        step_distances_.reset(new (std::nothrow) uint32_t[max_size]);
+        if (!inverse_norm2_ || !inner_row_ || !step_counts_ || !step_distances_)
+        {
+            deinit();
+            return false;
+        }
+        capacity_ = max_size;
+        return true;
+    }
+
+    void DtwWorkspace::deinit()
+    {
+        inverse_norm2_.reset();
+        inner_row_.reset();
+        step_counts_.reset();
+        step_distances_.reset();
+        capacity_ = 0;
+    }
+
+    bool DtwWorkerPool::init(int max_size, const DtwPoolConfig& config)
+    {
+        deinit();
+        if (max_size <= 0 || config.worker_num <= 0)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+
+        const int worker_num = config.worker_num;
+        workspaces_.reset(new (std::nothrow) DtwWorkspace[worker_num]);
+        tasks_.reset(new (std::nothrow) Task[worker_num]);
+        workers_.reset(new (std::nothrow) void*[worker_num]());
+        if (!workspaces_ || !tasks_ || !workers_)
+        {
+            printf("Failed to create heap\n");
+            deinit();
+            return false;
+        }
+        worker_num_ = worker_num;
+        for (int i = 0; i < worker_num; i++)
+        {
+            tasks_[i] = {this, i};
+            if (!workspaces_[i].init(max_size))
+            {
+                printf("Failed to create heap\n");
+                deinit();
+                return false;
+            }
+        }
+
+        // ワーカー０は呼び出し元のため、追加のワーカーは１から作成する
+        for (int i = 1; i < worker_num; i++)
+        {
+            const int core = (config.worker_core < 0) ? -1 : config.worker_core + i - 1;
+            workers_[i] = platform::createWorker(core, config.worker_priority, config.worker_stack_size);
+            if (workers_[i] == nullptr)
+            {
+                printf("Failed to create worker\n");
+                deinit();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void DtwWorkerPool::deinit()
+    {
+        for (int i = 1; i < worker_num_; i++)
+        {
+            if (workers_[i] != nullptr)
+            {
+                platform::destroyWorker(workers_[i]);
+            }
+        }
+        workers_.reset();
+        tasks_.reset();
+        workspaces_.reset();
+        worker_num_ = 0;
+    }
+
+    void DtwWorkerPool::RunTask(void* arg)
+    {
+        auto* task = static_cast<Task*>(arg);
+        task->pool->job_(task->pool->job_arg_, task->worker);
+    }
+
+    void DtwWorkerPool::run(void (*job)(void* arg, int worker), void* arg)
+    {
+        job_ = job;
+        job_arg_ = arg;
+        for (int i = 1; i < worker_num_; i++)
+        {
+            platform::startWorker(workers_[i], RunTask, &tasks_[i]);
+        }
+        job(arg, 0);
+        for (int i = 1; i < worker_num_; i++)
+        {
+            platform::waitWorker(workers_[i]);
+        }
+    }
+
+    int8_t* DtwEnvelope::prepare(int frame_num, int dimension, int radius)
+    {
+        deinit();
+        if (frame_num <= 0 || dimension <= 0 || radius < 0) { return nullptr; }
+        buffer_.reset(new (std::nothrow) int8_t[2 * frame_num * dimension]);
+        if (!buffer_) { return nullptr; }
+        upper_ = buffer_.get();
+        lower_ = &buffer_[frame_num * dimension];
+        frame_num_ = frame_num;
+        dimension_ = dimension;
+        radius_ = radius;
+        return buffer_.get();
+    }
+
+    void DtwEnvelope::deinit()
+    {
+        buffer_.reset();
+        upper_ = nullptr;
+        lower_ = nullptr;
+        frame_num_ = 0;
+        dimension_ = 0;
+        radius_ = 0;
+    }
+
+    bool DtwEnvelope::parse(const void* data, size_t length, bool copy)
+    {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        if (bytes == nullptr || length < kHeaderSize) { return false; }
+        if (bytes[0] != kEnvelopeTag)
+        {
+            printf("Unsupported format(%d)\n", (int)bytes[0]);
+            return false;
+        }
+
+        int32_t frame_num, dimension, radius;
+        memcpy(&frame_num, &bytes[4], sizeof(frame_num));
+        memcpy(&dimension, &bytes[8], sizeof(dimension));
+        memcpy(&radius, &bytes[12], sizeof(radius));
+        if (frame_num <= 0 || dimension <= 0 || radius < 0) { return false; }
+        const size_t value_num = (size_t)frame_num * dimension;
+        if (kHeaderSize + 2 * value_num > length) { return false; }
+
+        const auto* values = reinterpret_cast<const int8_t*>(&bytes[kHeaderSize]);
+        if (copy)
+        {
+            int8_t* dest = prepare(frame_num, dimension, radius);
+            if (dest == nullptr) { return false; }
+            memcpy(dest, values, 2 * value_num);
+            return true;
+        }
+        deinit();
+        upper_ = values;
+        lower_ = &values[value_num];
+        frame_num_ = frame_num;
+        dimension_ = dimension;
+        radius_ = radius;
+        return true;
+    }
+
+    void DtwEnvelope::writeImage(void* dest) const
+    {
+        auto* bytes = static_cast<uint8_t*>(dest);
+        memset(bytes, 0, kHeaderSize);
+        bytes[0] = kEnvelopeTag;
+        const int32_t frame_num = frame_num_;
+        const int32_t dimension = dimension_;
+        const int32_t radius = radius_;
+        memcpy(&bytes[4], &frame_num, sizeof(frame_num));
+        memcpy(&bytes[8], &dimension, sizeof(dimension));
+        memcpy(&bytes[12], &radius, sizeof(radius));
+        const size_t value_num = (size_t)frame_num_ * dimension_;
+        if (value_num == 0) { return; }
+        memcpy(&bytes[kHeaderSize], upper_, value_num);
+        memcpy(&bytes[kHeaderSize + value_num], lower_, value_num);
+    }
+
+namespace detail
+{
+    void AddDtwStats(uint64_t cell_count, bool is_abandoned)
+    {
+#if SIMPLEVOX_ENABLE_STATS
+        dtw_call_count.fetch_add(1, std::memory_order_relaxed);
+        dtw_cell_count.fetch_add(cell_count, std::memory_order_relaxed);
+        dtw_abandon_count.fetch_add(is_abandoned ? 1 : 0, std::memory_order_relaxed);
+#else
+        (void)cell_count;
+        (void)is_abandoned;
+#endif
+    }
+
+    void AddDtwPrunedStats()
+    {
+#if SIMPLEVOX_ENABLE_STATS
+        dtw_pruned_count.fetch_add(1, std::memory_order_relaxed);
+#endif
+    }
+
+    int InnerProduct(const int16_t *vec1, int n, const int16_t *vec2)
+    {
+        return InnerProductOf(vec1, n, vec2);
+    }
+
+    /**
+     * @brief int8_tの特徴量(MfccFeatureInt8)を含む内積
+     * @note  テンプレートごとのスケールはコサイン距離に影響しないため、量子化した値のまま積和を行う
+     */
+    int InnerProduct(const int16_t *vec1, int n, const int8_t *vec2)
+    {
+        return InnerProductOf(vec1, n, vec2);
+    }
+
+    int InnerProduct(const int8_t *vec1, int n, const int16_t *vec2)
+    {
+        return InnerProductOf(vec1, n, vec2);
+    }
+
+    int InnerProduct(const int8_t *vec1, int n, const int8_t *vec2)
+    {
+        return InnerProductOf(vec1, n, vec2);
+    }
+
+    /**
+     * @brief １つのベクトルと４つのベクトルそれぞれの内積を求める
+     * @details
+     * vecの各要素の読み出しを４つの積和で共有し、アキュムレータをレジスタ上に保持する。
+     * 次元数が小さい(12程度)場合、１ベクトルずつ求めるよりもループのオーバーヘッドと読み出しが削減される。
+     * @param[in]   vec     ベクトル
+     * @param[in]   n       次元数
+     * @param[in]   vec0    ベクトル０
+     * @param[in]   vec1    ベクトル１
+     * @param[in]   vec2    ベクトル２
+     * @param[in]   vec3    ベクトル３
+     * @param[out]  dest    内積(vecとvec0~vec3, ４個)
+     */
+    void InnerProduct4(const int16_t* vec, int n,
+                       const int16_t* vec0, const int16_t* vec1, const int16_t* vec2, const int16_t* vec3,
+                       int* dest)
+    {
+        InnerProduct4Of(vec, n, vec0, vec1, vec2, vec3, dest);
+    }
+
+    void InnerProduct4(const int16_t* vec, int n,
+                       const int8_t* vec0, const int8_t* vec1, const int8_t* vec2, const int8_t* vec3,
+                       int* dest)
+    {
+        InnerProduct4Of(vec, n, vec0, vec1, vec2, vec3, dest);
+    }
+
+    void InnerProduct4(const int8_t* vec, int n,
+                       const int16_t* vec0, const int16_t* vec1, const int16_t* vec2, const int16_t* vec3,
+                       int* dest)
+    {
+        InnerProduct4Of(vec, n, vec0, vec1, vec2, vec3, dest);
+    }
+
+    void InnerProduct4(const int8_t* vec, int n,
+                       const int8_t* vec0, const int8_t* vec1, const int8_t* vec2, const int8_t* vec3,
+                       int* dest)
+    {
+        InnerProduct4Of(vec, n, vec0, vec1, vec2, vec3, dest);
+    }
+
     /**
      * @brief 0から2の値をとるコサイン距離を求める
      *
@@ -10,14 +10,256 @@
 #ifndef SIMPLEVOX_DTW_H_
 #define SIMPLEVOX_DTW_H_
 
+#include <memory>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "simplevox_feature.h"
+#include "simplevox_stats.h"
 
 namespace simplevox
 {
-    template <class T1, class T2>
-    uint32_t calcDTW(const ISoundFeature<T1> &feature1, const ISoundFeature<T2> &feature2);
+    struct DtwConfig
+    {
+        /**
+         * @brief Sakoe-Chibaバンドの幅(特徴量２のフレーム数), 負の場合は制約なし
+         * @details
+         * 特徴量１の各フレームに対して、対角線上の位置からこの幅以内にある特徴量２のフレームのみ評価します。
+         * ただし、経路が存在するように２つの特徴量の長さの比(切り上げ)を下限とします。
+         */
+        int band_width = -1;
+
+        /**
+         * @brief 打ち切り距離, DTW距離がこの値以上になることが確定した時点で計算を打ち切ります
+         * @note 一致判定のしきい値(例: 180)を指定すると、明らかに一致しない場合の計算量を削減できます
+         */
+        uint32_t abandon_distance = UINT32_MAX;
+    };
+
+    /**
+     * @brief DTWの作業領域(特徴量２のフレーム数分)
+     * @details 事前に確保してcalcDTW()やcalcDTWBatch()に渡すと、呼び出しごとのヒープの確保が不要になります
+     */
+    class DtwWorkspace
+    {
+    private:
+        std::unique_ptr<float[]> inverse_norm2_;
+        std::unique_ptr<int[]> inner_row_;
+        std::unique_ptr<int16_t[]> step_counts_;
+        std::unique_ptr<uint32_t[]> step_distances_;
+        int capacity_ = 0;
+    public:
+        /**
+         * @brief   作業領域を確保します
+         * @param[in]   max_size    特徴量２の最大のフレーム数
+         * @return 確保に成功したらtrue, 失敗したらfalse
+         */
+        bool init(int max_size);
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   扱える特徴量２の最大のフレーム数
+         */
+        int capacity() const { return capacity_; }
+
+        float* inverse_norm2() { return inverse_norm2_.get(); }
+        int* inner_row() { return inner_row_.get(); }
+        int16_t* step_counts() { return step_counts_.get(); }
+        uint32_t* step_distances() { return step_distances_.get(); }
+    };
+
+    /**
+     * @brief テンプレートの下限値の算出(LB_Keogh)に用いる包絡線
+     * @details
+     * テンプレートの各フレームをノルムで正規化し、前後radiusフレームにおける各係数の最大値と最小値を保持します。
+     * 登録時に１度だけ作成し、テンプレートのファイルに保存しておくと(MfccEngine::saveFile())、
+     * calcDTWBatch()で明らかに一致しないテンプレートのDTWを省略できます。
+     * 値は正規化した値(-1~1)をkScale倍して外側に丸めたものです。
+     */
+    class DtwEnvelope
+    {
+    private:
+        std::unique_ptr<int8_t[]> buffer_;
+        const int8_t* upper_ = nullptr;
+        const int8_t* lower_ = nullptr;
+        int frame_num_ = 0;
+        int dimension_ = 0;
+        int radius_ = 0;
+
+        int8_t* prepare(int frame_num, int dimension, int radius);
+    public:
+        static constexpr int kScale = 127;
+        static constexpr size_t kHeaderSize = 16;   ///< イメージのヘッダ(tag + 詰め物 + frame_num + dimension + radius)
+
+        /**
+         * @brief   テンプレートから包絡線を作成します
+         * @param[in]   feature テンプレート
+         * @param[in]   radius  包絡線をとる前後のフレーム数(DtwConfig::band_widthを特徴量１のフレーム数に換算した程度)
+         * @return  作成に成功したらtrue, 失敗したらfalse
+         */
+        template <class T, typename V>
+        bool init(const ISoundFeature<T, V> &feature, int radius);
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   writeImage()で書き出したイメージを読み込みます
+         * @param[in]   data    イメージの先頭
+         * @param[in]   length  dataのバイト数
+         * @param[in]   copy    trueの場合はヒープにコピーし、falseの場合はdataをそのまま参照します
+         * @return  読み込みに成功したらtrue, 形式が異なる場合はfalse
+         */
+        bool parse(const void* data, size_t length, bool copy = false);
+
+        /**
+         * @brief   イメージのバイト数
+         */
+        size_t imageSize() const { return kHeaderSize + 2 * (size_t)frame_num_ * dimension_; }
+
+        /**
+         * @brief   イメージを書き出します
+         * @param[out]  dest    書き出し先(imageSize()バイト)
+         */
+        void writeImage(void* dest) const;
+
+        int size() const { return frame_num_; }
+        int dimension() const { return dimension_; }
+        int radius() const { return radius_; }
+        const int8_t* upper(int number) const { return &upper_[number * dimension_]; }
+        const int8_t* lower(int number) const { return &lower_[number * dimension_]; }
+    };
+
+    struct DtwPoolConfig
+    {
+        /**
+         * @brief 呼び出し元を含むワーカーの数(1の場合は呼び出し元のみで実行)
+         */
+        int worker_num = 2;
+
+        /**
+         * @brief 追加のワーカー(タスク)のコア, 優先度, スタックサイズ
+         * @details ２つ目以降の追加のワーカーは順に次のコアに割り当てます。コアが負の場合は指定しません。
+         * @note KwsPipelineと併用する場合は、録音タスク(capture_priority)より低い優先度としてください
+         */
+        int worker_core = 0;
+        int worker_priority = 4;
+        uint32_t worker_stack_size = 4096;
+    };
+
+    /**
+     * @brief calcDTWBatch()のテンプレートを複数のコアで分担して計算するワーカーとその作業領域
+     * @details
+     * 呼び出し元がワーカー０となり、追加のワーカー(ESP32ではタスク, ホスト環境ではスレッド)と
+     * テンプレートを１つずつ取り出して計算します。各ワーカーはDtwWorkspaceを持ちます。
+     * 複数のタスクから同時にcalcDTWBatch()に渡さないでください。
+     */
+    class DtwWorkerPool
+    {
+    private:
+        struct Task
+        {
+            DtwWorkerPool* pool;
+            int worker;
+        };
+
+        std::unique_ptr<DtwWorkspace[]> workspaces_;
+        std::unique_ptr<void*[]> workers_;
+        std::unique_ptr<Task[]> tasks_;
+        int worker_num_ = 0;
+        void (*job_)(void* arg, int worker) = nullptr;
+        void* job_arg_ = nullptr;
+
+        static void RunTask(void* arg);
+    public:
+        DtwWorkerPool() = default;
+        DtwWorkerPool(const DtwWorkerPool&) = delete;
+        DtwWorkerPool& operator=(const DtwWorkerPool&) = delete;
+        ~DtwWorkerPool() { deinit(); }
+
+        /**
+         * @brief   ワーカーと作業領域を作成します
+         * @param[in]   max_size    特徴量２の最大のフレーム数
+         * @param[in]   config      ワーカーの数などのコンフィグ
+         * @return 作成に成功したらtrue, 失敗したらfalse
+         */
+        bool init(int max_size, const DtwPoolConfig& config = DtwPoolConfig());
+
+        /**
+         * @brief   ワーカーを停止し、リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   呼び出し元を含むワーカーの数
+         */
+        int workerNum() const { return worker_num_; }
+
+        /**
+         * @brief   扱える特徴量２の最大のフレーム数
+         */
+        int capacity() const { return (worker_num_ > 0) ? workspaces_[0].capacity() : 0; }
+
+        /**
+         * @brief   ワーカーの作業領域
+         */
+        DtwWorkspace& workspace(int worker) { return workspaces_[worker]; }
+
+        /**
+         * @brief   全てのワーカーでjob(arg, ワーカーの番号)を実行し、完了を待ちます
+         * @note    呼び出し元はワーカー０として実行します
+         */
+        void run(void (*job)(void* arg, int worker), void* arg);
+    };
+
+    /**
+     * @brief   calcDTW()およびcalcDTWBatch()の評価したセル数などの積算値
+     * @note    SIMPLEVOX_ENABLE_STATSが0の場合は常に0
+     */
+    DtwStats dtwStats();
+
+    /**
+     * @brief   dtwStats()の積算値をリセットします
+     */
+    void resetDtwStats();
+
+    template <class T1, class T2, typename V1, typename V2>
+    uint32_t calcDTW(const ISoundFeature<T1, V1> &feature1, const ISoundFeature<T2, V2> &feature2);
+
+    template <class T1, class T2, typename V1, typename V2>
+    uint32_t calcDTW(const ISoundFeature<T1, V1> &feature1, const ISoundFeature<T2, V2> &feature2,
+                     const DtwConfig& config);
+
+    template <class T1, class T2, typename V1, typename V2>
+    int calcDTWPath(const ISoundFeature<T1, V1> &feature1, const ISoundFeature<T2, V2> &feature2,
+                    const DtwConfig& config, int16_t* path1, int16_t* path2);
+
+    template <class T1, class T2, typename V2>
+    int calcDTWBatch(const T1* const* templates, int num, const ISoundFeature<T2, V2> &query, uint32_t* distances);
+
+    template <class T1, class T2, typename V2>
+    int calcDTWBatch(const T1* const* templates, int num, const ISoundFeature<T2, V2> &query, uint32_t* distances,
+                     const DtwConfig& config);
+
+    template <class T1, class T2, typename V2>
+    int calcDTWBatch(const T1* const* templates, int num, const ISoundFeature<T2, V2> &query, uint32_t* distances,
+                     const DtwConfig& config, DtwWorkspace& workspace);
+
+    template <class T1, class T2, typename V2>
+    int calcDTWBatch(const T1* const* templates, const DtwEnvelope* const* envelopes, int num,
+                     const ISoundFeature<T2, V2> &query, uint32_t* distances,
+                     const DtwConfig& config, DtwWorkspace& workspace);
+
+    template <class T1, class T2, typename V2>
+    int calcDTWBatch(const T1* const* templates, const DtwEnvelope* const* envelopes, int num,
+                     const ISoundFeature<T2, V2> &query, uint32_t* distances,
+                     const DtwConfig& config, DtwWorkerPool& pool);
 } // namespace simplevox
 
 #include "detail/simplevox_dtw.h"
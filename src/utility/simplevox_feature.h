@@ -10,18 +10,85 @@
 #ifndef SIMPLEVOX_FEATURE_H_
 #define SIMPLEVOX_FEATURE_H_
 
+#include<math.h>
 #include<stdint.h>
 
 namespace simplevox
 {
+namespace detail
+{
+    /**
+     * @brief   実装するクラスが宣言したinverse_norms()を呼び出します
+     * @note    ISoundFeatureのものしかない(継承しただけの)場合は2つ目が選ばれ、nullptrを返します
+     */
     template <class T>
+    const float* InverseNormsOf(const T& feature, const float* (T::*)() const)
+    {
+        return feature.inverse_norms();
+    }
+
+    template <class T, class Base>
+    const float* InverseNormsOf(const T&, const float* (Base::*)() const)
+    {
+        return nullptr;
+    }
+} // namespace detail
+
+    /**
+     * @tparam  T   実装するクラス
+     * @tparam  V   特徴量の各要素の型(int16_t, またはテンプレートごとにスケーリングしたint8_t)
+     */
+    template <class T, typename V = int16_t>
     class ISoundFeature
     {
     public:
+        using value_type = V;
         int size() const { return static_cast<const T*>(this)->size(); }
         int dimension() const { return static_cast<const T*>(this)->dimension(); }
-        const int16_t *feature(int number) const { return static_cast<const T*>(this)->feature(number); }
+        const V *feature(int number) const { return static_cast<const T*>(this)->feature(number); }
+
+        /**
+         * @brief   各フレームの特徴量のノルムの逆数(size()個), 保持していない場合はnullptr
+         * @note    Tがinverse_norms()を持たない場合もnullptr
+         */
+        const float *inverse_norms() const
+        {
+            const T& feature = *static_cast<const T*>(this);
+            return detail::InverseNormsOf(feature, &T::inverse_norms);
+        }
     };
+
+    /**
+     * @brief   特徴量ベクトルのノルムの逆数を求めます
+     * @param[in]   vec 特徴量ベクトル
+     * @param[in]   n   次元数
+     * @return  ノルムの逆数, ゼロベクトルの場合は0
+     */
+    inline float calcInverseNorm(const int16_t* vec, int n)
+    {
+        int inner = 0;
+        for (int i = 0; i < n; i++)
+        {
+            inner += (int)vec[i] * vec[i];
+        }
+        return (inner == 0) ? 0 : 1.0f / sqrtf((float)inner);
+    }
+
+    /**
+     * @brief   特徴量ベクトル(int8_t)のノルムの逆数を求めます
+     * @param[in]   vec 特徴量ベクトル
+     * @param[in]   n   次元数
+     * @return  ノルムの逆数, ゼロベクトルの場合は0
+     */
+    inline float calcInverseNorm(const int8_t* vec, int n)
+    {
+        int inner = 0;
+        for (int i = 0; i < n; i++)
+        {
+            inner += (int)vec[i] * vec[i];
+        }
+        return (inner == 0) ? 0 : 1.0f / sqrtf((float)inner);
+    }
 } // namespace simplevox
 
 #endif // SIMPLEVOX_FEATURE_H_
\ No newline at end of file
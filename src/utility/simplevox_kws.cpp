@@ -0,0 +1,392 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#include "simplevox_kws.h"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdio.h>
+
+namespace
+{
+    int DivCeil(int dividend, int divisor)
+    {
+        return (dividend + divisor - 1) / divisor;
+    }
+
+    int FrameNum(const simplevox::MfccConfig& config, int length)
+    {
+        return (length - (config.frame_length() - config.hop_length())) / config.hop_length();
+    }
+}
+
+namespace simplevox
+{
+    bool KeywordSpotter::init(const KwsConfig& config)
+    {
+        int before_frame_num = 0;
+        int max_frame_num = 0;
+        if (!detail::CalcFeatureFrameNum(config.vad_config, config.mfcc_config, config.max_time_ms,
+                                         &before_frame_num, &max_frame_num))
+        {
+            return false;
+        }
+
+        const auto& mfcc_config = config.mfcc_config;
+        if (!vad_engine_.init(config.vad_config))
+        {
+            printf("Failed to initialize vad\n");
+            return false;
+        }
+        if (!mfcc_engine_.init(mfcc_config))
+        {
+            printf("Failed to initialize mfcc\n");
+            vad_engine_.deinit();
+            return false;
+        }
+        if (!feature_ring_.init(mfcc_engine_, max_frame_num, before_frame_num))
+        {
+            mfcc_engine_.deinit();
+            vad_engine_.deinit();
+            return false;
+        }
+
+        normalized_frame_.reset(new (std::nothrow) int16_t[mfcc_config.coef_num]);
+        if (!normalized_frame_
+            || !arena_.init(max_frame_num, mfcc_config.coef_num, config.feature_caps, false)
+            || !dtw_workspace_.init(max_frame_num))
+        {
+            printf("Failed to create heap\n");
+            deinit();
+            return false;
+        }
+
+        config_ = config;
+        reset();
+        return true;
+    }
+
+    void KeywordSpotter::deinit()
+    {
+        incremental_dtw_.deinit();
+        templates_.clear();
+        feature_ring_.deinit();
+        normalized_frame_.reset();
+        arena_.deinit();
+        dtw_workspace_.deinit();
+        mfcc_engine_.deinit();
+        vad_engine_.deinit();
+    }
+
+    void KeywordSpotter::reset()
+    {
+        vad_engine_.reset();
+        clearFeatures();
+    }
+
+    void KeywordSpotter::clearFeatures()
+    {
+        feature_ring_.clear();
+        incremental_dtw_.reset();
+        is_linear_ = false;
+        fed_count_ = 0;
+    }
+
+    bool KeywordSpotter::setTemplates(const MfccFeature* const* templates, int num)
+    {
+        return assignTemplates(templates, num);
+    }
+
+    bool KeywordSpotter::setTemplates(const MfccFeatureView* const* templates, int num)
+    {
+        return assignTemplates(templates, num);
+    }
+
+    template <class T>
+    bool KeywordSpotter::assignTemplates(const T* const* templates, int num)
+    {
+        if (num < 0 || (num > 0 && templates == nullptr))
+        {
+            return false;
+        }
+
+        incremental_dtw_.deinit();
+        if (config_.incremental && num > 0)
+        {
+            if (templates[0]->dimension() != config_.mfcc_config.coef_num
+                || !incremental_dtw_.init(templates, num, config_.dtw_config))
+            {
+                return false;
+            }
+        }
+        if (!templates_.assign(templates, num))
+        {
+            incremental_dtw_.deinit();
+            return false;
+        }
+        // 照合中の区間は新しいテンプレートで計算し直す
+        fed_count_ = 0;
+        return true;
+    }
+
+    bool KeywordSpotter::setThresholds(const uint32_t* thresholds)
+    {
+        return templates_.setThresholds(thresholds);
+    }
+
+    KwsEvent KeywordSpotter::process(const int16_t* data)
+    {
+        const auto state = vad_engine_.process(data);
+        const auto event = process(data, state);
+        if (event != KwsEvent::None)
+        {
+            vad_engine_.reset();
+        }
+        return event;
+    }
+
+    KwsEvent KeywordSpotter::process(const int16_t* data, VadState state)
+    {
+        if (!feature_ring_.isInitialized()) { return KwsEvent::None; }
+
+        if (is_linear_)     // 前回の判定結果を破棄
+        {
+            clearFeatures();
+        }
+
+        feature_ring_.push(data, config_.vad_config.frame_length(), state);
+        if (state >= VadState::Speech && config_.incremental)
+        {
+            feedIncremental();
+        }
+
+        // 検出完了もしくは最大フレームに到達した場合は判定
+        if (state == VadState::Detected || (state >= VadState::Speech && feature_ring_.isFull()))
+        {
+            feature_ring_.linearize();
+            is_linear_ = true;
+            return match();
+        }
+        return KwsEvent::None;
+    }
+
+    void KeywordSpotter::feedIncremental()
+    {
+        if (templates_.size() <= 0) { return; }
+
+        // それまでの区間の統計量で標準化する
+        const auto& normalizer = feature_ring_.normalizer();
+        for (; fed_count_ < feature_ring_.size(); fed_count_++)
+        {
+            normalizer.apply(feature_ring_.frame(fed_count_), 1, normalized_frame_.get());
+            incremental_dtw_.push(normalized_frame_.get());
+        }
+    }
+
+    KwsEvent KeywordSpotter::match()
+    {
+        matched_index_ = -1;
+        distance_ = UINT32_MAX;
+        uint32_t* distances = templates_.distances();
+
+        if (config_.incremental)
+        {
+            matched_index_ = (templates_.size() > 0) ? incremental_dtw_.result(distances) : -1;
+            if (matched_index_ >= 0)
+            {
+                distance_ = distances[matched_index_];
+            }
+            return (distance_ < templates_.threshold(matched_index_, config_.threshold))
+                    ? KwsEvent::Match
+                    : KwsEvent::NoMatch;
+        }
+
+        // 統計量はSpeechの検出以降に逐次求めているため、標準化は１回の走査で済む
+        MfccFeatureView feature;
+        if (!feature_ring_.create(mfcc_engine_, arena_, &feature))
+        {
+            return KwsEvent::NoMatch;
+        }
+
+        matched_index_ = calcDTWBatch(templates_.pointers(), templates_.size(), feature, distances,
+                                      config_.dtw_config, dtw_workspace_);
+        if (matched_index_ >= 0)
+        {
+            distance_ = distances[matched_index_];
+        }
+
+        return (distance_ < templates_.threshold(matched_index_, config_.threshold))
+                ? KwsEvent::Match
+                : KwsEvent::NoMatch;
+    }
+
+    MfccFeature* KeywordSpotter::createFeature()
+    {
+        if (!is_linear_ || feature_ring_.size() <= 0) { return nullptr; }
+        return mfcc_engine_.create(feature_ring_.linearize(), feature_ring_.size(), config_.mfcc_config.coef_num);
+    }
+
+namespace detail
+{
+    bool CalcFeatureFrameNum(const VadConfig& vad_config, const MfccConfig& mfcc_config, int max_time_ms,
+                             int* before_frame_num, int* max_frame_num)
+    {
+        if (vad_config.sample_rate != mfcc_config.sample_rate)
+        {
+            printf("Sample rate mismatch\n");
+            return false;
+        }
+        if (mfcc_config.hop_length() <= 0)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+
+        // VADのHangbeforeおよびPreDetectionに相当するフレーム数
+        const int vad_before_length =
+                    vad_config.frame_length() *
+                    ( DivCeil(vad_config.before_length(), vad_config.frame_length())
+                    + DivCeil(vad_config.decision_length(), vad_config.frame_length()));
+        *before_frame_num = std::max(0, FrameNum(mfcc_config, vad_before_length));
+        *max_frame_num = FrameNum(mfcc_config, max_time_ms * mfcc_config.sample_rate / 1000);
+        if (*max_frame_num <= *before_frame_num)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+        return true;
+    }
+
+    bool FeatureRing::init(MfccEngine& engine, int max_frame_num, int before_frame_num)
+    {
+        const auto config = engine.config();
+        if (max_frame_num <= 0 || before_frame_num < 0 || config.hop_length() <= 0)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+        if (!mfcc_stream_.init(engine))
+        {
+            return false;
+        }
+        features_.reset(new (std::nothrow) float[max_frame_num * config.coef_num]);
+        if (!features_ || !normalizer_.init(config.coef_num, config.per_coef_normalize))
+        {
+            printf("Failed to create heap\n");
+            deinit();
+            return false;
+        }
+
+        coef_num_ = config.coef_num;
+        hop_length_ = config.hop_length();
+        max_frame_num_ = max_frame_num;
+        before_frame_num_ = before_frame_num;
+        clear();
+        return true;
+    }
+
+    void FeatureRing::deinit()
+    {
+        features_.reset();
+        mfcc_stream_.deinit();
+    }
+
+    void FeatureRing::clear()
+    {
+        mfcc_stream_.reset();
+        normalizer_.reset();
+        head_ = 0;
+        count_ = 0;
+    }
+
+    void FeatureRing::push(const int16_t* data, int length, VadState state)
+    {
+        if (state >= VadState::Silence)
+        {
+            // hop_length()ずつ入力すると算出されるフレームは高々１つのため、リングの末尾に１フレームずつ書き込む
+            // (MfccConfig::frame_time_msが20ms未満の場合は10ms分から複数のフレームが算出される)
+            for (int offset = 0; offset < length && count_ < max_frame_num_; offset += hop_length_)
+            {
+                const int tail = (head_ + count_) % max_frame_num_;
+                count_ += mfcc_stream_.push(&data[offset], std::min(hop_length_, length - offset),
+                                            &features_[tail * coef_num_], 1);
+            }
+        }
+
+        // Speech以前(Silence, PreDetection)の場合はbefore_frame_num_を超えた古いフレームを破棄
+        if (state < VadState::Speech && count_ > before_frame_num_)
+        {
+            const int drop_num = count_ - before_frame_num_;
+            head_ = (head_ + drop_num) % max_frame_num_;
+            count_ -= drop_num;
+        }
+
+        // Speechの検出時はそれまでのフレーム(Speech以降は破棄されない)をまとめて反映
+        if (state >= VadState::Speech)
+        {
+            for (int n = normalizer_.size(); n < count_; n++)
+            {
+                normalizer_.push(frame(n));
+            }
+        }
+    }
+
+    const float* FeatureRing::linearize()
+    {
+        float* begin = features_.get();
+        if (head_ + count_ > max_frame_num_)
+        {
+            std::rotate(begin, &begin[head_ * coef_num_], &begin[max_frame_num_ * coef_num_]);
+        }
+        else if (head_ > 0)
+        {
+            std::copy_n(&begin[head_ * coef_num_], count_ * coef_num_, begin);
+        }
+        head_ = 0;
+        return begin;
+    }
+
+    bool FeatureRing::create(MfccEngine& engine, MfccArena& arena, MfccFeatureView* dest)
+    {
+        const float* features = linearize();
+        return (normalizer_.size() == count_)
+            ? engine.create(features, count_, normalizer_, arena, dest)
+            : engine.create(features, count_, coef_num_, arena, dest);
+    }
+
+    bool TemplateSet::setThresholds(const uint32_t* thresholds)
+    {
+        if (thresholds == nullptr)
+        {
+            thresholds_.reset();
+            return true;
+        }
+        std::unique_ptr<uint32_t[]> temp(new (std::nothrow) uint32_t[std::max(num_, 1)]);
+        if (!temp)
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+        std::copy_n(thresholds, num_, temp.get());
+        thresholds_ = std::move(temp);
+        return true;
+    }
+
+    void TemplateSet::clear()
+    {
+        templates_.reset();
+        template_ptrs_.reset();
+        distances_.reset();
+        thresholds_.reset();
+        num_ = 0;
+    }
+} // namespace detail
+
+} // namespace simplevox
@@ -0,0 +1,205 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef SIMPLEVOX_KWS_H_
+#define SIMPLEVOX_KWS_H_
+
+#include <memory>
+#include <stdint.h>
+
+#include "simplevox_dtw.h"
+#include "simplevox_mfcc.h"
+#include "simplevox_platform.h"
+#include "simplevox_sdtw.h"
+#include "simplevox_vad.h"
+#include "detail/simplevox_kws.h"
+
+namespace simplevox
+{
+    enum class KwsEvent
+    {
+        None,       ///< 判定中(音声区間の検出待ち)
+        Match,      ///< 音声区間を検出し、テンプレートと一致
+        NoMatch,    ///< 音声区間を検出したが、いずれのテンプレートとも一致しない
+    };
+
+    struct KwsConfig
+    {
+        VadConfig vad_config;
+        MfccConfig mfcc_config;
+
+        /**
+         * @brief 照合時のDTWのコンフィグ
+         * @note abandon_distanceにthresholdを指定すると一致しないテンプレートの計算を打ち切れます
+         */
+        DtwConfig dtw_config;
+
+        /**
+         * @brief 音声区間の最大長, これを超える場合は超えた時点で判定を行う
+         */
+        int max_time_ms = 3000;
+
+        /**
+         * @brief 一致と判定するDTW距離(この値未満で一致), しきい値は要調整
+         */
+        uint32_t threshold = 180;
+
+        /**
+         * @brief 音声区間の検出中にDTWを逐次的に計算するか(IncrementalDtw)
+         * @details
+         * 音声(Speech)を検出した時点から、MFCCの各フレームをそれまでの区間の平均と標準偏差で標準化して照合を進めます。
+         * 区間の確定時の処理が軽くなる一方、標準化の統計量が区間全体のものではないため距離はわずかに異なります。
+         * dtw_configのband_widthは無視されます。
+         */
+        bool incremental = false;
+
+        /**
+         * @brief 照合用の特徴量の領域(MfccArena)に用いるメモリの種類(heap_caps_malloc()のcaps)
+         * @note MALLOC_CAP_SPIRAMを含めると内部RAMを節約できますが、DTWの速度は低下します
+         */
+        uint32_t feature_caps = MALLOC_CAP_8BIT;
+    };
+
+    /**
+     * @brief VAD -> MFCC -> DTW による音声コマンドの検出を行います
+     * @details
+     * VadConfig::frame_length()ごとのサウンドデータを入力すると、
+     * 音声区間のMFCCを逐次算出し、音声区間の検出完了時に登録されたテンプレートとの照合を行います。
+     * 音声の開始前(Silence, PreDetection)の特徴量はリングバッファ上で保持されるため、シフトは発生しません。
+     * 照合に用いる領域は全てinit()およびsetTemplates()で確保されるため、process()はヒープの確保を行いません。
+     */
+    class KeywordSpotter
+    {
+    private:
+        KwsConfig config_;
+        VadEngine vad_engine_;
+        MfccEngine mfcc_engine_;
+        detail::FeatureRing feature_ring_;
+        bool is_linear_ = false;
+        detail::TemplateSet templates_;     ///< テンプレートとしきい値(設定されていない場合はconfig_.threshold)
+        MfccArena arena_;
+        DtwWorkspace dtw_workspace_;
+        int matched_index_ = -1;
+        uint32_t distance_ = UINT32_MAX;
+        IncrementalDtw incremental_dtw_;
+        std::unique_ptr<int16_t[]> normalized_frame_;
+        int fed_count_ = 0;
+
+        template <class T>
+        bool assignTemplates(const T* const* templates, int num);
+        void feedIncremental();
+        KwsEvent match();
+    public:
+        ~KeywordSpotter() { deinit(); }
+
+        KwsConfig config() const { return config_; }
+
+        /**
+         * @brief   内部のVadEngine(音声の登録などで直接利用する場合)
+         */
+        VadEngine& vad() { return vad_engine_; }
+
+        /**
+         * @brief   内部のMfccEngine(テンプレートの作成などで直接利用する場合)
+         */
+        MfccEngine& mfcc() { return mfcc_engine_; }
+
+        /**
+         * @brief   指定したコンフィグに沿って初期化処理を行います
+         * @param[in]   config  コンフィグ
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         */
+        bool init(const KwsConfig& config);
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   判定状況をリセットします(VADの状態も含む)
+         */
+        void reset();
+
+        /**
+         * @brief   保持している音声区間の特徴量のみ破棄します(VADの状態は変更しません)
+         * @note    VADを別のタスクで使用している場合(KwsPipeline)に用います
+         */
+        void clearFeatures();
+
+        /**
+         * @brief   照合に用いるテンプレートを設定します
+         * @param[in]   templates   テンプレートの配列
+         * @param[in]   num         テンプレートの個数
+         * @return 設定成功ならtrue, 失敗ならfalse
+         * @note    テンプレートは所有されないため、使用している間は有効である必要があります
+         */
+        bool setTemplates(const MfccFeature* const* templates, int num);
+
+        /**
+         * @brief   フラッシュ等に配置したテンプレートを設定します
+         * @param[in]   templates   テンプレートの配列
+         * @param[in]   num         テンプレートの個数
+         * @return 設定成功ならtrue, 失敗ならfalse
+         * @note    テンプレートの参照先は使用している間は有効である必要があります
+         */
+        bool setTemplates(const MfccFeatureView* const* templates, int num);
+
+        /**
+         * @brief   テンプレートごとのしきい値を設定します(MfccEngine::average()で求めた値など)
+         * @param[in]   thresholds  setTemplates()で設定した個数のしきい値, nullptrの場合はKwsConfig::thresholdに戻します
+         * @return 設定成功ならtrue, 失敗ならfalse
+         * @note    setTemplates()を呼び出すと解除されます。
+         *          照合は最も距離が小さいテンプレートのしきい値で判定されます。
+         *          DtwConfig::abandon_distanceはしきい値の最大値以上としてください
+         */
+        bool setThresholds(const uint32_t* thresholds);
+
+        /**
+         * @brief   音声区間の検出と照合を行います
+         * @param[in]   data    １フレーム(VadConfig::frame_length())分のサウンドデータ
+         * @return  判定結果, None以外の場合は内部のVADもリセットされます
+         */
+        KwsEvent process(const int16_t* data);
+
+        /**
+         * @brief   外部で算出したVADの状態を基にMFCCの算出と照合を行います
+         * @param[in]   data    １フレーム(VadConfig::frame_length())分のサウンドデータ
+         * @param[in]   state   dataに対するVadEngine::process()の結果
+         * @return  判定結果
+         * @note    None以外の場合、呼び出し元でVADをリセットする必要があります
+         */
+        KwsEvent process(const int16_t* data, VadState state);
+
+        /**
+         * @brief   直近の判定で最も距離が小さかったテンプレートの番号(テンプレートがない場合は-1)
+         */
+        int matchedIndex() const { return matched_index_; }
+
+        /**
+         * @brief   直近の判定で最も小さかったDTW距離
+         */
+        uint32_t distance() const { return distance_; }
+
+        /**
+         * @brief   直近の判定における各テンプレートとのDTW距離(setTemplates()で設定した個数)
+         */
+        const uint32_t* distances() const { return templates_.distances(); }
+
+        /**
+         * @brief   直近に検出した音声区間からMFCCを作成します(テンプレートの登録用)
+         * @return  作成に成功したらnullptr以外, 失敗したらnullptr
+         * @note    作成したMFCCはヒープに確保され、呼び出し側が所有します(不要になったらdeleteしてください)
+         *          直近の音声区間は次にprocess()を呼び出すまで保持されます
+         */
+        MfccFeature* createFeature();
+    };
+} // namespace simplevox
+
+#endif // SIMPLEVOX_KWS_H_
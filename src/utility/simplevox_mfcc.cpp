@@ -9,13 +9,18 @@
 
 #include "simplevox_mfcc.h"
 
+#include <algorithm>
 #include <math.h>
 #include <memory>
+#include <mutex>
 #include <new>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include <esp_heap_caps.h>
-#include <esp_dsp.h>
+#include "simplevox_dtw.h"
+#include "simplevox_platform.h"
+#include "detail/simplevox_mfcc_tables.h"
 
 namespace
 {
@@ -24,10 +29,27 @@ namespace
     constexpr int kDctCoef = 10000;
     constexpr int kNormalizeCoef = 1000;
     constexpr int kDistanceCoef = 1000;
+    constexpr int kFixedMfccCoef = 16;      ///< 固定小数点版MFCCの倍率(Q4)
+    constexpr int kFixedInputBits = 14;     ///< sc16 FFTへの入力の最大ビット数(符号除く)
+    constexpr int32_t kDbPerLog2 = 197283;  ///< 10 * log10(2) (Q16)
+    constexpr int32_t kLog2WindowCoef = 1741647;    ///< 2 * log2(kWindowCoef) (Q16)
+    constexpr float kMelFloor = 1.0f;       ///< 対数変換前のメルスペクトルの下限(0dB)
+    constexpr float kDbPerLog2f = 3.01029996f;      ///< 10 * log10(2)
+
+    /**
+     * @brief log2(1 + i / 32) (Q16, i = 0..32)
+     */
+    constexpr int32_t kLog2Table[] = {
+            0,  2909,  5732,  8473, 11136, 13727, 16248, 18704,
+        21098, 23433, 25711, 27936, 30109, 32234, 34312, 36346,
+        38336, 40286, 42196, 44068, 45904, 47705, 49472, 51207,
+        52911, 54584, 56229, 57845, 59434, 60997, 62534, 64047,
+        65536,
+    };
 
     bool VerifyMfccConfig(const simplevox::MfccConfig& config)
     {
-        if (config.fft_num < 0 || !dsp_is_power_of_two(config.fft_num))
+        if (config.fft_num < 0 || (config.fft_num & (config.fft_num - 1)) != 0)
         {
             return false;
         }
@@ -46,7 +68,18 @@ namespace
             return false;
         }
 
-        if (config.frame_length() > config.fft_num)
+        if (config.per_coef_normalize && config.coef_num > simplevox::MfccNormalizer::kMaxCoefNum)
+        {
+            return false;
+        }
+
+        // hop_length()が0の場合はMfccStreamがフレームを進められない
+        if (config.frame_length() > config.fft_num || config.hop_length() <= 0)
+        {
+            return false;
+        }
+
+        if (config.arithmetic == simplevox::MfccArithmetic::FixedPoint && config.fft_num < 4)
         {
             return false;
         }
@@ -127,339 +160,1742 @@ namespace
         return true;
     }
 
-    void ApplyMelFilter(const float *src, const int16_t *mel_position, int channel_num, float *dest)
+    /**
+     * @brief プリエンファシスと窓関数を適用する
+     * @param[in]   src             サウンドデータ
+     * @param[in]   length          サウンドデータの長さ
+     * @param[in]   window          srcの先頭に対応する窓関数
+     * @param[in]   pre_emphasis    プリエンファシス係数[%]
+     * @param[in]   prev_val        srcの直前のサンプル値
+     * @param[out]  dest            適用結果の格納先(length個)
+     * @return  srcの最後のサンプル値(lengthが0の場合はprev_val)
+     */
+    int ApplyPreEmphasis(const int16_t* src, int length, const int16_t* window, int pre_emphasis, int prev_val, float* dest)
+    {
+        for (int i = 0; i < length; i++)
+        {
+            const int curt_val = src[i];
+            const float pre_emphasised = curt_val - pre_emphasis * prev_val / kPreEmphaCoef;
+            dest[i] = pre_emphasised * window[i] / kWindowCoef;
+            prev_val = curt_val;
+        }
+        return prev_val;
+    }
+
+    /**
+     * @brief Mel-Filterの各チャンネルの重みを設定する
+     * @details
+     * 各チャンネルの三角波は前のチャンネルの中心位置から次のチャンネルの中心位置までの範囲を持つため、
+     * チャンネルごとに開始位置と長さ、その範囲の重みのみを保持する(重みはチャンネル順に連続して格納)。
+     * @param[in]   position    SetupMelFilter()で設定した位置情報
+     * @param[in]   channel_num メルチャンネル数
+     * @param[in]   normalize   重みの正規化方法
+     * @param[in]   delta_freq  FFTの1点あたりの周波数[Hz]
+     * @param[out]  begin       各チャンネルの開始位置(channel_num個)
+     * @param[out]  length      各チャンネルの長さ(channel_num個)
+     * @param[out]  weight      重み(MelWeightNum()個)
+     * @retval  true    設定成功
+     * @retval  false   設定失敗
+     */
+    bool SetupMelWeight(const int16_t *position, int channel_num, simplevox::MelNormalize normalize, float delta_freq,
+                        int16_t *begin, int16_t *length, float *weight)
     {
-        const int posEnd = channel_num + 2;
+        if (begin == nullptr || length == nullptr || weight == nullptr) { return false; }
 
         for (int i = 1; i <= channel_num; i++)
         {
-            const float increment = 1.0f / (mel_position[i] - mel_position[i - 1]);
+            begin[i - 1] = position[i - 1];
+            length[i - 1] = position[i + 1] - position[i - 1];
+
+            float* dest = weight;
+            const float increment = 1.0f / (position[i] - position[i - 1]);
             float coef = 0;
-            dest[i - 1] = 0;
-            for (int j = mel_position[i - 1]; j < mel_position[i]; j++)
+            for (int j = position[i - 1]; j < position[i]; j++)
             {
                 coef += increment;
-                dest[i - 1] += coef * src[j];
+                *weight++ = coef;
             }
-            const float decrement = 1.0f / (mel_position[i + 1] - mel_position[i]);
-            for (int j = mel_position[i]; j < mel_position[i + 1]; j++)
+            const float decrement = 1.0f / (position[i + 1] - position[i]);
+            for (int j = position[i]; j < position[i + 1]; j++)
             {
                 coef -= decrement;
-                dest[i - 1] += coef * src[j];
+                *weight++ = coef;
+            }
+
+            if (normalize == simplevox::MelNormalize::Slaney && length[i - 1] > 0)
+            {
+                // 三角波の面積が等しくなるように帯域幅で正規化する
+                const float scale = 2.0f / (length[i - 1] * delta_freq);
+                for (int j = 0; j < length[i - 1]; j++)
+                {
+                    dest[j] *= scale;
+                }
             }
         }
+        return true;
     }
 
-    enum class MfccTag: uint8_t
-    {
-        VERSION1 = 1,
-    };
-}
-
-
-namespace simplevox
-{
-    MfccFeature::MfccFeature(int frame_num, int coef_num): frame_num_(frame_num), coef_num_(coef_num)
+    /**
+     * @brief Mel-Filterの重みの総数(各チャンネルの長さの合計)
+     */
+    int MelWeightNum(const int16_t *position, int channel_num)
     {
-        feature_ = (int16_t*)heap_caps_malloc(sizeof(*feature_) * frame_num_ * coef_num_, MALLOC_CAP_8BIT);
+        return position[channel_num + 1] + position[channel_num] - position[1] - position[0];
     }
 
-    MfccFeature::~MfccFeature()
+    void ApplyMelFilter(const float *src, const int16_t *begin, const int16_t *length, const float *weight,
+                        int channel_num, float *dest)
     {
-        if (feature_ != NULL)
+        for (int i = 0; i < channel_num; i++)
         {
-            heap_caps_free(feature_);
-            feature_ = NULL;
+            const float* spectrum = &src[begin[i]];
+            float mel_val = 0;
+            for (int j = 0; j < length[i]; j++)
+            {
+                mel_val += weight[j] * spectrum[j];
+            }
+            dest[i] = mel_val;
+            weight += length[i];
         }
     }
 
-    void MfccEngine::release()
+    /**
+     * @brief 値を表すのに必要なビット数(0の場合は0)
+     */
+    int BitLength(uint32_t value)
     {
-        fft_data_.reset();
-        mel_data_.reset();
-        dctII_table_.reset();
-        mel_position_.reset();
-        window_.reset();
+        return (value == 0) ? 0 : 32 - __builtin_clz(value);
     }
 
-    bool MfccEngine::init(const MfccConfig &config)
+    /**
+     * @brief log2(1 + fraction / 2^16)をkLog2Tableの線形補間で求める(Q16)
+     * @note 誤差は最大で約2e-4です
+     */
+    int32_t Log2Mantissa(uint32_t fraction)
     {
-        if (!VerifyMfccConfig(config))
-        {
-            printf("Argument error\n");
-            return false;
-        }
+        const int index = fraction >> 11;
+        const int32_t rest = fraction & 0x7FF;
+        return kLog2Table[index] + (((kLog2Table[index + 1] - kLog2Table[index]) * rest) >> 11);
+    }
 
-        window_.reset(new (std::nothrow) int16_t[config.frame_length()]);
-        if (!SetupHammingWindow(window_.get(), config.frame_length()))
-        {
-            printf("Setup window error\n");
-            release();
-            return false;
-        }
+    /**
+     * @brief 2を底とする対数(Q16)
+     * @details 整数部は最上位ビットの位置から、小数部は続く16bitからLog2Mantissa()で求める。
+     * @param[in]   value   真数(0より大きいこと)
+     */
+    int32_t Log2Fixed(uint64_t value)
+    {
+        const int exponent = 63 - __builtin_clzll(value);
+        const uint32_t fraction = (value << (63 - exponent)) >> 47 & 0xFFFF;
+        return exponent * (1 << 16) + Log2Mantissa(fraction);
+    }
 
-        mel_position_.reset(new (std::nothrow) int16_t[config.mel_channel + 2]);
-        if (!SetupMelFilter(mel_position_.get(), config.sample_rate, config.fft_num, config.mel_channel))
-        {
-            printf("Setup MelFilter error\n");
-            release();
-            return false;
-        }
+    /**
+     * @brief 2を底とする対数の近似値
+     * @details 指数部はfloatの指数ビットから、小数部は仮数部の上位16bitからLog2Mantissa()で求める。
+     * 誤差は最大で約2e-4(10 * log10換算で約6e-4dB)です。
+     * @param[in]   value   真数(正規化数であること)
+     */
+    float FastLog2(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        const int exponent = (int)((bits >> 23) & 0xFF) - 127;
+        const uint32_t fraction = (bits >> 7) & 0xFFFF;
+        return exponent + Log2Mantissa(fraction) / 65536.0f;
+    }
 
-        dctII_table_.reset(new (std::nothrow) int16_t[config.coef_num * config.mel_channel]);
-        if (!SetupDctTable(dctII_table_.get(), config.coef_num, config.mel_channel))
+    /**
+     * @brief プリエンファシスと窓関数を適用した値の絶対値の最大値を求める
+     * @param[in]       src             サウンドデータ
+     * @param[in]       length          サウンドデータの長さ
+     * @param[in]       window          srcの先頭に対応する窓関数
+     * @param[in]       pre_emphasis    プリエンファシス係数[%]
+     * @param[in]       prev_val        srcの直前のサンプル値
+     * @param[in,out]   max_abs         これまでの最大値(更新される)
+     * @return  srcの最後のサンプル値(lengthが0の場合はprev_val)
+     */
+    int MaxPreEmphasis(const int16_t* src, int length, const int16_t* window, int pre_emphasis, int prev_val, uint32_t* max_abs)
+    {
+        uint32_t max_val = *max_abs;
+        for (int i = 0; i < length; i++)
         {
-            printf("Setup DctTable error\n");
-            release();
-            return false;
+            const int curt_val = src[i];
+            const int32_t value = (curt_val - pre_emphasis * prev_val / kPreEmphaCoef) * window[i];
+            max_val = std::max(max_val, (uint32_t)abs(value));
+            prev_val = curt_val;
         }
+        *max_abs = max_val;
+        return prev_val;
+    }
 
-        mel_data_.reset(new (std::nothrow) float[config.mel_channel]);
-        if (!mel_data_)
-        {
-            printf("Failed to create heap\n");
-            release();
-            return false;
-        }
-     
-        fft_data_.reset(new (std::nothrow) float[config.fft_num]);
-        if (!fft_data_)
+    /**
+     * @brief プリエンファシスと窓関数を適用し、ブロック浮動小数点の共通指数でスケーリングする
+     * @param[in]   src             サウンドデータ
+     * @param[in]   length          サウンドデータの長さ
+     * @param[in]   window          srcの先頭に対応する窓関数
+     * @param[in]   pre_emphasis    プリエンファシス係数[%]
+     * @param[in]   prev_val        srcの直前のサンプル値
+     * @param[in]   shift           右シフト量(負の場合は左シフト)
+     * @param[out]  dest            適用結果の格納先(length個, 値は(pre_emphasised * window) / 2^shift)
+     * @return  srcの最後のサンプル値(lengthが0の場合はprev_val)
+     */
+    int ApplyPreEmphasis(const int16_t* src, int length, const int16_t* window, int pre_emphasis, int prev_val, int shift, int16_t* dest)
+    {
+        const int32_t round = (shift > 0) ? (1 << (shift - 1)) : 0;
+        const int32_t scale = (shift < 0) ? (1 << -shift) : 1;
+        for (int i = 0; i < length; i++)
         {
-            printf("Failed to create heap\n");
-            release();
-            return false;
+            const int curt_val = src[i];
+            const int32_t value = (curt_val - pre_emphasis * prev_val / kPreEmphaCoef) * window[i];
+            dest[i] = (shift > 0) ? ((value + round) >> shift) : (value * scale);
+            prev_val = curt_val;
         }
+        return prev_val;
+    }
 
-        if (dsps_fft4r_initialized != 0)
-        {
-            printf("DSP is already initialized\n");
-            release();
-            return false;
-        }
-        if (dsps_fft4r_init_fc32(NULL, config.fft_num / 2) != ESP_OK)
+    /**
+     * @brief 実数FFT用の回転因子(cos, sin)を設定する
+     * @param[out]  twiddle 設定先(2 * (fft_num / 4 + 1)個, Q15)
+     * @param[in]   fft_num FFTのデータ点数
+     */
+    bool SetupTwiddle(int16_t* twiddle, int fft_num)
+    {
+        if (twiddle == nullptr) { return false; }
+        for (int k = 0; k <= fft_num / 4; k++)
         {
-            printf("DSP init error\n");
-            release();
-            return false;
+            const float angle = 2 * M_PI * k / fft_num;
+            twiddle[2 * k] = std::min(32767L, lroundf(32768 * cosf(angle)));
+            twiddle[2 * k + 1] = std::min(32767L, lroundf(32768 * sinf(angle)));
         }
-
-        mfcc_config_ = config;
         return true;
     }
 
-    void MfccEngine::deinit()
-    {
-        if (dctII_table_ == nullptr) { return; }
-        dsps_fft4r_deinit_fc32();
-        release();
-    }
-
-    void MfccEngine::calculate(const int16_t* frame, float* mfcc)
+    /**
+     * @brief 複素FFTの結果から実数信号のパワースペクトルを求める
+     * @details
+     * 長さfft_numの実数信号を長さhalf_numの複素信号とみなしたFFTの結果Zから
+     * X[k] = (Z[k] + Z*[m]) / 2 - i W^k (Z[k] - Z*[m]) / 2 (m = half_num - k)
+     * によって実数信号のスペクトルを復元し、そのパワーを同じ領域に格納する。
+     * k = 0の要素には直流成分とナイキスト周波数成分のパワーの和を格納する。
+     * @param[in,out]   data        複素FFTの結果(int16_tの実部, 虚部の組がhalf_num個) -> パワースペクトル(half_num個)
+     * @param[in]       twiddle     SetupTwiddle()で設定した回転因子
+     * @param[in]       half_num    複素FFTのデータ点数(fft_num / 2)
+     */
+    void RealPowerSpectrum(uint32_t* data, const int16_t* twiddle, int half_num)
     {
-        const int frame_length = mfcc_config_.frame_length();
-        const int fft_num = mfcc_config_.fft_num;
-        {
-            const int pre_emphasis = mfcc_config_.pre_emphasis;
-            int prev_val = 0;
-            for (int i = 0; i < frame_length; i++)
-            {
-                const int curt_val = frame[i];
-                const float pre_emphasised = curt_val - pre_emphasis * prev_val / kPreEmphaCoef;
-                fft_data_[i] = pre_emphasised * window_[i] / kWindowCoef;
-                prev_val = curt_val;
-            }
-            for (int i = frame_length; i < fft_num; i++)
-            {
-                fft_data_[i] = 0;
-            }
-        }
-
-        dsps_fft4r_fc32(fft_data_.get(), fft_num / 2);
-        dsps_bit_rev4r_fc32(fft_data_.get(), fft_num / 2);
-        dsps_cplx2real_fc32(fft_data_.get(), fft_num / 2);
+        int16_t z0[2];
+        memcpy(z0, &data[0], sizeof(z0));
+        const int32_t dc = z0[0] + z0[1];
+        const int32_t nyquist = z0[0] - z0[1];
+        data[0] = (uint32_t)(dc * dc) + (uint32_t)(nyquist * nyquist);
 
-        static int frame_count = 0;
-        float* power_spectrum = fft_data_.get();
-        for (int i = 0; i < fft_num / 2; i++)
+        for (int k = 1; k <= half_num / 2; k++)
         {
-            const float re = fft_data_[2 * i];
-            const float im = fft_data_[2 * i + 1];
-            power_spectrum[i] = re*re + im*im;
-        }
-
-        const int mel_channel = mfcc_config_.mel_channel;
-        float* mel_spectrum = mel_data_.get();
-        ApplyMelFilter(power_spectrum, mel_position_.get(), mel_channel, mel_spectrum);
+            const int m = half_num - k;
+            int16_t zk[2], zm[2];
+            memcpy(zk, &data[k], sizeof(zk));
+            memcpy(zm, &data[m], sizeof(zm));
 
-        float* logmel_spectrum = mel_spectrum;
-        for (int i = 0; i < mel_channel; i++)
-        {
-            logmel_spectrum[i] = 10.0f * log10f(mel_spectrum[i]);
-        }
-        frame_count++;
+            const int32_t even_re = (zk[0] + zm[0]) >> 1;
+            const int32_t even_im = (zk[1] - zm[1]) >> 1;
+            const int32_t odd_re = (zk[0] - zm[0]) >> 1;
+            const int32_t odd_im = (zk[1] + zm[1]) >> 1;
+            const int32_t cos_val = twiddle[2 * k];
+            const int32_t sin_val = twiddle[2 * k + 1];
+            // i * W^k * odd (W^k = cos - i * sin)
+            const int32_t rotated_re = (sin_val * odd_re - cos_val * odd_im) >> 15;
+            const int32_t rotated_im = (cos_val * odd_re + sin_val * odd_im) >> 15;
 
-        const int coef_num = mfcc_config_.coef_num;
-        for (int i = 0; i < coef_num; i++)
-        {
-            const auto* dct = &dctII_table_[i * mel_channel];
-            float mfcc_val = 0;
-            for (int j = 0; j < mel_channel; j++)
+            const int32_t xk_re = even_re - rotated_re;
+            const int32_t xk_im = even_im - rotated_im;
+            data[k] = (uint32_t)(xk_re * xk_re) + (uint32_t)(xk_im * xk_im);
+            if (m != k)
             {
-                mfcc_val += logmel_spectrum[j] * dct[j] / kDctCoef;
+                // X[m] = conj(even + i * W^k * odd)
+                const int32_t xm_re = even_re + rotated_re;
+                const int32_t xm_im = even_im + rotated_im;
+                data[m] = (uint32_t)(xm_re * xm_re) + (uint32_t)(xm_im * xm_im);
             }
-            mfcc[i] = mfcc_val;
         }
     }
 
-    void MfccEngine::normalize(const float* src, int frame_num, int coef_num, int16_t* dest)
+    /**
+     * @brief パワースペクトルにMel-Filterを適用し、対数に変換する
+     * @param[in]   src         パワースペクトル
+     * @param[in]   begin       各チャンネルの開始位置
+     * @param[in]   length      各チャンネルの長さ
+     * @param[in]   weight      重み(Q15)
+     * @param[in]   channel_num メルチャンネル数
+     * @param[in]   log2_offset Mel-Filterの出力から実際のパワーへの換算値(log2, Q16)
+     * @param[out]  dest        対数メルスペクトル[dB](Q4, 0未満は0にクリップ)
+     */
+    void ApplyLogMelFilter(const uint32_t* src, const int16_t* begin, const int16_t* length, const uint16_t* weight,
+                           int channel_num, int32_t log2_offset, int32_t* dest)
     {
-        float sum_val = 0;
-        for (int i = 0; i < frame_num; i++)
+        for (int i = 0; i < channel_num; i++)
         {
-            for (int j = 0; j < coef_num; j++)
+            const uint32_t* spectrum = &src[begin[i]];
+            uint64_t mel_val = 0;
+            for (int j = 0; j < length[i]; j++)
             {
-                sum_val += src[i * coef_num + j];
+                mel_val += (uint64_t)weight[j] * spectrum[j];
             }
-        }
-        const float mean_val = sum_val / (frame_num * coef_num);
+            weight += length[i];
 
-        sum_val = 0;
-        for (int i = 0; i < frame_num; i++)
-        {
-            for (int j = 0; j < coef_num; j++)
-            {
-                const float value = src[i * coef_num + j] - mean_val;
-                sum_val += (value * value);
-            }
-        }
-        // 値がすべて等しい場合は０、０除算回避のため１とする
-        const float stddev = (fabsf(sum_val) < __FLT_EPSILON__)
-                            ? 1
-                            : sqrtf(sum_val / (frame_num * coef_num));
-        for (int i = 0; i < frame_num; i++)
-        {
-            for (int j = 0; j < coef_num; j++)
+            if (mel_val == 0)
             {
-                const float normalized_val = kNormalizeCoef * (src[i * coef_num + j] - mean_val) / stddev;
-                if (normalized_val < INT16_MIN)
-                {
-                    dest[i * coef_num + j] = INT16_MIN;
-                }
-                else if (INT16_MAX < normalized_val)
-                {
-                    dest[i * coef_num + j] = INT16_MAX;
-                }
-                else
-                {
-                    dest[i * coef_num + j] = normalized_val;
-                }
+                dest[i] = 0;
+                continue;
             }
+            const int64_t log2_val = Log2Fixed(mel_val) + log2_offset;
+            dest[i] = std::max<int32_t>(0, (log2_val * kDbPerLog2) >> (16 + 16 - 4));
         }
     }
 
-    bool MfccEngine::saveFile(const char *path, const MfccFeature &mfcc)
+    void StoreMfcc(float value, float* dest) { *dest = value; }
+    void StoreMfcc(float value, int16_t* dest)
     {
-        auto* file = fopen(path, "wb");
-        if (file == NULL) { return false; }
+        *dest = std::min<float>(INT16_MAX, std::max<float>(INT16_MIN, roundf(value * kFixedMfccCoef)));
+    }
+    void StoreFixedMfcc(int32_t value, float* dest) { *dest = (float)value / kFixedMfccCoef; }
+    void StoreFixedMfcc(int32_t value, int16_t* dest)
+    {
+        *dest = std::min<int32_t>(INT16_MAX, std::max<int32_t>(INT16_MIN, value));
+    }
 
-        const auto tag = static_cast<uint8_t>(MfccTag::VERSION1);
-        if (fwrite(&tag, sizeof(tag), 1, file) != 1)
+    /**
+     * @brief 複数のMfccEngineで共有するFFTテーブル(platform::initFftFc32()など)
+     * @details
+     * FFTのテーブルはプロセス全体で１つだが、最大サイズで初期化すればそれ以下のFFTにも使用できる。
+     * そのため最初に初期化するエンジンはkSharedFftNum(より大きい場合はそのfft_num)で初期化し、
+     * 以降はそのサイズ以下であれば参照カウントを増やして共有する(8kHzの後に16kHzのエンジンを初期化できる)。
+     */
+    constexpr int kSharedFftNum = 1024;     // 16kHzで64msのフレームまで
+    struct SharedFftTable
+    {
+        int fft_num;
+        int ref_count;
+    };
+    std::mutex fft_table_mutex;
+    SharedFftTable fc32_table = {0, 0};
+    SharedFftTable sc16_table = {0, 0};
+
+    bool AcquireFftTable(simplevox::MfccArithmetic arithmetic, int fft_num)
+    {
+        std::lock_guard<std::mutex> lock(fft_table_mutex);
+        const bool is_fixed = (arithmetic == simplevox::MfccArithmetic::FixedPoint);
+        auto& table = is_fixed ? sc16_table : fc32_table;
+        if (table.ref_count > 0)
         {
-            fclose(file); return false;
+            if (fft_num > table.fft_num)
+            {
+                printf("FFT table is too small (fft_num above %d must be initialized first)\n", table.fft_num);
+                return false;
+            }
+            table.ref_count++;
+            return true;
         }
 
-        const int32_t size = mfcc.size();
-        if (fwrite(&size, sizeof(size), 1, file) != 1)
+        if (is_fixed ? simplevox::platform::isFftSc16Initialized() : simplevox::platform::isFftFc32Initialized())
         {
-            fclose(file); return false;
+            printf("DSP is already initialized\n");
+            return false;
         }
-        const int32_t coef_num = mfcc.dimension();
-        if (fwrite(&coef_num, sizeof(coef_num), 1, file) != 1)
+        // テーブルを確保できない場合は自身のfft_numで初期化する
+        int table_fft_num = std::max(fft_num, kSharedFftNum);
+        bool result = is_fixed ? simplevox::platform::initFftSc16(table_fft_num / 2) : simplevox::platform::initFftFc32(table_fft_num);
+        if (!result && table_fft_num > fft_num)
         {
-            fclose(file); return false;
+            table_fft_num = fft_num;
+            result = is_fixed ? simplevox::platform::initFftSc16(fft_num / 2) : simplevox::platform::initFftFc32(fft_num);
         }
-
-        const auto data_byte = sizeof(*mfcc.feature_);
-        const int data_num = size * coef_num;
-        if (fwrite(mfcc.feature_, data_byte, data_num, file) != data_num)
+        if (!result)
         {
-            fclose(file); return false;
+            printf("DSP init error\n");
+            return false;
         }
-
-        fclose(file);
+        table.fft_num = table_fft_num;
+        table.ref_count = 1;
         return true;
     }
 
-    MfccFeature *MfccEngine::loadFile(const char *path)
+    void ReleaseFftTable(simplevox::MfccArithmetic arithmetic)
     {
-        auto* file = fopen(path, "rb");
-        if (file == NULL) { return nullptr; }
-
-        MfccTag tag;
-        if (fread(&tag, sizeof(tag), 1, file) != 1)
-        {
-            fclose(file); return nullptr;
-        }
+        std::lock_guard<std::mutex> lock(fft_table_mutex);
+        const bool is_fixed = (arithmetic == simplevox::MfccArithmetic::FixedPoint);
+        auto& table = is_fixed ? sc16_table : fc32_table;
+        if (table.ref_count <= 0 || --table.ref_count > 0) { return; }
 
-        int32_t size, coef_num;
-        if (fread(&size, sizeof(size), 1, file) != 1)
+        if (is_fixed)
         {
-            fclose(file); return nullptr;
+            simplevox::platform::deinitFftSc16();
         }
-        if (fread(&coef_num, sizeof(coef_num), 1, file) != 1)
+        else
         {
-            fclose(file); return nullptr;
+            simplevox::platform::deinitFftFc32();
         }
+        table.fft_num = 0;
+    }
 
-        MfccFeature* mfcc = new MfccFeature(size, coef_num);
-        if (mfcc == nullptr || mfcc->feature_ == nullptr)
-        {
-            fclose(file); return nullptr;
-        }
+    enum class MfccTag: uint8_t
+    {
+        VERSION1 = 1,
+        VERSION1_NORM = 2,  ///< VERSION1 + 各フレームのノルムの逆数(float * size)
+        ALIGNED1 = 3,       ///< VERSION1の各データを4byte境界に揃えたもの(タグの後に3byteの詰め物)
+        ALIGNED1_NORM = 4,  ///< VERSION1_NORMの各データを4byte境界に揃えたもの
+        LIBRARY2 = 5,       ///< 複数のテンプレートを持つライブラリ(MfccLibrary)
+        ALIGNED8 = 6,       ///< 8bitに量子化したMFCC(MfccFeatureInt8), 各データは4byte境界に揃える
+        ALIGNED8_NORM = 7,  ///< ALIGNED8 + 各フレームのノルムの逆数
+        ENVELOPE1 = 8,      ///< DtwEnvelope(各形式のMFCCの後に4byte境界に揃えて続く)
+    };
 
-        const auto data_byte = sizeof(*mfcc->feature_);
-        const int data_num = size * coef_num;
-        if (fread(mfcc->feature_, data_byte, data_num, file) != data_num)
-        {
-            delete mfcc;
-            fclose(file); return nullptr;
-        }
+    constexpr size_t kAlignedHeaderSize = 12;   ///< tag + 詰め物 + size + coef_num
+    constexpr size_t kAligned8HeaderSize = 16;  ///< tag + 詰め物 + size + coef_num + scale
 
-        fclose(file);
-        return mfcc;
+    /**
+     * @brief ALIGNED1形式において、特徴量の後のノルムの逆数の開始位置(バイト)
+     */
+    size_t AlignedNormOffset(int32_t size, int32_t coef_num)
+    {
+        const size_t feature_end = kAlignedHeaderSize + sizeof(int16_t) * size * coef_num;
+        return (feature_end + 3) & ~(size_t)3;
     }
 
-    MfccFeature *MfccEngine::create(const int16_t *raw_audio, int length)
+    /**
+     * @brief ALIGNED8形式において、特徴量の後のノルムの逆数の開始位置(バイト)
+     */
+    size_t Aligned8NormOffset(int32_t size, int32_t coef_num)
+    {
+        const size_t feature_end = kAligned8HeaderSize + sizeof(int8_t) * size * coef_num;
+        return (feature_end + 3) & ~(size_t)3;
+    }
+
+    // LIBRARY2形式
+    // ヘッダ: tag(1) + 詰め物(3) + 全体のバイト数(4) + CRC32(4) + テンプレート数(4) + coef_num(4)
+    // インデックス(テンプレートごと): 特徴量の位置(4) + ノルムの逆数の位置(4, なければ0) + フレーム数(4) + ラベル(20)
+    // 以降に各テンプレートの特徴量(4byte境界に揃える)とノルムの逆数が続く, 位置はいずれもイメージ先頭からのバイト数
+    // CRC32はヘッダ以降(インデックスから末尾まで)を対象とする
+    constexpr size_t kLibraryHeaderSize = 20;
+    constexpr size_t kIndexEntrySize = 12 + simplevox::MfccLibrary::kLabelSize;
+
+    uint32_t ReadU32(const uint8_t* bytes, size_t offset)
+    {
+        uint32_t value;
+        memcpy(&value, &bytes[offset], sizeof(value));
+        return value;
+    }
+
+    void WriteU32(uint8_t* bytes, size_t offset, uint32_t value)
+    {
+        memcpy(&bytes[offset], &value, sizeof(value));
+    }
+
+    size_t AlignUp4(size_t length)
+    {
+        return (length + 3) & ~(size_t)3;
+    }
+
+    /**
+     * @brief CRC32(IEEE 802.3)を更新する, 初回のcrcは0
+     * @note 読み込み時に１度だけ行うため、テーブルは4bit分(16要素)のみとする
+     */
+    uint32_t UpdateCrc32(uint32_t crc, const void* data, size_t length)
+    {
+        static constexpr uint32_t kTable[16] =
+        {
+            0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+            0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+        };
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        crc = ~crc;
+        for (size_t i = 0; i < length; i++)
+        {
+            crc = kTable[(crc ^ bytes[i]) & 0x0F] ^ (crc >> 4);
+            crc = kTable[(crc ^ (bytes[i] >> 4)) & 0x0F] ^ (crc >> 4);
+        }
+        return ~crc;
+    }
+
+    /**
+     * @brief 各形式のMFCCのイメージのバイト数(続く包絡線を含まない)
+     */
+    size_t FeatureImageLength(MfccTag tag, int32_t size, int32_t coef_num)
+    {
+        switch (tag)
+        {
+        case MfccTag::VERSION1:
+            return 1 + sizeof(int32_t) * 2 + sizeof(int16_t) * size * coef_num;
+        case MfccTag::VERSION1_NORM:
+            return 1 + sizeof(int32_t) * 2 + sizeof(int16_t) * size * coef_num + sizeof(float) * size;
+        case MfccTag::ALIGNED1:
+            return kAlignedHeaderSize + sizeof(int16_t) * size * coef_num;
+        case MfccTag::ALIGNED1_NORM:
+            return AlignedNormOffset(size, coef_num) + sizeof(float) * size;
+        case MfccTag::ALIGNED8:
+            return kAligned8HeaderSize + sizeof(int8_t) * size * coef_num;
+        case MfccTag::ALIGNED8_NORM:
+            return Aligned8NormOffset(size, coef_num) + sizeof(float) * size;
+        default:
+            return 0;
+        }
+    }
+
+    /**
+     * @brief MFCCのイメージ(image_lengthバイト)の後に包絡線を書き出す
+     */
+    bool WriteEnvelope(FILE* file, size_t image_length, const simplevox::DtwEnvelope& envelope)
+    {
+        const uint8_t padding[3] = {};
+        const size_t padding_length = AlignUp4(image_length) - image_length;
+        if (fwrite(padding, 1, padding_length, file) != padding_length)
+        {
+            return false;
+        }
+        std::unique_ptr<uint8_t[]> image(new (std::nothrow) uint8_t[envelope.imageSize()]);
+        if (!image)
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+        envelope.writeImage(image.get());
+        return fwrite(image.get(), 1, envelope.imageSize(), file) == envelope.imageSize();
+    }
+
+    /**
+     * @brief MFCCのイメージ(image_lengthバイト)の後に続く包絡線を読み出す
+     * @return 包絡線がない場合もtrue(envelopeは空), 読み出しに失敗した場合はfalse
+     */
+    bool ReadEnvelope(FILE* file, size_t image_length, simplevox::DtwEnvelope* envelope)
+    {
+        envelope->deinit();
+        uint8_t header[simplevox::DtwEnvelope::kHeaderSize];
+        if (fseek(file, AlignUp4(image_length), SEEK_SET) != 0
+            || fread(header, 1, sizeof(header), file) != sizeof(header)
+            || header[0] != static_cast<uint8_t>(MfccTag::ENVELOPE1))
+        {
+            return true;
+        }
+
+        int32_t frame_num, dimension;
+        memcpy(&frame_num, &header[4], sizeof(frame_num));
+        memcpy(&dimension, &header[8], sizeof(dimension));
+        if (frame_num <= 0 || dimension <= 0) { return false; }
+        const size_t length = sizeof(header) + 2 * (size_t)frame_num * dimension;
+        std::unique_ptr<uint8_t[]> image(new (std::nothrow) uint8_t[length]);
+        if (!image) { return false; }
+        memcpy(image.get(), header, sizeof(header));
+        if (fread(&image[sizeof(header)], 1, length - sizeof(header), file) != length - sizeof(header))
+        {
+            return false;
+        }
+        return envelope->parse(image.get(), length, true);
+    }
+
+    /**
+     * @brief MFCCのイメージ(image_lengthバイト)の後に続く包絡線を参照する(なければ空にする)
+     */
+    void ParseEnvelope(const uint8_t* bytes, size_t length, size_t image_length, simplevox::DtwEnvelope* envelope)
+    {
+        const size_t offset = AlignUp4(image_length);
+        if (offset >= length || bytes[offset] != static_cast<uint8_t>(MfccTag::ENVELOPE1)
+            || !envelope->parse(&bytes[offset], length - offset))
+        {
+            envelope->deinit();
+        }
+    }
+}
+
+
+namespace simplevox
+{
+namespace detail
+{
+    bool AcquireMfccFftTable(MfccArithmetic arithmetic, int fft_num)
+    {
+        return AcquireFftTable(arithmetic, fft_num);
+    }
+
+    void ReleaseMfccFftTable(MfccArithmetic arithmetic)
+    {
+        ReleaseFftTable(arithmetic);
+    }
+
+    float FastLog2(float value)
+    {
+        return ::FastLog2(value);
+    }
+} // namespace detail
+
+    MfccFeature::MfccFeature(int frame_num, int coef_num): frame_num_(frame_num), coef_num_(coef_num)
+    {
+        feature_ = (int16_t*)platform::allocate(sizeof(*feature_) * frame_num_ * coef_num_, MALLOC_CAP_8BIT);
+    }
+
+    MfccFeature::~MfccFeature()
+    {
+        if (feature_ != NULL)
+        {
+            platform::deallocate(feature_);
+            feature_ = NULL;
+        }
+        if (inverse_norm_ != NULL)
+        {
+            platform::deallocate(inverse_norm_);
+            inverse_norm_ = NULL;
+        }
+    }
+
+    bool MfccFeature::cacheInverseNorm()
+    {
+        if (inverse_norm_ == NULL)
+        {
+            inverse_norm_ = (float*)platform::allocate(sizeof(*inverse_norm_) * frame_num_, MALLOC_CAP_8BIT);
+            if (inverse_norm_ == NULL) { return false; }
+        }
+        for (int i = 0; i < frame_num_; i++)
+        {
+            inverse_norm_[i] = calcInverseNorm(feature(i), coef_num_);
+        }
+        return true;
+    }
+
+    MfccFeatureInt8::MfccFeatureInt8(int frame_num, int coef_num): frame_num_(frame_num), coef_num_(coef_num)
+    {
+        feature_ = (int8_t*)platform::allocate(sizeof(*feature_) * frame_num_ * coef_num_, MALLOC_CAP_8BIT);
+    }
+
+    MfccFeatureInt8::~MfccFeatureInt8()
+    {
+        if (feature_ != NULL)
+        {
+            platform::deallocate(feature_);
+            feature_ = NULL;
+        }
+        if (inverse_norm_ != NULL)
+        {
+            platform::deallocate(inverse_norm_);
+            inverse_norm_ = NULL;
+        }
+    }
+
+    bool MfccFeatureInt8::cacheInverseNorm()
+    {
+        if (inverse_norm_ == NULL)
+        {
+            inverse_norm_ = (float*)platform::allocate(sizeof(*inverse_norm_) * frame_num_, MALLOC_CAP_8BIT);
+            if (inverse_norm_ == NULL) { return false; }
+        }
+        for (int i = 0; i < frame_num_; i++)
+        {
+            inverse_norm_[i] = calcInverseNorm(feature(i), coef_num_);
+        }
+        return true;
+    }
+
+    size_t MfccArena::requiredSize(int max_frame_num, int coef_num, bool has_work)
+    {
+        const size_t feature_size = AlignUp4(sizeof(*feature_) * max_frame_num * coef_num);
+        const size_t norm_size = sizeof(*inverse_norm_) * max_frame_num;
+        const size_t work_size = has_work ? sizeof(*work_) * max_frame_num * coef_num : 0;
+        return feature_size + norm_size + work_size;
+    }
+
+    bool MfccArena::init(int max_frame_num, int coef_num, uint32_t caps, bool has_work)
+    {
+        if (buffer_ != nullptr || max_frame_num <= 0 || coef_num <= 0)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+        const size_t size = requiredSize(max_frame_num, coef_num, has_work);
+        auto* buffer = platform::allocate(size, caps);
+        if (buffer == nullptr)
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+        if (!init(buffer, size, max_frame_num, coef_num, has_work))
+        {
+            platform::deallocate(buffer);
+            return false;
+        }
+        is_owner_ = true;
+        return true;
+    }
+
+    bool MfccArena::init(void* buffer, size_t size, int max_frame_num, int coef_num, bool has_work)
+    {
+        if (buffer_ != nullptr || buffer == nullptr || ((uintptr_t)buffer & 3) != 0
+            || max_frame_num <= 0 || coef_num <= 0 || size < requiredSize(max_frame_num, coef_num, has_work))
+        {
+            printf("Argument error\n");
+            return false;
+        }
+        buffer_ = static_cast<uint8_t*>(buffer);
+        is_owner_ = false;
+        feature_ = reinterpret_cast<int16_t*>(buffer_);
+        inverse_norm_ = reinterpret_cast<float*>(&buffer_[AlignUp4(sizeof(*feature_) * max_frame_num * coef_num)]);
+        work_ = has_work ? &inverse_norm_[max_frame_num] : nullptr;
+        max_frame_num_ = max_frame_num;
+        coef_num_ = coef_num;
+        return true;
+    }
+
+    void MfccArena::deinit()
+    {
+        if (buffer_ == nullptr) { return; }
+        if (is_owner_)
+        {
+            platform::deallocate(buffer_);
+        }
+        buffer_ = nullptr;
+        is_owner_ = false;
+        feature_ = nullptr;
+        inverse_norm_ = nullptr;
+        work_ = nullptr;
+        max_frame_num_ = 0;
+        coef_num_ = 0;
+    }
+
+    void MfccEngine::release()
+    {
+        fft_data_fixed_.reset();
+        mel_data_fixed_.reset();
+        twiddle_.reset();
+        mel_weight_fixed_.reset();
+        fft_data_.reset();
+        mel_data_.reset();
+        dctII_table_.reset();
+        mel_weight_.reset();
+        mel_length_.reset();
+        mel_begin_.reset();
+        window_.reset();
+    }
+
+    bool MfccEngine::init(const MfccConfig &config)
+    {
+        if (!VerifyMfccConfig(config))
+        {
+            printf("Argument error\n");
+            return false;
+        }
+
+        window_.reset(new (std::nothrow) int16_t[config.frame_length()]);
+        if (!SetupHammingWindow(window_.get(), config.frame_length()))
+        {
+            printf("Setup window error\n");
+            release();
+            return false;
+        }
+
+        std::unique_ptr<int16_t[]> mel_position(new (std::nothrow) int16_t[config.mel_channel + 2]);
+        if (!SetupMelFilter(mel_position.get(), config.sample_rate, config.fft_num, config.mel_channel))
+        {
+            printf("Setup MelFilter error\n");
+            release();
+            return false;
+        }
+        mel_begin_.reset(new (std::nothrow) int16_t[config.mel_channel]);
+        mel_length_.reset(new (std::nothrow) int16_t[config.mel_channel]);
+        mel_weight_.reset(new (std::nothrow) float[MelWeightNum(mel_position.get(), config.mel_channel)]);
+        if (!SetupMelWeight(mel_position.get(), config.mel_channel, config.mel_normalize,
+                            (float)config.sample_rate / config.fft_num,
+                            mel_begin_.get(), mel_length_.get(), mel_weight_.get()))
+        {
+            printf("Setup MelFilter error\n");
+            release();
+            return false;
+        }
+
+        dctII_table_.reset(new (std::nothrow) int16_t[config.coef_num * config.mel_channel]);
+        if (!SetupDctTable(dctII_table_.get(), config.coef_num, config.mel_channel))
+        {
+            printf("Setup DctTable error\n");
+            release();
+            return false;
+        }
+
+        if (config.arithmetic == MfccArithmetic::FixedPoint)
+        {
+            if (!initFixed(config, mel_position.get()))
+            {
+                release();
+                return false;
+            }
+            mfcc_config_ = config;
+            return true;
+        }
+
+        mel_data_.reset(new (std::nothrow) float[config.mel_channel]);
+        if (!mel_data_)
+        {
+            printf("Failed to create heap\n");
+            release();
+            return false;
+        }
+     
+        fft_data_.reset(new (std::nothrow) float[config.fft_num]);
+        if (!fft_data_)
+        {
+            printf("Failed to create heap\n");
+            release();
+            return false;
+        }
+
+        if (!AcquireFftTable(config.arithmetic, config.fft_num))
+        {
+            release();
+            return false;
+        }
+
+        mfcc_config_ = config;
+        return true;
+    }
+
+    bool MfccEngine::initFixed(const MfccConfig& config, const int16_t* mel_position)
+    {
+        // 重みは最大値で正規化してQ15とし、最大値はlog2_offset_に含める(Slaney形式の小さな重みの精度を保つため)
+        const int weight_num = MelWeightNum(mel_position, config.mel_channel);
+        const float max_weight = *std::max_element(mel_weight_.get(), mel_weight_.get() + weight_num);
+        mel_weight_fixed_.reset(new (std::nothrow) uint16_t[weight_num]);
+        if (!mel_weight_fixed_)
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+        for (int i = 0; i < weight_num; i++)
+        {
+            mel_weight_fixed_[i] = lroundf(32768 * mel_weight_[i] / max_weight);
+        }
+        mel_weight_.reset();
+
+        // 実際のパワー = Mel-Filterの出力 * max_weight / 2^15 * (fft_num / 2)^2 / kWindowCoef^2 * 4^shift
+        log2_offset_ = lroundf(65536 * (log2f(max_weight) - 15 + 2 * log2f(config.fft_num / 2))) - kLog2WindowCoef;
+
+        twiddle_.reset(new (std::nothrow) int16_t[2 * (config.fft_num / 4 + 1)]);
+        if (!SetupTwiddle(twiddle_.get(), config.fft_num))
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+
+        mel_data_fixed_.reset(new (std::nothrow) int32_t[config.mel_channel]);
+        fft_data_fixed_.reset(new (std::nothrow) uint32_t[config.fft_num / 2]);
+        if (!mel_data_fixed_ || !fft_data_fixed_)
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+
+        return AcquireFftTable(config.arithmetic, config.fft_num);
+    }
+
+    void MfccEngine::deinit()
+    {
+        if (dctII_table_ == nullptr) { return; }
+        ReleaseFftTable(mfcc_config_.arithmetic);
+        release();
+    }
+
+    void MfccEngine::calculate(const int16_t* frame, float* mfcc)
+    {
+        calculate(frame, mfcc_config_.frame_length(), nullptr, 0, mfcc);
+    }
+
+    void MfccEngine::calculate(const int16_t* frame, int16_t* mfcc)
+    {
+        if (mfcc_config_.arithmetic == MfccArithmetic::FixedPoint)
+        {
+            calculateFixed(frame, mfcc_config_.frame_length(), nullptr, 0, mfcc);
+        }
+        else
+        {
+            calculateFloat(frame, mfcc_config_.frame_length(), nullptr, 0, mfcc);
+        }
+    }
+
+    void MfccEngine::calculate(const int16_t* head, int head_length, const int16_t* tail, int prev_val, float* mfcc)
+    {
+        if (mfcc_config_.arithmetic == MfccArithmetic::FixedPoint)
+        {
+            calculateFixed(head, head_length, tail, prev_val, mfcc);
+        }
+        else
+        {
+            calculateFloat(head, head_length, tail, prev_val, mfcc);
+        }
+    }
+
+    template <typename T>
+    void MfccEngine::calculateFloat(const int16_t* head, int head_length, const int16_t* tail, int prev_val, T* mfcc)
+    {
+        SIMPLEVOX_STATS_BEGIN();
+        const int frame_length = mfcc_config_.frame_length();
+        const int fft_num = mfcc_config_.fft_num;
+        {
+            const int pre_emphasis = mfcc_config_.pre_emphasis;
+            const int tail_length = frame_length - head_length;
+            prev_val = ApplyPreEmphasis(head, head_length, window_.get(), pre_emphasis, prev_val, fft_data_.get());
+            ApplyPreEmphasis(tail, tail_length, &window_[head_length], pre_emphasis, prev_val, &fft_data_[head_length]);
+            for (int i = frame_length; i < fft_num; i++)
+            {
+                fft_data_[i] = 0;
+            }
+        }
+        SIMPLEVOX_STATS_LAP(stats_.window_cycles);
+
+        platform::calcRealFftFc32(fft_data_.get(), fft_num);
+        SIMPLEVOX_STATS_LAP(stats_.fft_cycles);
+
+        float* power_spectrum = fft_data_.get();
+        for (int i = 0; i < fft_num / 2; i++)
+        {
+            const float re = fft_data_[2 * i];
+            const float im = fft_data_[2 * i + 1];
+            power_spectrum[i] = re*re + im*im;
+        }
+        SIMPLEVOX_STATS_LAP(stats_.power_cycles);
+
+        const int mel_channel = mfcc_config_.mel_channel;
+        float* mel_spectrum = mel_data_.get();
+        ApplyMelFilter(power_spectrum, mel_begin_.get(), mel_length_.get(), mel_weight_.get(), mel_channel, mel_spectrum);
+        SIMPLEVOX_STATS_LAP(stats_.mel_cycles);
+
+        // 無音のフレームで-infとならないように下限を設ける(固定小数点版と同じく0dB)
+        float* logmel_spectrum = mel_spectrum;
+        if (mfcc_config_.fast_log)
+        {
+            for (int i = 0; i < mel_channel; i++)
+            {
+                logmel_spectrum[i] = kDbPerLog2f * FastLog2(std::max(mel_spectrum[i], kMelFloor));
+            }
+        }
+        else
+        {
+            for (int i = 0; i < mel_channel; i++)
+            {
+                logmel_spectrum[i] = 10.0f * log10f(std::max(mel_spectrum[i], kMelFloor));
+            }
+        }
+        SIMPLEVOX_STATS_LAP(stats_.log_cycles);
+
+        const int coef_num = mfcc_config_.coef_num;
+        for (int i = 0; i < coef_num; i++)
+        {
+            const auto* dct = &dctII_table_[i * mel_channel];
+            float mfcc_val = 0;
+            for (int j = 0; j < mel_channel; j++)
+            {
+                mfcc_val += logmel_spectrum[j] * dct[j] / kDctCoef;
+            }
+            StoreMfcc(mfcc_val, &mfcc[i]);
+        }
+        SIMPLEVOX_STATS_LAP(stats_.dct_cycles);
+        SIMPLEVOX_STATS_ADD(stats_.frame_count, 1);
+    }
+
+    template <typename T>
+    void MfccEngine::calculateFixed(const int16_t* head, int head_length, const int16_t* tail, int prev_val, T* mfcc)
+    {
+        SIMPLEVOX_STATS_BEGIN();
+        const int frame_length = mfcc_config_.frame_length();
+        const int fft_num = mfcc_config_.fft_num;
+        auto* fft_data = reinterpret_cast<int16_t*>(fft_data_fixed_.get());
+        int shift;
+        {
+            // ブロック浮動小数点: フレーム内の最大振幅がkFixedInputBitsに収まるように共通のシフト量を決める
+            const int pre_emphasis = mfcc_config_.pre_emphasis;
+            const int tail_length = frame_length - head_length;
+            uint32_t max_abs = 0;
+            const int tail_prev_val = MaxPreEmphasis(head, head_length, window_.get(), pre_emphasis, prev_val, &max_abs);
+            MaxPreEmphasis(tail, tail_length, &window_[head_length], pre_emphasis, tail_prev_val, &max_abs);
+            shift = BitLength(max_abs) - kFixedInputBits;
+
+            ApplyPreEmphasis(head, head_length, window_.get(), pre_emphasis, prev_val, shift, fft_data);
+            ApplyPreEmphasis(tail, tail_length, &window_[head_length], pre_emphasis, tail_prev_val, shift, &fft_data[head_length]);
+            for (int i = frame_length; i < fft_num; i++)
+            {
+                fft_data[i] = 0;
+            }
+        }
+        SIMPLEVOX_STATS_LAP(stats_.window_cycles);
+
+        // 実数信号をfft_num / 2点の複素信号とみなす(sc16のFFTは各段で1/2にスケーリングされる)
+        platform::calcFftSc16(fft_data, fft_num / 2);
+        SIMPLEVOX_STATS_LAP(stats_.fft_cycles);
+
+        uint32_t* power_spectrum = fft_data_fixed_.get();
+        RealPowerSpectrum(power_spectrum, twiddle_.get(), fft_num / 2);
+        SIMPLEVOX_STATS_LAP(stats_.power_cycles);
+
+        const int mel_channel = mfcc_config_.mel_channel;
+        int32_t* logmel_spectrum = mel_data_fixed_.get();
+        ApplyLogMelFilter(power_spectrum, mel_begin_.get(), mel_length_.get(), mel_weight_fixed_.get(), mel_channel,
+                          log2_offset_ + 2 * shift * (1 << 16), logmel_spectrum);
+        SIMPLEVOX_STATS_LAP(stats_.mel_cycles);
+
+        const int coef_num = mfcc_config_.coef_num;
+        for (int i = 0; i < coef_num; i++)
+        {
+            const auto* dct = &dctII_table_[i * mel_channel];
+            // Q4の対数メルスペクトル * kDctCoefの総和はmel_channelが多く大きな入力の場合にint32_tを超え得るため64bitで加算する
+            int64_t mfcc_val = 0;
+            for (int j = 0; j < mel_channel; j++)
+            {
+                mfcc_val += logmel_spectrum[j] * dct[j];
+            }
+            StoreFixedMfcc((int32_t)(mfcc_val / kDctCoef), &mfcc[i]);
+        }
+        SIMPLEVOX_STATS_LAP(stats_.dct_cycles);
+        SIMPLEVOX_STATS_ADD(stats_.frame_count, 1);
+    }
+
+    bool MfccNormalizer::init(int coef_num, bool per_coef)
+    {
+        if (coef_num <= 0 || (per_coef && coef_num > kMaxCoefNum))
+        {
+            printf("Argument error\n");
+            return false;
+        }
+        coef_num_ = coef_num;
+        stat_num_ = per_coef ? coef_num : 1;
+        reset();
+        return true;
+    }
+
+    void MfccNormalizer::reset()
+    {
+        std::fill_n(mean_, stat_num_, 0.0f);
+        std::fill_n(m2_, stat_num_, 0.0f);
+        frame_count_ = 0;
+    }
+
+    void MfccNormalizer::push(const float* mfcc)
+    {
+        frame_count_++;
+        if (stat_num_ == 1)
+        {
+            // フレーム内の平均と偏差平方和を求めてから、それまでの統計量と結合する(Chanの方法)
+            float frame_sum = 0;
+            for (int j = 0; j < coef_num_; j++)
+            {
+                frame_sum += mfcc[j];
+            }
+            const float frame_mean = frame_sum / coef_num_;
+            float frame_m2 = 0;
+            for (int j = 0; j < coef_num_; j++)
+            {
+                const float value = mfcc[j] - frame_mean;
+                frame_m2 += value * value;
+            }
+            const float delta = frame_mean - mean_[0];
+            const float prev_num = (float)(frame_count_ - 1) * coef_num_;
+            const float total_num = (float)frame_count_ * coef_num_;
+            mean_[0] += delta * coef_num_ / total_num;
+            m2_[0] += frame_m2 + delta * delta * prev_num * coef_num_ / total_num;
+        }
+        else
+        {
+            const float inverse_count = 1.0f / frame_count_;
+            for (int j = 0; j < coef_num_; j++)
+            {
+                const float delta = mfcc[j] - mean_[j];
+                mean_[j] += delta * inverse_count;
+                m2_[j] += delta * (mfcc[j] - mean_[j]);
+            }
+        }
+    }
+
+    void MfccNormalizer::apply(const float* mfccs, int frame_num, int16_t* dest) const
+    {
+        if (frame_count_ <= 0) { return; }
+
+        // 値がすべて等しい場合は０、０除算回避のため標準偏差を１とする
+        float scales[kMaxCoefNum];
+        const int value_num = (stat_num_ == 1) ? frame_count_ * coef_num_ : frame_count_;
+        for (int k = 0; k < stat_num_; k++)
+        {
+            const float stddev = (fabsf(m2_[k]) < __FLT_EPSILON__) ? 1 : sqrtf(m2_[k] / value_num);
+            scales[k] = kNormalizeCoef / stddev;
+        }
+
+        for (int i = 0; i < frame_num; i++)
+        {
+            for (int j = 0; j < coef_num_; j++)
+            {
+                const int k = (stat_num_ == 1) ? 0 : j;
+                const float normalized_val = (mfccs[i * coef_num_ + j] - mean_[k]) * scales[k];
+                if (normalized_val < INT16_MIN)
+                {
+                    dest[i * coef_num_ + j] = INT16_MIN;
+                }
+                else if (INT16_MAX < normalized_val)
+                {
+                    dest[i * coef_num_ + j] = INT16_MAX;
+                }
+                else
+                {
+                    dest[i * coef_num_ + j] = normalized_val;
+                }
+            }
+        }
+    }
+
+    bool MfccEngine::initNormalizer(int coef_num, MfccNormalizer& normalizer) const
+    {
+        return normalizer.init(coef_num, mfcc_config_.per_coef_normalize);
+    }
+
+    void MfccEngine::normalize(const float* src, int frame_num, int coef_num, int16_t* dest)
+    {
+        MfccNormalizer normalizer;
+        if (!initNormalizer(coef_num, normalizer)) { return; }
+        for (int i = 0; i < frame_num; i++)
+        {
+            normalizer.push(&src[i * coef_num]);
+        }
+        normalizer.apply(src, frame_num, dest);
+    }
+
+    bool MfccFeatureView::parse(const void* data, size_t length, DtwEnvelope* envelope)
+    {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        if (bytes == nullptr || length < kAlignedHeaderSize) { return false; }
+        if (((uintptr_t)bytes & 3) != 0)
+        {
+            printf("Misaligned data\n");
+            return false;
+        }
+
+        const auto tag = static_cast<MfccTag>(bytes[0]);
+        if (tag != MfccTag::ALIGNED1 && tag != MfccTag::ALIGNED1_NORM)
+        {
+            printf("Unsupported format(%d)\n", (int)bytes[0]);
+            return false;
+        }
+
+        int32_t size, coef_num;
+        memcpy(&size, &bytes[4], sizeof(size));
+        memcpy(&coef_num, &bytes[8], sizeof(coef_num));
+        if (size <= 0 || coef_num <= 0) { return false; }
+
+        const size_t norm_offset = AlignedNormOffset(size, coef_num);
+        const size_t total_length = (tag == MfccTag::ALIGNED1_NORM)
+                                    ? norm_offset + sizeof(float) * size
+                                    : kAlignedHeaderSize + sizeof(int16_t) * size * coef_num;
+        if (total_length > length) { return false; }
+
+        feature_ = reinterpret_cast<const int16_t*>(&bytes[kAlignedHeaderSize]);
+        inverse_norm_ = (tag == MfccTag::ALIGNED1_NORM) ? reinterpret_cast<const float*>(&bytes[norm_offset]) : nullptr;
+        frame_num_ = size;
+        coef_num_ = coef_num;
+        if (envelope != nullptr)
+        {
+            ParseEnvelope(bytes, length, total_length, envelope);
+        }
+        return true;
+    }
+
+    bool MfccFeatureInt8View::parse(const void* data, size_t length, DtwEnvelope* envelope)
+    {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        if (bytes == nullptr || length < kAligned8HeaderSize) { return false; }
+        if (((uintptr_t)bytes & 3) != 0)
+        {
+            printf("Misaligned data\n");
+            return false;
+        }
+
+        const auto tag = static_cast<MfccTag>(bytes[0]);
+        if (tag != MfccTag::ALIGNED8 && tag != MfccTag::ALIGNED8_NORM)
+        {
+            printf("Unsupported format(%d)\n", (int)bytes[0]);
+            return false;
+        }
+
+        int32_t size, coef_num;
+        float scale;
+        memcpy(&size, &bytes[4], sizeof(size));
+        memcpy(&coef_num, &bytes[8], sizeof(coef_num));
+        memcpy(&scale, &bytes[12], sizeof(scale));
+        if (size <= 0 || coef_num <= 0) { return false; }
+
+        const size_t norm_offset = Aligned8NormOffset(size, coef_num);
+        const size_t total_length = (tag == MfccTag::ALIGNED8_NORM)
+                                    ? norm_offset + sizeof(float) * size
+                                    : kAligned8HeaderSize + sizeof(int8_t) * size * coef_num;
+        if (total_length > length) { return false; }
+
+        feature_ = reinterpret_cast<const int8_t*>(&bytes[kAligned8HeaderSize]);
+        inverse_norm_ = (tag == MfccTag::ALIGNED8_NORM) ? reinterpret_cast<const float*>(&bytes[norm_offset]) : nullptr;
+        frame_num_ = size;
+        coef_num_ = coef_num;
+        scale_ = scale;
+        if (envelope != nullptr)
+        {
+            ParseEnvelope(bytes, length, total_length, envelope);
+        }
+        return true;
+    }
+
+    bool MfccLibrary::parse(const void* data, size_t length, bool verify)
+    {
+        clear();
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        if (bytes == nullptr || length < kLibraryHeaderSize) { return false; }
+        if (((uintptr_t)bytes & 3) != 0)
+        {
+            printf("Misaligned data\n");
+            return false;
+        }
+        if (static_cast<MfccTag>(bytes[0]) != MfccTag::LIBRARY2)
+        {
+            printf("Unsupported format(%d)\n", (int)bytes[0]);
+            return false;
+        }
+
+        const uint32_t total_length = ReadU32(bytes, 4);
+        const int32_t num = ReadU32(bytes, 12);
+        const int32_t coef_num = ReadU32(bytes, 16);
+        if (total_length > length || num <= 0 || coef_num <= 0
+            || (total_length - kLibraryHeaderSize) / kIndexEntrySize < (uint32_t)num)
+        {
+            printf("Broken library\n");
+            return false;
+        }
+        if (verify && UpdateCrc32(0, &bytes[kLibraryHeaderSize], total_length - kLibraryHeaderSize) != ReadU32(bytes, 8))
+        {
+            printf("CRC mismatch\n");
+            return false;
+        }
+
+        views_.reset(new (std::nothrow) MfccFeatureView[num]);
+        template_ptrs_.reset(new (std::nothrow) const MfccFeatureView*[num]);
+        labels_.reset(new (std::nothrow) const char*[num]);
+        if (!views_ || !template_ptrs_ || !labels_)
+        {
+            printf("Failed to create heap\n");
+            clear();
+            return false;
+        }
+
+        for (int k = 0; k < num; k++)
+        {
+            const uint8_t* entry = &bytes[kLibraryHeaderSize + kIndexEntrySize * k];
+            const uint32_t feature_offset = ReadU32(entry, 0);
+            const uint32_t norm_offset = ReadU32(entry, 4);
+            const int32_t frame_num = ReadU32(entry, 8);
+            const char* label = reinterpret_cast<const char*>(&entry[12]);
+            if (frame_num <= 0 || (feature_offset & 3) != 0 || (norm_offset & 3) != 0
+                || feature_offset > total_length
+                || (total_length - feature_offset) / sizeof(int16_t) / coef_num < (uint32_t)frame_num
+                || norm_offset > total_length
+                || (norm_offset != 0 && (total_length - norm_offset) / sizeof(float) < (uint32_t)frame_num)
+                || label[kLabelSize - 1] != '\0')
+            {
+                printf("Broken library\n");
+                clear();
+                return false;
+            }
+            views_[k] = MfccFeatureView(reinterpret_cast<const int16_t*>(&bytes[feature_offset]), frame_num, coef_num,
+                                        (norm_offset != 0) ? reinterpret_cast<const float*>(&bytes[norm_offset]) : nullptr);
+            template_ptrs_[k] = &views_[k];
+            labels_[k] = label;
+        }
+        template_num_ = num;
+        coef_num_ = coef_num;
+        return true;
+    }
+
+    void MfccLibrary::clear()
+    {
+        views_.reset();
+        template_ptrs_.reset();
+        labels_.reset();
+        if (buffer_ != nullptr)
+        {
+            platform::deallocate(buffer_);
+            buffer_ = nullptr;
+        }
+        template_num_ = 0;
+        coef_num_ = 0;
+    }
+
+    int MfccLibrary::find(const char* label) const
+    {
+        for (int k = 0; k < template_num_; k++)
+        {
+            if (strncmp(labels_[k], label, kLabelSize) == 0) { return k; }
+        }
+        return -1;
+    }
+
+    bool MfccEngine::saveFile(const char *path, const MfccFeature &mfcc, bool aligned, const DtwEnvelope* envelope)
+    {
+        auto* file = fopen(path, "wb");
+        if (file == NULL) { return false; }
+
+        const bool has_norm = (mfcc.inverse_norm_ != nullptr);
+        const auto tag = static_cast<uint8_t>(aligned
+                            ? (has_norm ? MfccTag::ALIGNED1_NORM : MfccTag::ALIGNED1)
+                            : (has_norm ? MfccTag::VERSION1_NORM : MfccTag::VERSION1));
+        if (fwrite(&tag, sizeof(tag), 1, file) != 1)
+        {
+            fclose(file); return false;
+        }
+        const uint8_t padding[3] = {};
+        if (aligned && fwrite(padding, 1, sizeof(padding), file) != sizeof(padding))
+        {
+            fclose(file); return false;
+        }
+
+        const int32_t size = mfcc.size();
+        if (fwrite(&size, sizeof(size), 1, file) != 1)
+        {
+            fclose(file); return false;
+        }
+        const int32_t coef_num = mfcc.dimension();
+        if (fwrite(&coef_num, sizeof(coef_num), 1, file) != 1)
+        {
+            fclose(file); return false;
+        }
+
+        const auto data_byte = sizeof(*mfcc.feature_);
+        const int data_num = size * coef_num;
+        if (fwrite(mfcc.feature_, data_byte, data_num, file) != (size_t)data_num)
+        {
+            fclose(file); return false;
+        }
+
+        if (aligned && has_norm)
+        {
+            const size_t padding_length = AlignedNormOffset(size, coef_num) - (kAlignedHeaderSize + data_byte * data_num);
+            if (fwrite(padding, 1, padding_length, file) != padding_length)
+            {
+                fclose(file); return false;
+            }
+        }
+
+        if (has_norm && fwrite(mfcc.inverse_norm_, sizeof(*mfcc.inverse_norm_), size, file) != (size_t)size)
+        {
+            fclose(file); return false;
+        }
+
+        if (envelope != nullptr
+            && !WriteEnvelope(file, FeatureImageLength(static_cast<MfccTag>(tag), size, coef_num), *envelope))
+        {
+            fclose(file); return false;
+        }
+
+        fclose(file);
+        return true;
+    }
+
+    MfccFeature *MfccEngine::loadFile(const char *path, DtwEnvelope* envelope)
+    {
+        auto* file = fopen(path, "rb");
+        if (file == NULL) { return nullptr; }
+
+        MfccTag tag;
+        if (fread(&tag, sizeof(tag), 1, file) != 1
+            || (tag != MfccTag::VERSION1 && tag != MfccTag::VERSION1_NORM
+                && tag != MfccTag::ALIGNED1 && tag != MfccTag::ALIGNED1_NORM))
+        {
+            fclose(file); return nullptr;
+        }
+        const bool aligned = (tag == MfccTag::ALIGNED1 || tag == MfccTag::ALIGNED1_NORM);
+        const bool has_norm = (tag == MfccTag::VERSION1_NORM || tag == MfccTag::ALIGNED1_NORM);
+        if (aligned && fseek(file, kAlignedHeaderSize - sizeof(int32_t) * 2, SEEK_SET) != 0)
+        {
+            fclose(file); return nullptr;
+        }
+
+        int32_t size, coef_num;
+        if (fread(&size, sizeof(size), 1, file) != 1)
+        {
+            fclose(file); return nullptr;
+        }
+        if (fread(&coef_num, sizeof(coef_num), 1, file) != 1)
+        {
+            fclose(file); return nullptr;
+        }
+
+        MfccFeature* mfcc = new MfccFeature(size, coef_num);
+        if (mfcc == nullptr || mfcc->feature_ == nullptr)
+        {
+            fclose(file); return nullptr;
+        }
+
+        const auto data_byte = sizeof(*mfcc->feature_);
+        const int data_num = size * coef_num;
+        if (fread(mfcc->feature_, data_byte, data_num, file) != (size_t)data_num)
+        {
+            delete mfcc;
+            fclose(file); return nullptr;
+        }
+
+        if (aligned && has_norm && fseek(file, AlignedNormOffset(size, coef_num), SEEK_SET) != 0)
+        {
+            delete mfcc;
+            fclose(file); return nullptr;
+        }
+        if (has_norm)
+        {
+            mfcc->inverse_norm_ = (float*)platform::allocate(sizeof(*mfcc->inverse_norm_) * size, MALLOC_CAP_8BIT);
+            if (mfcc->inverse_norm_ == nullptr
+                || fread(mfcc->inverse_norm_, sizeof(*mfcc->inverse_norm_), size, file) != (size_t)size)
+            {
+                delete mfcc;
+                fclose(file); return nullptr;
+            }
+        }
+
+        if (envelope != nullptr && !ReadEnvelope(file, FeatureImageLength(tag, size, coef_num), envelope))
+        {
+            delete mfcc;
+            fclose(file); return nullptr;
+        }
+
+        fclose(file);
+        return mfcc;
+    }
+
+    MfccFeatureInt8* MfccEngine::quantize(const MfccFeatureView& mfcc)
+    {
+        const int frame_num = mfcc.size();
+        const int coef_num = mfcc.dimension();
+        if (frame_num <= 0 || coef_num <= 0) { return nullptr; }
+
+        auto* quantized = new (std::nothrow) MfccFeatureInt8(frame_num, coef_num);
+        if (quantized == nullptr || quantized->feature_ == nullptr)
+        {
+            printf("Failed to create heap\n");
+            delete quantized;
+            return nullptr;
+        }
+
+        // 絶対値の最大をINT8_MAXに合わせる(全て0の場合はスケール1)
+        const int16_t* src = mfcc.feature(0);
+        const int data_num = frame_num * coef_num;
+        int max_abs = 0;
+        for (int i = 0; i < data_num; i++)
+        {
+            max_abs = std::max(max_abs, abs((int)src[i]));
+        }
+        quantized->scale_ = (max_abs == 0) ? 1.0f : (float)INT8_MAX / max_abs;
+        for (int i = 0; i < data_num; i++)
+        {
+            const int value = (int)roundf(src[i] * quantized->scale_);
+            quantized->feature_[i] = std::min(INT8_MAX, std::max(-INT8_MAX, value));
+        }
+
+        if (mfcc.inverse_norms() != nullptr && !quantized->cacheInverseNorm())
+        {
+            printf("Failed to create heap\n");
+            delete quantized;
+            return nullptr;
+        }
+        return quantized;
+    }
+
+    bool MfccEngine::saveFile(const char *path, const MfccFeatureInt8 &mfcc, const DtwEnvelope* envelope)
+    {
+        auto* file = fopen(path, "wb");
+        if (file == NULL) { return false; }
+
+        const bool has_norm = (mfcc.inverse_norm_ != nullptr);
+        uint8_t header[kAligned8HeaderSize] = {};
+        header[0] = static_cast<uint8_t>(has_norm ? MfccTag::ALIGNED8_NORM : MfccTag::ALIGNED8);
+        const int32_t size = mfcc.size();
+        const int32_t coef_num = mfcc.dimension();
+        memcpy(&header[4], &size, sizeof(size));
+        memcpy(&header[8], &coef_num, sizeof(coef_num));
+        memcpy(&header[12], &mfcc.scale_, sizeof(mfcc.scale_));
+        if (fwrite(header, 1, sizeof(header), file) != sizeof(header))
+        {
+            fclose(file); return false;
+        }
+
+        const int data_num = size * coef_num;
+        if (fwrite(mfcc.feature_, sizeof(*mfcc.feature_), data_num, file) != (size_t)data_num)
+        {
+            fclose(file); return false;
+        }
+
+        if (has_norm)
+        {
+            const uint8_t padding[3] = {};
+            const size_t padding_length = Aligned8NormOffset(size, coef_num) - (kAligned8HeaderSize + data_num);
+            if (fwrite(padding, 1, padding_length, file) != padding_length
+                || fwrite(mfcc.inverse_norm_, sizeof(*mfcc.inverse_norm_), size, file) != (size_t)size)
+            {
+                fclose(file); return false;
+            }
+        }
+
+        if (envelope != nullptr
+            && !WriteEnvelope(file, FeatureImageLength(static_cast<MfccTag>(header[0]), size, coef_num), *envelope))
+        {
+            fclose(file); return false;
+        }
+
+        fclose(file);
+        return true;
+    }
+
+    MfccFeatureInt8 *MfccEngine::loadFileInt8(const char *path, DtwEnvelope* envelope)
+    {
+        auto* file = fopen(path, "rb");
+        if (file == NULL) { return nullptr; }
+
+        uint8_t header[kAligned8HeaderSize];
+        if (fread(header, 1, sizeof(header), file) != sizeof(header))
+        {
+            fclose(file); return nullptr;
+        }
+        const auto tag = static_cast<MfccTag>(header[0]);
+        if (tag != MfccTag::ALIGNED8 && tag != MfccTag::ALIGNED8_NORM)
+        {
+            fclose(file); return nullptr;
+        }
+        const bool has_norm = (tag == MfccTag::ALIGNED8_NORM);
+
+        int32_t size, coef_num;
+        float scale;
+        memcpy(&size, &header[4], sizeof(size));
+        memcpy(&coef_num, &header[8], sizeof(coef_num));
+        memcpy(&scale, &header[12], sizeof(scale));
+        if (size <= 0 || coef_num <= 0)
+        {
+            fclose(file); return nullptr;
+        }
+
+        auto* mfcc = new (std::nothrow) MfccFeatureInt8(size, coef_num);
+        if (mfcc == nullptr || mfcc->feature_ == nullptr)
+        {
+            delete mfcc;
+            fclose(file); return nullptr;
+        }
+        mfcc->scale_ = scale;
+
+        const int data_num = size * coef_num;
+        if (fread(mfcc->feature_, sizeof(*mfcc->feature_), data_num, file) != (size_t)data_num)
+        {
+            delete mfcc;
+            fclose(file); return nullptr;
+        }
+
+        if (has_norm)
+        {
+            mfcc->inverse_norm_ = (float*)platform::allocate(sizeof(*mfcc->inverse_norm_) * size, MALLOC_CAP_8BIT);
+            if (mfcc->inverse_norm_ == nullptr
+                || fseek(file, Aligned8NormOffset(size, coef_num), SEEK_SET) != 0
+                || fread(mfcc->inverse_norm_, sizeof(*mfcc->inverse_norm_), size, file) != (size_t)size)
+            {
+                delete mfcc;
+                fclose(file); return nullptr;
+            }
+        }
+
+        if (envelope != nullptr && !ReadEnvelope(file, FeatureImageLength(tag, size, coef_num), envelope))
+        {
+            delete mfcc;
+            fclose(file); return nullptr;
+        }
+
+        fclose(file);
+        return mfcc;
+    }
+
+    bool MfccEngine::saveLibrary(const char *path, const MfccFeature* const* mfccs, const char* const* labels, int num)
+    {
+        if (mfccs == nullptr || num <= 0) { return false; }
+        const int coef_num = mfccs[0]->dimension();
+        for (int k = 0; k < num; k++)
+        {
+            if (mfccs[k]->dimension() != coef_num || mfccs[k]->size() <= 0
+                || (labels != nullptr && labels[k] != nullptr && strlen(labels[k]) >= MfccLibrary::kLabelSize))
+            {
+                printf("Argument error\n");
+                return false;
+            }
+        }
+
+        // インデックスを作成し、各データの位置を決める
+        const size_t index_length = kIndexEntrySize * num;
+        std::unique_ptr<uint8_t[]> index(new (std::nothrow) uint8_t[index_length]());
+        if (!index)
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+        size_t offset = kLibraryHeaderSize + index_length;
+        for (int k = 0; k < num; k++)
+        {
+            uint8_t* entry = &index[kIndexEntrySize * k];
+            const auto& mfcc = *mfccs[k];
+            WriteU32(entry, 0, offset);
+            offset = AlignUp4(offset + sizeof(*mfcc.feature_) * mfcc.size() * coef_num);
+            WriteU32(entry, 4, (mfcc.inverse_norm_ != nullptr) ? offset : 0);
+            if (mfcc.inverse_norm_ != nullptr)
+            {
+                offset += sizeof(*mfcc.inverse_norm_) * mfcc.size();
+            }
+            WriteU32(entry, 8, mfcc.size());
+            if (labels != nullptr && labels[k] != nullptr)
+            {
+                strncpy(reinterpret_cast<char*>(&entry[12]), labels[k], MfccLibrary::kLabelSize - 1);
+            }
+        }
+        const size_t total_length = offset;
+
+        // インデックス以降を出力する(fileがnullptrの場合はCRCの算出のみ)
+        uint32_t crc = 0;
+        auto emit = [&crc](FILE* file, const void* data, size_t length)
+        {
+            crc = UpdateCrc32(crc, data, length);
+            return file == nullptr || fwrite(data, 1, length, file) == length;
+        };
+        auto emitBody = [&](FILE* file)
+        {
+            const uint8_t padding[3] = {};
+            if (!emit(file, index.get(), index_length)) { return false; }
+            for (int k = 0; k < num; k++)
+            {
+                const auto& mfcc = *mfccs[k];
+                const size_t feature_length = sizeof(*mfcc.feature_) * mfcc.size() * coef_num;
+                if (!emit(file, mfcc.feature_, feature_length)
+                    || !emit(file, padding, AlignUp4(feature_length) - feature_length))
+                {
+                    return false;
+                }
+                if (mfcc.inverse_norm_ != nullptr
+                    && !emit(file, mfcc.inverse_norm_, sizeof(*mfcc.inverse_norm_) * mfcc.size()))
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+        emitBody(nullptr);
+
+        uint8_t header[kLibraryHeaderSize] = {};
+        header[0] = static_cast<uint8_t>(MfccTag::LIBRARY2);
+        WriteU32(header, 4, total_length);
+        WriteU32(header, 8, crc);
+        WriteU32(header, 12, num);
+        WriteU32(header, 16, coef_num);
+
+        auto* file = fopen(path, "wb");
+        if (file == NULL) { return false; }
+        if (fwrite(header, 1, sizeof(header), file) != sizeof(header) || !emitBody(file))
+        {
+            fclose(file); return false;
+        }
+        fclose(file);
+        return true;
+    }
+
+    MfccLibrary* MfccEngine::loadLibrary(const char *path)
+    {
+        auto* file = fopen(path, "rb");
+        if (file == NULL) { return nullptr; }
+
+        uint8_t header[kLibraryHeaderSize];
+        if (fread(header, 1, sizeof(header), file) != sizeof(header)
+            || static_cast<MfccTag>(header[0]) != MfccTag::LIBRARY2)
+        {
+            fclose(file); return nullptr;
+        }
+
+        const uint32_t total_length = ReadU32(header, 4);
+        if (total_length < kLibraryHeaderSize)
+        {
+            fclose(file); return nullptr;
+        }
+        auto* library = new (std::nothrow) MfccLibrary();
+        auto* buffer = (uint8_t*)platform::allocate(total_length, MALLOC_CAP_8BIT);
+        if (library == nullptr || buffer == nullptr)
+        {
+            printf("Failed to create heap\n");
+            delete library;
+            platform::deallocate(buffer);
+            fclose(file); return nullptr;
+        }
+        memcpy(buffer, header, sizeof(header));
+        const size_t body_length = total_length - kLibraryHeaderSize;
+        const bool is_read = (fread(&buffer[kLibraryHeaderSize], 1, body_length, file) == body_length);
+        fclose(file);
+
+        if (!is_read || !library->parse(buffer, total_length))
+        {
+            delete library;
+            platform::deallocate(buffer);
+            return nullptr;
+        }
+        library->buffer_ = buffer;
+        return library;
+    }
+
+    void MfccEngine::calculateFrames(const int16_t* raw_audio, int frame_num, float* mfccs, MfccNormalizer& normalizer)
+    {
+        const int frame_length = mfcc_config_.frame_length();
+        const int hop_length = mfcc_config_.hop_length();
+        const int coef_num = mfcc_config_.coef_num;
+        for (int fnum = 0; fnum < frame_num; fnum++)
+        {
+            // プリエンファシスの状態はフレーム間で引き継ぐ(MfccStreamと同じ結果になる)
+            const auto* frame = &raw_audio[fnum * hop_length];
+            const int prev_val = (fnum > 0) ? frame[-1] : 0;
+            calculate(frame, frame_length, nullptr, prev_val, &mfccs[fnum * coef_num]);
+            normalizer.push(&mfccs[fnum * coef_num]);
+        }
+    }
+
+    int MfccEngine::frameNum(int length) const
     {
         const int frame_length = mfcc_config_.frame_length();
         const int hop_length = mfcc_config_.hop_length();
-        const int frame_num = (length - (frame_length - hop_length)) / hop_length;
+        return (length - (frame_length - hop_length)) / hop_length;
+    }
+
+    MfccFeature *MfccEngine::create(const int16_t *raw_audio, int length)
+    {
+        const int frame_num = frameNum(length);
         const int coef_num = mfcc_config_.coef_num;
         if (frame_num <= 0) { return nullptr; }
 
-        auto* mfcc = new MfccFeature(frame_num, coef_num);
-        std::unique_ptr<float[]> temp_feature(new float[frame_num * coef_num]);
-        if (mfcc->feature_ == NULL || !temp_feature)
+        auto* mfcc = new (std::nothrow) MfccFeature(frame_num, coef_num);
+        std::unique_ptr<float[]> temp_feature(new (std::nothrow) float[frame_num * coef_num]);
+        if (mfcc == nullptr || mfcc->feature_ == NULL || !temp_feature)
         {
             printf("Failed to create heap.\n");
             delete mfcc;
             return nullptr;
         }
 
-        for (int fnum = 0; fnum < frame_num; fnum++)
+        MfccNormalizer normalizer;
+        if (!initNormalizer(coef_num, normalizer))
         {
-            const auto* frame = &raw_audio[fnum * hop_length];
-            calculate(frame, &temp_feature[fnum * coef_num]);
+            delete mfcc;
+            return nullptr;
+        }
+        calculateFrames(raw_audio, frame_num, temp_feature.get(), normalizer);
+        normalizer.apply(temp_feature.get(), frame_num, mfcc->feature_);
+        if (mfcc_config_.cache_inverse_norm && !mfcc->cacheInverseNorm())
+        {
+            printf("Failed to create heap.\n");
+            delete mfcc;
+            return nullptr;
         }
-
-        normalize(temp_feature.get(), frame_num, coef_num, mfcc->feature_);
         return mfcc;
     }
 
     MfccFeature* MfccEngine::create(const float* mfccs, int frame_num, int coef_num)
     {
-        auto* mfcc = new MfccFeature(frame_num, coef_num);
-        if (mfcc->feature_ == NULL)
+        auto* mfcc = new (std::nothrow) MfccFeature(frame_num, coef_num);
+        if (mfcc == nullptr || mfcc->feature_ == NULL)
         {
             printf("Failed to create heap.\n");
             delete mfcc;
@@ -467,9 +1903,239 @@ namespace simplevox
         }
 
         normalize(mfccs, frame_num, coef_num, mfcc->feature_);
+        if (mfcc_config_.cache_inverse_norm && !mfcc->cacheInverseNorm())
+        {
+            printf("Failed to create heap.\n");
+            delete mfcc;
+            return nullptr;
+        }
+        return mfcc;
+    }
+
+    MfccFeature* MfccEngine::average(const MfccFeature* const* mfccs, int num, const DbaConfig& config,
+                                     uint32_t* threshold)
+    {
+        if (mfccs == nullptr || num <= 0 || config.iteration_num < 0 || config.threshold_margin < 0)
+        {
+            printf("Argument error\n");
+            return nullptr;
+        }
+        const int coef_num = mfccs[0]->dimension();
+        int max_frame_num = 0;
+        for (int k = 0; k < num; k++)
+        {
+            if (mfccs[k]->dimension() != coef_num || mfccs[k]->size() <= 0)
+            {
+                printf("Argument error\n");
+                return nullptr;
+            }
+            max_frame_num = std::max(max_frame_num, mfccs[k]->size());
+        }
+        DtwConfig dtw_config;
+        dtw_config.band_width = config.band_width;
+
+        // 他の登録音声との距離の合計が最小のものを初期値とする(比較できない組み合わせは距離の最大値とみなす)
+        int medoid = 0;
+        uint64_t medoid_sum = UINT64_MAX;
+        for (int k = 0; k < num; k++)
+        {
+            uint64_t sum = 0;
+            for (int m = 0; m < num; m++)
+            {
+                if (m == k) { continue; }
+                const uint32_t distance = calcDTW(*mfccs[k], *mfccs[m], dtw_config);
+                sum += (distance == UINT32_MAX) ? 2 * detail::kDistanceCoef : distance;
+            }
+            if (sum < medoid_sum)
+            {
+                medoid = k;
+                medoid_sum = sum;
+            }
+        }
+
+        const int frame_num = mfccs[medoid]->size();
+        auto* mfcc = new (std::nothrow) MfccFeature(frame_num, coef_num);
+        std::unique_ptr<float[]> sums(new (std::nothrow) float[frame_num * coef_num]);
+        std::unique_ptr<int[]> counts(new (std::nothrow) int[frame_num]);
+        std::unique_ptr<int16_t[]> path1(new (std::nothrow) int16_t[frame_num + max_frame_num]);
+        std::unique_ptr<int16_t[]> path2(new (std::nothrow) int16_t[frame_num + max_frame_num]);
+        if (mfcc == nullptr || mfcc->feature_ == NULL || !sums || !counts || !path1 || !path2)
+        {
+            printf("Failed to create heap.\n");
+            delete mfcc;
+            return nullptr;
+        }
+        memcpy(mfcc->feature_, mfccs[medoid]->feature(0), sizeof(*mfcc->feature_) * frame_num * coef_num);
+
+        for (int iteration = 0; iteration < config.iteration_num; iteration++)
+        {
+            std::fill(&sums[0], &sums[frame_num * coef_num], 0.0f);
+            std::fill(&counts[0], &counts[frame_num], 0);
+            for (int m = 0; m < num; m++)
+            {
+                const int length = calcDTWPath(*mfcc, *mfccs[m], dtw_config, path1.get(), path2.get());
+                for (int p = 0; p < length; p++)
+                {
+                    const int16_t* feature = mfccs[m]->feature(path2[p]);
+                    float* sum = &sums[path1[p] * coef_num];
+                    for (int j = 0; j < coef_num; j++)
+                    {
+                        sum[j] += feature[j];
+                    }
+                    counts[path1[p]]++;
+                }
+            }
+
+            // 対応する登録音声のフレームがない場合は前回の値のままとする
+            for (int i = 0; i < frame_num; i++)
+            {
+                if (counts[i] == 0) { continue; }
+                for (int j = 0; j < coef_num; j++)
+                {
+                    const float value = roundf(sums[i * coef_num + j] / counts[i]);
+                    mfcc->feature_[i * coef_num + j] = std::min<float>(INT16_MAX, std::max<float>(INT16_MIN, value));
+                }
+            }
+        }
+
+        if (mfcc_config_.cache_inverse_norm && !mfcc->cacheInverseNorm())
+        {
+            printf("Failed to create heap.\n");
+            delete mfcc;
+            return nullptr;
+        }
+
+        if (threshold != nullptr)
+        {
+            uint32_t max_distance = 0;
+            for (int m = 0; m < num; m++)
+            {
+                max_distance = std::max(max_distance, calcDTW(*mfcc, *mfccs[m], dtw_config));
+            }
+            *threshold = (max_distance == UINT32_MAX)
+                       ? UINT32_MAX
+                       : max_distance + max_distance * config.threshold_margin / 100;
+        }
         return mfcc;
     }
 
-    
+    bool MfccEngine::create(const int16_t* raw_audio, int length, MfccArena& arena, MfccFeatureView* dest)
+    {
+        const int frame_num = frameNum(length);
+        if (frame_num <= 0 || frame_num > arena.max_frame_num_ || arena.work_ == nullptr
+            || arena.coef_num_ != mfcc_config_.coef_num)
+        {
+            return false;
+        }
+        MfccNormalizer normalizer;
+        if (!initNormalizer(mfcc_config_.coef_num, normalizer)) { return false; }
+        calculateFrames(raw_audio, frame_num, arena.work_, normalizer);
+        return create(arena.work_, frame_num, normalizer, arena, dest);
+    }
+
+    bool MfccEngine::create(const float* mfccs, int frame_num, int coef_num, MfccArena& arena, MfccFeatureView* dest)
+    {
+        MfccNormalizer normalizer;
+        if (!initNormalizer(coef_num, normalizer)) { return false; }
+        for (int i = 0; i < frame_num; i++)
+        {
+            normalizer.push(&mfccs[i * coef_num]);
+        }
+        return create(mfccs, frame_num, normalizer, arena, dest);
+    }
+
+    bool MfccEngine::create(const float* mfccs, int frame_num, const MfccNormalizer& normalizer,
+                            MfccArena& arena, MfccFeatureView* dest)
+    {
+        const int coef_num = normalizer.dimension();
+        if (frame_num <= 0 || frame_num > arena.max_frame_num_ || coef_num != arena.coef_num_
+            || normalizer.size() <= 0)
+        {
+            return false;
+        }
+
+        normalizer.apply(mfccs, frame_num, arena.feature_);
+        const float* inverse_norms = nullptr;
+        if (mfcc_config_.cache_inverse_norm)
+        {
+            for (int i = 0; i < frame_num; i++)
+            {
+                arena.inverse_norm_[i] = calcInverseNorm(&arena.feature_[i * coef_num], coef_num);
+            }
+            inverse_norms = arena.inverse_norm_;
+        }
+        *dest = MfccFeatureView(arena.feature_, frame_num, coef_num, inverse_norms);
+        return true;
+    }
+
+    bool MfccStream::init(MfccEngine& engine)
+    {
+        if (engine.window_ == nullptr)
+        {
+            printf("MfccEngine is not initialized\n");
+            return false;
+        }
+
+        ring_.reset(new (std::nothrow) int16_t[engine.config().frame_length()]);
+        if (!ring_)
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+
+        engine_ = &engine;
+        reset();
+        return true;
+    }
+
+    void MfccStream::deinit()
+    {
+        ring_.reset();
+        engine_ = nullptr;
+    }
+
+    void MfccStream::reset()
+    {
+        write_pos_ = 0;
+        pending_length_ = (engine_ != nullptr) ? engine_->config().frame_length() : 0;
+        prev_val_ = 0;
+    }
+
+    int MfccStream::push(const int16_t* data, int length, float* dest, int max_frame_num)
+    {
+        if (engine_ == nullptr) { return 0; }
+
+        const auto config = engine_->config();
+        const int ring_length = config.frame_length();
+        const int hop_length = config.hop_length();
+        const int coef_num = config.coef_num;
+
+        int frame_count = 0;
+        int index = 0;
+        while (index < length)
+        {
+            const int copy_length = std::min(std::min(pending_length_, length - index), ring_length - write_pos_);
+            std::copy_n(&data[index], copy_length, &ring_[write_pos_]);
+            index += copy_length;
+            pending_length_ -= copy_length;
+            write_pos_ += copy_length;
+            if (write_pos_ >= ring_length) { write_pos_ = 0; }
+
+            if (pending_length_ > 0) { continue; }
+
+            // write_pos_はフレームの先頭(最も古いサンプル)を指す
+            if (frame_count < max_frame_num)
+            {
+                engine_->calculate(&ring_[write_pos_], ring_length - write_pos_, ring_.get(), prev_val_,
+                                   &dest[frame_count * coef_num]);
+                frame_count++;
+            }
+            // 次のフレームの直前のサンプルは以降の書き込みで上書きされるため保持しておく
+            prev_val_ = ring_[(write_pos_ + hop_length - 1) % ring_length];
+            pending_length_ = hop_length;
+        }
+        return frame_count;
+    }
+
 
 } // namespace simplevox
@@ -11,12 +11,28 @@
 #define SIMPLEVOX_MFCC_H_
 
 #include <memory>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "simplevox_feature.h"
+#include "simplevox_stats.h"
 
 namespace simplevox
 {
+    class DtwEnvelope;
+
+    enum class MelNormalize
+    {
+        None,       ///< 三角波の頂点を1とする
+        Slaney,     ///< 三角波の面積が等しくなるように正規化する(Slaney形式)
+    };
+
+    enum class MfccArithmetic
+    {
+        Float,      ///< 浮動小数点演算(FFTはfc32)
+        FixedPoint, ///< 固定小数点演算(FFTはsc16, FPUを持たないチップ向け)
+    };
+
     struct MfccConfig
     {
         /**
@@ -29,6 +45,11 @@ namespace simplevox
          */
         int mel_channel = 24;
 
+        /**
+         * @brief メルフィルタバンクの重みの正規化方法
+         */
+        MelNormalize mel_normalize = MelNormalize::None;
+
         /**
          * @brief MFCCの係数の数(12 -> 1~12を取り出す(0は除外))
          */
@@ -52,14 +73,106 @@ namespace simplevox
          */
         int frame_time_ms = 32;
 
+        /**
+         * @brief create()で作成するMFCCに各フレームのノルムの逆数を保持するか
+         * @note 保持しておくとDTWの各セルで平方根と除算が不要になります(1フレームあたり4byte増加)
+         */
+        bool cache_inverse_norm = true;
+
+        /**
+         * @brief MFCCの算出に用いる演算方式
+         * @note
+         * FixedPointではFFTの作業領域がfloat(fft_num個)からint16_t(fft_num個)になります。
+         * 16bitのFFTのため、Floatに比べて小さなスペクトル成分の精度は低下します。
+         */
+        MfccArithmetic arithmetic = MfccArithmetic::Float;
+
+        /**
+         * @brief 対数メルスペクトルの算出にlog10f()の代わりに近似を用いるか(MfccArithmetic::Floatのみ)
+         * @note
+         * 誤差は最大で約6e-4dBです。
+         * MFCCは後段で標準化されるため、DTWの結果への影響はほぼありません。
+         */
+        bool fast_log = false;
+
+        /**
+         * @brief 標準化の平均と標準偏差を係数ごとに求めるか(CMVN: Cepstral Mean and Variance Normalization)
+         * @note
+         * falseの場合は全ての係数で共通の平均と標準偏差を用います。
+         * trueの場合は話者や収録環境による係数ごとの偏りが除かれ、DTWの距離の分離が改善する傾向があります。
+         * テンプレートと照合する特徴量は同じ設定で作成する必要があります。
+         */
+        bool per_coef_normalize = false;
+
         int frame_length() const { return frame_time_ms * sample_rate / 1000; }
         int hop_length() const { return frame_length() / 2; }
     };
 
+    /**
+     * @brief MFCCの標準化に用いる平均と分散をフレームごとに逐次的に求めます
+     * @details
+     * Welfordの方法(フレーム単位の統計量の結合)で平均と偏差平方和を更新するため、
+     * 全てのフレームを保持して再度走査する必要がありません。
+     * 最後のフレームを入力した時点で統計量が確定し、apply()の１回の走査で標準化できます。
+     * ヒープの確保を行いません。
+     */
+    class MfccNormalizer
+    {
+    public:
+        static constexpr int kMaxCoefNum = 32;  ///< 係数ごとに標準化する場合の最大の係数の個数
+
+        /**
+         * @brief   初期化処理を行います
+         * @param[in]   coef_num    係数の個数
+         * @param[in]   per_coef    係数ごとに統計量を求めるか(coef_numはkMaxCoefNum以下であること)
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         */
+        bool init(int coef_num, bool per_coef);
+
+        /**
+         * @brief   統計量を破棄します
+         */
+        void reset();
+
+        /**
+         * @brief   統計量に１フレーム分のMFCCを加えます
+         * @param[in]   mfcc    標準化前のMFCC(coef_num個)
+         */
+        void push(const float* mfcc);
+
+        /**
+         * @brief   統計量に加えたフレーム数
+         */
+        int size() const { return frame_count_; }
+
+        /**
+         * @brief   係数の個数
+         */
+        int dimension() const { return coef_num_; }
+
+        /**
+         * @brief   現在の統計量でMFCCを標準化します(MfccEngine::normalize()と同じく1000倍し、int16_tの範囲にクリップ)
+         * @param[in]   mfccs       標準化前のMFCC(frame_num * coef_num)
+         * @param[in]   frame_num   フレーム数
+         * @param[out]  dest        標準化後のMFCC(frame_num * coef_num)
+         */
+        void apply(const float* mfccs, int frame_num, int16_t* dest) const;
+
+    private:
+        float mean_[kMaxCoefNum];
+        float m2_[kMaxCoefNum];     ///< 偏差平方和
+        int coef_num_ = 0;
+        int stat_num_ = 0;          ///< 統計量の個数(全体で共通なら1, 係数ごとならcoef_num)
+        int frame_count_ = 0;
+    };
+
     class MfccFeature: public ISoundFeature<MfccFeature>
     {
     friend class MfccEngine;
     public:
+        MfccFeature() = default;
+        MfccFeature(const MfccFeature&) = delete;
+        MfccFeature& operator=(const MfccFeature&) = delete;
         ~MfccFeature();
         /**
          * @brief   特徴量の総数
@@ -77,29 +190,369 @@ namespace simplevox
          */
         const int16_t* feature(int number) const { return &feature_[number * coef_num_]; }
 
+        /**
+         * @brief   各フレームの特徴量のノルムの逆数, 保持していない場合はnullptr
+         */
+        const float* inverse_norms() const { return inverse_norm_; }
+
     private:
         MfccFeature(int frame_num, int coef_num);
+        bool cacheInverseNorm();
         int frame_num_;
         int coef_num_;
         int16_t* feature_ = nullptr;
+        float* inverse_norm_ = nullptr;
+    };
+
+    /**
+     * @brief 外部の読み出し専用メモリ上のMFCCを参照する特徴量(コピーしない)
+     * @details
+     * esp_partition_mmap()でマップしたフラッシュ上のデータや、ファームウェアに埋め込んだconstデータを
+     * ヒープに読み込まずにそのままテンプレートとして使用します。
+     * 参照先のメモリは所有されないため、使用している間は有効である必要があります。
+     */
+    class MfccFeatureView: public ISoundFeature<MfccFeatureView>
+    {
+    public:
+        MfccFeatureView() = default;
+
+        /**
+         * @param[in]   feature         標準化済みの特徴量(frame_num * coef_num, 2byte境界に配置)
+         * @param[in]   frame_num       総フレーム数
+         * @param[in]   coef_num        係数の個数
+         * @param[in]   inverse_norms   各フレームのノルムの逆数(frame_num個, 4byte境界に配置), なければnullptr
+         */
+        MfccFeatureView(const int16_t* feature, int frame_num, int coef_num, const float* inverse_norms = nullptr)
+            : feature_(feature), inverse_norm_(inverse_norms), frame_num_(frame_num), coef_num_(coef_num) {}
+
+        /**
+         * @brief   ヒープ上のMFCCを参照します
+         */
+        MfccFeatureView(const MfccFeature& mfcc)
+            : MfccFeatureView(mfcc.feature(0), mfcc.size(), mfcc.dimension(), mfcc.inverse_norms()) {}
+
+        /**
+         * @brief   MfccEngine::saveFile(path, mfcc, true)で保存したファイルのイメージを参照します
+         * @param[in]   data        イメージの先頭(4byte境界に配置されていること)
+         * @param[in]   length      dataのバイト数
+         * @param[out]  envelope    nullptr以外の場合、イメージに続く包絡線を参照する(なければ空にする)
+         * @return  参照に成功したらtrue, 形式が異なる場合や境界が揃っていない場合はfalse
+         */
+        bool parse(const void* data, size_t length, DtwEnvelope* envelope = nullptr);
+
+        int size() const { return frame_num_; }
+        int dimension() const { return coef_num_; }
+        const int16_t* feature(int number) const { return &feature_[number * coef_num_]; }
+        const float* inverse_norms() const { return inverse_norm_; }
+
+    private:
+        const int16_t* feature_ = nullptr;
+        const float* inverse_norm_ = nullptr;
+        int frame_num_ = 0;
+        int coef_num_ = 0;
+    };
+
+    /**
+     * @brief テンプレートごとのスケールで8bitに量子化したMFCC(MfccEngine::quantize()で作成)
+     * @details
+     * 標準化済みの特徴量(MfccFeature)の絶対値の最大がINT8_MAXとなるようにスケーリングして保持するため、
+     * テンプレートのメモリやフラッシュの使用量はMfccFeatureの半分となります。
+     * コサイン距離はスケールによらないため、calcDTW()では量子化した値のまま比較できます。
+     */
+    class MfccFeatureInt8: public ISoundFeature<MfccFeatureInt8, int8_t>
+    {
+    friend class MfccEngine;
+    public:
+        MfccFeatureInt8() = default;
+        MfccFeatureInt8(const MfccFeatureInt8&) = delete;
+        MfccFeatureInt8& operator=(const MfccFeatureInt8&) = delete;
+        ~MfccFeatureInt8();
+        int size() const { return frame_num_; }
+        int dimension() const { return coef_num_; }
+        const int8_t* feature(int number) const { return &feature_[number * coef_num_]; }
+
+        /**
+         * @brief   各フレームのノルムの逆数(量子化後の値から算出したもの), 保持していない場合はnullptr
+         */
+        const float* inverse_norms() const { return inverse_norm_; }
+
+        /**
+         * @brief   量子化のスケール(量子化前の値 * scale()を丸めたものが各要素の値)
+         */
+        float scale() const { return scale_; }
+
+    private:
+        MfccFeatureInt8(int frame_num, int coef_num);
+        bool cacheInverseNorm();
+        int frame_num_;
+        int coef_num_;
+        float scale_ = 1;
+        int8_t* feature_ = nullptr;
+        float* inverse_norm_ = nullptr;
+    };
+
+    /**
+     * @brief 外部の読み出し専用メモリ上の量子化したMFCCを参照する特徴量(コピーしない)
+     * @see MfccFeatureView
+     */
+    class MfccFeatureInt8View: public ISoundFeature<MfccFeatureInt8View, int8_t>
+    {
+    public:
+        MfccFeatureInt8View() = default;
+
+        /**
+         * @param[in]   feature         量子化済みの特徴量(frame_num * coef_num)
+         * @param[in]   frame_num       総フレーム数
+         * @param[in]   coef_num        係数の個数
+         * @param[in]   scale           量子化のスケール
+         * @param[in]   inverse_norms   各フレームのノルムの逆数(frame_num個, 4byte境界に配置), なければnullptr
+         */
+        MfccFeatureInt8View(const int8_t* feature, int frame_num, int coef_num, float scale,
+                            const float* inverse_norms = nullptr)
+            : feature_(feature), inverse_norm_(inverse_norms), frame_num_(frame_num), coef_num_(coef_num),
+              scale_(scale) {}
+
+        /**
+         * @brief   ヒープ上の量子化したMFCCを参照します
+         */
+        MfccFeatureInt8View(const MfccFeatureInt8& mfcc)
+            : MfccFeatureInt8View(mfcc.feature(0), mfcc.size(), mfcc.dimension(), mfcc.scale(), mfcc.inverse_norms()) {}
+
+        /**
+         * @brief   MfccEngine::saveFile(path, mfcc)で保存した量子化したMFCCのファイルのイメージを参照します
+         * @param[in]   data        イメージの先頭(4byte境界に配置されていること)
+         * @param[in]   length      dataのバイト数
+         * @param[out]  envelope    nullptr以外の場合、イメージに続く包絡線を参照する(なければ空にする)
+         * @return  参照に成功したらtrue, 形式が異なる場合や境界が揃っていない場合はfalse
+         */
+        bool parse(const void* data, size_t length, DtwEnvelope* envelope = nullptr);
+
+        int size() const { return frame_num_; }
+        int dimension() const { return coef_num_; }
+        const int8_t* feature(int number) const { return &feature_[number * coef_num_]; }
+        const float* inverse_norms() const { return inverse_norm_; }
+        float scale() const { return scale_; }
+
+    private:
+        const int8_t* feature_ = nullptr;
+        const float* inverse_norm_ = nullptr;
+        int frame_num_ = 0;
+        int coef_num_ = 0;
+        float scale_ = 1;
+    };
+
+    /**
+     * @brief 複数のテンプレートをまとめて保持するライブラリ(MfccEngine::saveLibrary()の形式)
+     * @details
+     * 先頭のインデックスに各テンプレートの位置、フレーム数、ラベル、ノルムの逆数の有無を持ち、
+     * 全てのデータは4byte境界に配置されるため、マップしたフラッシュ上でそのまま参照できます。
+     * インデックス以降のデータはCRC32で検証されます。
+     */
+    class MfccLibrary
+    {
+    friend class MfccEngine;
+    public:
+        static constexpr int kLabelSize = 20;   ///< ラベルの最大長(終端文字を含む)
+
+        ~MfccLibrary() { clear(); }
+
+        /**
+         * @brief   MfccEngine::saveLibrary()で保存したファイルのイメージを参照します(コピーしない)
+         * @param[in]   data    イメージの先頭(4byte境界に配置されていること)
+         * @param[in]   length  dataのバイト数
+         * @param[in]   verify  CRCを検証するか(全てのデータを読み出すため、起動時間を優先する場合はfalse)
+         * @return  参照に成功したらtrue, 失敗したらfalse
+         * @note    参照先のメモリは所有されないため、使用している間は有効である必要があります
+         */
+        bool parse(const void* data, size_t length, bool verify = true);
+
+        /**
+         * @brief   保持しているテンプレートを破棄します
+         */
+        void clear();
+
+        /**
+         * @brief   テンプレートの個数
+         */
+        int size() const { return template_num_; }
+
+        /**
+         * @brief   特徴量の次元数(全てのテンプレートで共通)
+         */
+        int dimension() const { return coef_num_; }
+
+        /**
+         * @brief   テンプレートの配列(KeywordSpotter::setTemplates()などにそのまま渡せます)
+         */
+        const MfccFeatureView* const* templates() const { return template_ptrs_.get(); }
+
+        /**
+         * @brief   任意の番号のテンプレート
+         */
+        const MfccFeatureView& feature(int index) const { return views_[index]; }
+
+        /**
+         * @brief   任意の番号のテンプレートのラベル
+         */
+        const char* label(int index) const { return labels_[index]; }
+
+        /**
+         * @brief   ラベルからテンプレートの番号を探します
+         * @return  テンプレートの番号, 見つからない場合は-1
+         */
+        int find(const char* label) const;
+
+    private:
+        std::unique_ptr<MfccFeatureView[]> views_;
+        std::unique_ptr<const MfccFeatureView*[]> template_ptrs_;
+        std::unique_ptr<const char*[]> labels_;
+        uint8_t* buffer_ = nullptr;     ///< loadLibrary()で読み込んだイメージ
+        int template_num_ = 0;
+        int coef_num_ = 0;
+    };
+
+    /**
+     * @brief MfccEngine::create()で作成するMFCCの格納先として事前に確保する領域
+     * @details
+     * init()の後はヒープの確保を行わずにMFCCを作成できるため、長時間の連続運転でもヒープが断片化しません。
+     * 作成したMFCC(MfccFeatureView)は、次に同じ領域へ作成するまで有効です。
+     */
+    class MfccArena
+    {
+    friend class MfccEngine;
+    private:
+        uint8_t* buffer_ = nullptr;
+        bool is_owner_ = false;
+        int16_t* feature_ = nullptr;
+        float* inverse_norm_ = nullptr;
+        float* work_ = nullptr;         ///< 標準化前のMFCC(create(const int16_t*, ...)でのみ使用)
+        int max_frame_num_ = 0;
+        int coef_num_ = 0;
+    public:
+        MfccArena() = default;
+        MfccArena(const MfccArena&) = delete;
+        MfccArena& operator=(const MfccArena&) = delete;
+        ~MfccArena() { deinit(); }
+
+        /**
+         * @brief   必要なバイト数を求めます
+         * @param[in]   max_frame_num   最大のフレーム数
+         * @param[in]   coef_num        係数の個数
+         * @param[in]   has_work        サウンドデータから作成するための作業領域を含めるか
+         */
+        static size_t requiredSize(int max_frame_num, int coef_num, bool has_work);
+
+        /**
+         * @brief   領域を確保して初期化します
+         * @param[in]   max_frame_num   最大のフレーム数
+         * @param[in]   coef_num        係数の個数
+         * @param[in]   caps            heap_caps_malloc()に指定するメモリの種類
+         *                              (MALLOC_CAP_SPIRAMで外部RAM, MALLOC_CAP_INTERNALで内部RAM)
+         * @param[in]   has_work        create(const int16_t*, ...)で使用する場合はtrue
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         * @note    外部RAMは内部RAMに比べてアクセスが遅いため、DTWの速度が低下する場合があります
+         */
+        bool init(int max_frame_num, int coef_num, uint32_t caps, bool has_work = true);
+
+        /**
+         * @brief   呼び出し元が用意した領域(静的な配列など)を用いて初期化します
+         * @param[in]   buffer          領域(requiredSize()バイト以上, 4byte境界に配置)
+         * @param[in]   size            bufferのバイト数
+         * @param[in]   max_frame_num   最大のフレーム数
+         * @param[in]   coef_num        係数の個数
+         * @param[in]   has_work        create(const int16_t*, ...)で使用する場合はtrue
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         * @note    bufferは所有されないため、使用している間は有効である必要があります
+         */
+        bool init(void* buffer, size_t size, int max_frame_num, int coef_num, bool has_work = true);
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   格納できる最大のフレーム数
+         */
+        int capacity() const { return max_frame_num_; }
+    };
+
+    /**
+     * @brief MfccEngine::average()のコンフィグ
+     */
+    struct DbaConfig
+    {
+        /**
+         * @brief DBA(DTW Barycenter Averaging)の反復回数
+         */
+        int iteration_num = 5;
+
+        /**
+         * @brief 整列に用いるDTWのバンドの幅(DtwConfig::band_width), 負の場合は制約なし
+         */
+        int band_width = -1;
+
+        /**
+         * @brief しきい値の余裕[%], 各登録音声と平均化したテンプレートのDTW距離の最大値にこの割合を加えてしきい値とします
+         */
+        int threshold_margin = 20;
     };
 
     class MfccEngine
     {
+    friend class MfccStream;
     private:
         MfccConfig mfcc_config_;
         std::unique_ptr<int16_t[]> window_;
-        std::unique_ptr<int16_t[]> mel_position_;
+        std::unique_ptr<int16_t[]> mel_begin_;
+        std::unique_ptr<int16_t[]> mel_length_;
+        std::unique_ptr<float[]> mel_weight_;
         std::unique_ptr<int16_t[]> dctII_table_;
         std::unique_ptr<float[]> mel_data_;
         std::unique_ptr<float[]> fft_data_;
+        // 以下はMfccArithmetic::FixedPointの場合のみ使用する
+        std::unique_ptr<uint16_t[]> mel_weight_fixed_;
+        std::unique_ptr<int16_t[]> twiddle_;
+        std::unique_ptr<int32_t[]> mel_data_fixed_;
+        std::unique_ptr<uint32_t[]> fft_data_fixed_;
+        int32_t log2_offset_ = 0;
+#if SIMPLEVOX_ENABLE_STATS
+        MfccStats stats_;
+#endif
         void release();
+        bool initFixed(const MfccConfig& config, const int16_t* mel_position);
+
+        template <typename T>
+        void calculateFloat(const int16_t* head, int head_length, const int16_t* tail, int prev_val, T* mfcc);
+        template <typename T>
+        void calculateFixed(const int16_t* head, int head_length, const int16_t* tail, int prev_val, T* mfcc);
+
+        /**
+         * @brief ２つの領域に分かれた１フレーム分のサウンドデータからMFCCを算出します
+         * @param[in]   head        フレームの前半部分
+         * @param[in]   head_length 前半部分の長さ(frame_length()以下)
+         * @param[in]   tail        フレームの後半部分(frame_length() - head_length個)
+         * @param[in]   prev_val    フレーム直前のサンプル値(プリエンファシス用)
+         * @param[out]  mfcc        算出した特徴量(MFCC, coef_num個)
+         */
+        void calculate(const int16_t* head, int head_length, const int16_t* tail, int prev_val, float* mfcc);
+
+        /**
+         * @brief 連続したサウンドデータの各フレームのMFCC(標準化前)を算出します
+         */
+        void calculateFrames(const int16_t* raw_audio, int frame_num, float* mfccs, MfccNormalizer& normalizer);
+        bool initNormalizer(int coef_num, MfccNormalizer& normalizer) const;
     public:
         MfccConfig config() const { return mfcc_config_; }
         /**
          * @brief   指定したコンフィグに沿って初期化処理を行います
          * @param[in]   config  コンフィグ
          * @return 初期化成功ならtrue, 失敗ならfalse 
+         * @note
+         * 複数のエンジンを同時に使用できます(FFTのテーブルは演算方式ごとに共有されます)。
+         * 共有するテーブルはfft_num = 1024(16kHzで64ms)以上で確保されるため、それ以下のエンジンは初期化の順序を問いません。
+         * 1024を超えるfft_numのエンジンは、他のエンジンより先に初期化する必要があります
+         * (すでに共有されているテーブルより大きいfft_numは初期化に失敗します)。
          */
         bool init(const MfccConfig& config);
         
@@ -115,10 +568,41 @@ namespace simplevox
          */
         void calculate(const int16_t* frame, float* mfcc);
 
+        /**
+         * @brief MFCCを固定小数点数で算出します
+         * @param[in]   frame   １フレーム(frame_length())分のサウンドデータ
+         * @param[out]  mfcc    算出した特徴量(MFCCを16倍した値, coef_num個)
+         * @note MfccArithmetic::FixedPointの場合は浮動小数点演算を行いません
+         */
+        void calculate(const int16_t* frame, int16_t* mfcc);
+
+        /**
+         * @brief calculate()の各段の積算サイクル数(create()などによる呼び出しを含む)
+         * @note SIMPLEVOX_ENABLE_STATSが0の場合は常に0
+         */
+        MfccStats stats() const
+        {
+#if SIMPLEVOX_ENABLE_STATS
+            return stats_;
+#else
+            return MfccStats();
+#endif
+        }
+
+        /**
+         * @brief stats()の積算値をリセットします
+         */
+        void resetStats()
+        {
+#if SIMPLEVOX_ENABLE_STATS
+            stats_ = MfccStats();
+#endif
+        }
+
         /**
          * @brief 各フレームのMFCCを標準化します
          * @details
-         * 入力のMFCCを平均０、分散１に標準化します。
+         * 入力のMFCCを平均０、分散１に標準化します(MfccConfig::per_coef_normalizeがtrueの場合は係数ごと)。
          * 標準化の性質からほとんどの値は－３～３の範囲に収まることが期待されます。
          * これに合わせてdestに１０００倍した値を変換結果として格納します。
          * これは精度を満たしながら(floatに比べて)処理コストおよびサイズを削減するためです。
@@ -136,16 +620,65 @@ namespace simplevox
          * @brief   MFCCをファイルに保存します
          * @param[in]   path    ファイルのパス
          * @param[in]   mfcc    保存するMFCC
+         * @param[in]   aligned 各データを4byte境界に揃えて保存するか(MfccFeatureView::parse()で参照する場合はtrue)
+         * @param[in]   envelope    MFCCの後に保存する包絡線(calcDTWBatch()の枝刈り用), nullptrの場合は保存しない
          * @return  保存に成功したらtrue, そうでなければfalse
          */
-        static bool saveFile(const char *path, const MfccFeature& mfcc);
+        static bool saveFile(const char *path, const MfccFeature& mfcc, bool aligned = false,
+                             const DtwEnvelope* envelope = nullptr);
 
         /**
          * @brief   ファイルからMFCCを読み出します
-         * @param[in]   path    ファイルのパス
+         * @param[in]   path        ファイルのパス
+         * @param[out]  envelope    nullptr以外の場合、保存された包絡線を読み出す(なければ空にする)
          * @return  読み出しに成功したらnullptr以外, 失敗したらnullptr 
          */
-        static MfccFeature* loadFile(const char *path);
+        static MfccFeature* loadFile(const char *path, DtwEnvelope* envelope = nullptr);
+
+        /**
+         * @brief   標準化済みのMFCCをテンプレートごとのスケールで8bitに量子化します
+         * @details 元のMFCCがノルムの逆数を保持している場合は、量子化後の値から算出して保持します
+         * @param[in]   mfcc    量子化するMFCC(MfccFeatureも指定可)
+         * @return  量子化したMFCC, 確保に失敗したらnullptr
+         */
+        static MfccFeatureInt8* quantize(const MfccFeatureView& mfcc);
+
+        /**
+         * @brief   量子化したMFCCをファイルに保存します
+         * @details 各データは4byte境界に揃えて保存します(MfccFeatureInt8View::parse()で参照可)
+         * @param[in]   path    ファイルのパス
+         * @param[in]   mfcc    保存するMFCC
+         * @param[in]   envelope    MFCCの後に保存する包絡線, nullptrの場合は保存しない
+         * @return  保存に成功したらtrue, そうでなければfalse
+         */
+        static bool saveFile(const char *path, const MfccFeatureInt8& mfcc, const DtwEnvelope* envelope = nullptr);
+
+        /**
+         * @brief   ファイルから量子化したMFCCを読み出します
+         * @param[in]   path        ファイルのパス
+         * @param[out]  envelope    nullptr以外の場合、保存された包絡線を読み出す(なければ空にする)
+         * @return  読み出しに成功したらnullptr以外, 失敗したらnullptr
+         */
+        static MfccFeatureInt8* loadFileInt8(const char *path, DtwEnvelope* envelope = nullptr);
+
+        /**
+         * @brief   複数のMFCCを１つのファイルにまとめて保存します
+         * @param[in]   path        ファイルのパス
+         * @param[in]   mfccs       保存するMFCCの配列(全て同じ次元数であること)
+         * @param[in]   labels      各MFCCのラベルの配列(kLabelSize - 1文字まで), nullptrの場合はラベルなし
+         * @param[in]   num         MFCCの個数
+         * @return  保存に成功したらtrue, そうでなければfalse
+         * @note    ノルムの逆数を保持しているMFCCはノルムの逆数も保存されます
+         */
+        static bool saveLibrary(const char *path, const MfccFeature* const* mfccs, const char* const* labels, int num);
+
+        /**
+         * @brief   saveLibrary()で保存したファイルを読み出します
+         * @param[in]   path    ファイルのパス
+         * @return  読み出しに成功したらnullptr以外, 失敗(CRCの不一致を含む)したらnullptr
+         * @note    ファイル全体を１つのバッファに読み込み、各テンプレートはその領域を参照します
+         */
+        static MfccLibrary* loadLibrary(const char *path);
 
         /**
          * @brief   raw audio dataを基にMFCCを作成します
@@ -163,6 +696,112 @@ namespace simplevox
          * @return  作成に成功したらnullptr以外, 失敗したらnullptr 
          */
         MfccFeature* create(const float* mfccs, int frame_num, int coef_num);
+
+        /**
+         * @brief   raw audio dataを基に事前に確保した領域へMFCCを作成します(ヒープの確保を行いません)
+         * @param[in]   raw_audio   raw audio
+         * @param[in]   length      raw audioの長さ(frameNum(length)がarenaのcapacity()以下であること)
+         * @param[in]   arena       格納先(作業領域を含めて初期化したもの)
+         * @param[out]  dest        作成したMFCC(arenaの領域を参照する)
+         * @return  作成に成功したらtrue, 失敗したらfalse
+         */
+        bool create(const int16_t* raw_audio, int length, MfccArena& arena, MfccFeatureView* dest);
+
+        /**
+         * @brief   フレームごとの特徴量(標準化前)を基に事前に確保した領域へMFCCを作成します(ヒープの確保を行いません)
+         * @param[in]   mfccs       MFCC (frame_num * coef_num)
+         * @param[in]   frame_num   総フレーム数(arenaのcapacity()以下であること)
+         * @param[in]   coef_num    係数の個数
+         * @param[in]   arena       格納先
+         * @param[out]  dest        作成したMFCC(arenaの領域を参照する)
+         * @return  作成に成功したらtrue, 失敗したらfalse
+         */
+        bool create(const float* mfccs, int frame_num, int coef_num, MfccArena& arena, MfccFeatureView* dest);
+
+        /**
+         * @brief   逐次的に求めた統計量を用いて事前に確保した領域へMFCCを作成します(ヒープの確保を行いません)
+         * @details 統計量は確定しているため、標準化は１回の走査で完了します
+         * @param[in]   mfccs       MFCC (frame_num * coef_num)
+         * @param[in]   frame_num   総フレーム数(arenaのcapacity()以下であること)
+         * @param[in]   normalizer  mfccsの各フレームを入力した統計量
+         * @param[in]   arena       格納先
+         * @param[out]  dest        作成したMFCC(arenaの領域を参照する)
+         * @return  作成に成功したらtrue, 失敗したらfalse
+         */
+        bool create(const float* mfccs, int frame_num, const MfccNormalizer& normalizer,
+                    MfccArena& arena, MfccFeatureView* dest);
+
+        /**
+         * @brief   同じ単語を複数回登録したMFCCをDBA(DTW Barycenter Averaging)で１つのテンプレートにまとめます
+         * @details
+         * 他の登録音声とのDTW距離の合計が最小のもの(medoid)を初期値とし、各登録音声をDTWで整列して
+         * 対応するフレームの平均をとることを反復します。テンプレートのフレーム数は初期値と同じです。
+         * 照合時のDTWの回数が登録回数分の１となります。
+         * @param[in]   mfccs       登録音声のMFCCの配列(全て同じ次元数であること)
+         * @param[in]   num         MFCCの個数
+         * @param[in]   config      反復回数などのコンフィグ
+         * @param[out]  threshold   nullptr以外の場合、テンプレートに対するしきい値(登録音声との距離の最大値 + 余裕)
+         * @return  作成に成功したらnullptr以外, 失敗したらnullptr
+         * @note    ノルムの逆数はcreate()と同じくMfccConfig::cache_inverse_normに従います
+         */
+        MfccFeature* average(const MfccFeature* const* mfccs, int num, const DbaConfig& config = DbaConfig(),
+                             uint32_t* threshold = nullptr);
+
+        /**
+         * @brief   サウンドデータの長さから作成されるMFCCのフレーム数を求めます
+         * @param[in]   length  サウンドデータの長さ
+         * @return  フレーム数(frame_length()に満たない場合は0以下)
+         */
+        int frameNum(int length) const;
+    };
+
+    /**
+     * @brief 任意の長さのサウンドデータから逐次的にMFCCを算出します
+     * @details
+     * 内部にframe_length()分のリングバッファを持ち、hop_length()分のデータが揃うごとに
+     * １フレーム分のMFCCを算出します。
+     * フレーム間で重複するデータはリング上で共有されるため、シフトやコピーは発生しません。
+     * また、プリエンファシスの状態(フレーム直前のサンプル)もフレーム間で引き継がれます。
+     */
+    class MfccStream
+    {
+    private:
+        MfccEngine* engine_ = nullptr;
+        std::unique_ptr<int16_t[]> ring_;
+        int write_pos_ = 0;
+        int pending_length_ = 0;
+        int prev_val_ = 0;
+    public:
+        /**
+         * @brief   初期化処理を行います
+         * @param[in]   engine  MFCCの算出に用いるエンジン(初期化済みであること)
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         * @note    engineはMfccStreamを使用している間は有効である必要があります
+         */
+        bool init(MfccEngine& engine);
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   バッファリング中のデータを破棄し、最初のフレームから算出し直します
+         */
+        void reset();
+
+        /**
+         * @brief   サウンドデータを追加し、揃ったフレームのMFCCを算出します
+         * @param[in]   data            サウンドデータ
+         * @param[in]   length          サウンドデータの長さ
+         * @param[out]  dest            算出したMFCCの格納先(max_frame_num * coef_num)
+         * @param[in]   max_frame_num   destに格納可能なフレーム数
+         * @return  destに格納したフレーム数
+         * @note
+         * max_frame_numを超えるフレームは算出されずに破棄されますが、サウンドデータは全て消費されます。
+         * １回の呼び出しで算出されるフレーム数は最大でlength / hop_length() + 1です。
+         */
+        int push(const int16_t* data, int length, float* dest, int max_frame_num);
     };
 } // namespace simplevox
 
@@ -0,0 +1,236 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#include "simplevox_multi_kws.h"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdio.h>
+
+namespace
+{
+    constexpr int kMaxChannelNum = 8;
+}
+
+namespace simplevox
+{
+    bool MultiKeywordSpotter::init(const KwsConfig& config, int channel_num)
+    {
+        if (channel_num_ > 0 || channel_num <= 0 || channel_num > kMaxChannelNum || config.incremental)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+
+        // KeywordSpotterと同じくVADのHangbeforeおよびPreDetectionに相当するフレーム数を保持する
+        int before_frame_num = 0;
+        int max_frame_num = 0;
+        if (!detail::CalcFeatureFrameNum(config.vad_config, config.mfcc_config, config.max_time_ms,
+                                         &before_frame_num, &max_frame_num))
+        {
+            return false;
+        }
+
+        if (!mfcc_engine_.init(config.mfcc_config))
+        {
+            printf("Failed to initialize mfcc\n");
+            return false;
+        }
+
+        vad_engines_.reset(new (std::nothrow) VadEngine[channel_num]);
+        states_.reset(new (std::nothrow) VadState[channel_num]);
+        feature_rings_.reset(new (std::nothrow) detail::FeatureRing[channel_num]);
+        frames_.reset(new (std::nothrow) int16_t[channel_num * config.vad_config.frame_length()]);
+        channel_num_ = channel_num;
+        if (!vad_engines_ || !states_ || !feature_rings_ || !frames_
+            || !arena_.init(max_frame_num, config.mfcc_config.coef_num, config.feature_caps, false)
+            || !dtw_workspace_.init(max_frame_num))
+        {
+            printf("Failed to create heap\n");
+            deinit();
+            return false;
+        }
+        for (int ch = 0; ch < channel_num; ch++)
+        {
+            if (!vad_engines_[ch].init(config.vad_config))
+            {
+                printf("Failed to initialize vad\n");
+                deinit();
+                return false;
+            }
+            if (!feature_rings_[ch].init(mfcc_engine_, max_frame_num, before_frame_num))
+            {
+                deinit();
+                return false;
+            }
+        }
+
+        config_ = config;
+        reset();
+        return true;
+    }
+
+    void MultiKeywordSpotter::deinit()
+    {
+        if (vad_engines_)
+        {
+            for (int ch = 0; ch < channel_num_; ch++)
+            {
+                vad_engines_[ch].deinit();
+            }
+        }
+        vad_engines_.reset();
+        states_.reset();
+        feature_rings_.reset();
+        frames_.reset();
+        templates_.clear();
+        best_distances_.reset();
+        channel_num_ = 0;
+        arena_.deinit();
+        dtw_workspace_.deinit();
+        mfcc_engine_.deinit();
+    }
+
+    void MultiKeywordSpotter::reset()
+    {
+        for (int ch = 0; ch < channel_num_; ch++)
+        {
+            vad_engines_[ch].reset();
+            states_[ch] = VadState::None;
+            feature_rings_[ch].clear();
+        }
+    }
+
+    bool MultiKeywordSpotter::setTemplates(const MfccFeature* const* templates, int num)
+    {
+        return assignTemplates(templates, num);
+    }
+
+    bool MultiKeywordSpotter::setTemplates(const MfccFeatureView* const* templates, int num)
+    {
+        return assignTemplates(templates, num);
+    }
+
+    template <class T>
+    bool MultiKeywordSpotter::assignTemplates(const T* const* templates, int num)
+    {
+        if (num < 0)
+        {
+            return false;
+        }
+        std::unique_ptr<uint32_t[]> best_distances(new (std::nothrow) uint32_t[std::max(num, 1)]);
+        if (!best_distances)
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+        if (!templates_.assign(templates, num))
+        {
+            return false;
+        }
+        std::fill_n(best_distances.get(), num, UINT32_MAX);
+        best_distances_ = std::move(best_distances);
+        return true;
+    }
+
+    bool MultiKeywordSpotter::setThresholds(const uint32_t* thresholds)
+    {
+        return templates_.setThresholds(thresholds);
+    }
+
+    void MultiKeywordSpotter::deinterleave(const int16_t* data)
+    {
+        // VADとMFCCの両方で用いるため、１回の走査でチャンネルごとの連続した領域に並べ替える
+        const int frame_length = config_.vad_config.frame_length();
+        const int channel_num = channel_num_;
+        for (int ch = 0; ch < channel_num; ch++)
+        {
+            int16_t* dest = &frames_[ch * frame_length];
+            const int16_t* src = &data[ch];
+            for (int i = 0; i < frame_length; i++)
+            {
+                dest[i] = src[i * channel_num];
+            }
+        }
+    }
+
+    KwsEvent MultiKeywordSpotter::process(const int16_t* data)
+    {
+        if (!feature_rings_) { return KwsEvent::None; }
+
+        deinterleave(data);
+
+        const int frame_length = config_.vad_config.frame_length();
+        bool is_completed = false;
+        for (int ch = 0; ch < channel_num_; ch++)
+        {
+            const int16_t* frame = &frames_[ch * frame_length];
+            const auto state = vad_engines_[ch].process(frame);
+            states_[ch] = state;
+
+            auto& ring = feature_rings_[ch];
+            ring.push(frame, frame_length, state);
+            if (state == VadState::Detected || (state >= VadState::Speech && ring.isFull()))
+            {
+                is_completed = true;
+            }
+        }
+
+        if (!is_completed)
+        {
+            return KwsEvent::None;
+        }
+        const auto event = match();
+        for (int ch = 0; ch < channel_num_; ch++)
+        {
+            vad_engines_[ch].reset();
+            feature_rings_[ch].clear();
+        }
+        return event;
+    }
+
+    KwsEvent MultiKeywordSpotter::match()
+    {
+        matched_channel_ = -1;
+        matched_index_ = -1;
+        distance_ = UINT32_MAX;
+        const int template_num = templates_.size();
+        std::fill_n(best_distances_.get(), template_num, UINT32_MAX);
+
+        for (int ch = 0; ch < channel_num_; ch++)
+        {
+            if (states_[ch] < VadState::Speech || template_num <= 0) { continue; }
+
+            MfccFeatureView feature;
+            if (!feature_rings_[ch].create(mfcc_engine_, arena_, &feature))
+            {
+                continue;
+            }
+
+            // それまでのチャンネルの最小の距離以上となるテンプレートは打ち切る
+            DtwConfig dtw_config = config_.dtw_config;
+            dtw_config.abandon_distance = std::min(dtw_config.abandon_distance, distance_);
+            uint32_t* distances = templates_.distances();
+            const int index = calcDTWBatch(templates_.pointers(), template_num, feature, distances,
+                                           dtw_config, dtw_workspace_);
+            if (index >= 0 && distances[index] < distance_)
+            {
+                matched_channel_ = ch;
+                matched_index_ = index;
+                distance_ = distances[index];
+                std::copy_n(distances, template_num, best_distances_.get());
+            }
+        }
+
+        return (distance_ < templates_.threshold(matched_index_, config_.threshold))
+                ? KwsEvent::Match
+                : KwsEvent::NoMatch;
+    }
+} // namespace simplevox
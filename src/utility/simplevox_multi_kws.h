@@ -0,0 +1,144 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef SIMPLEVOX_MULTI_KWS_H_
+#define SIMPLEVOX_MULTI_KWS_H_
+
+#include <memory>
+#include <stdint.h>
+
+#include "simplevox_kws.h"
+
+namespace simplevox
+{
+    /**
+     * @brief 複数のマイク(インターリーブされたI2Sのフレーム)に対して音声コマンドの検出を行います
+     * @details
+     * 各チャンネルのVADの状態と特徴量のリング(KeywordSpotterと共通)はチャンネルごとに保持し、MfccEngine(窓関数, Mel-Filter, DCTのテーブルと
+     * FFTの作業領域)、照合用の特徴量の領域(MfccArena)およびDTWの作業領域は全チャンネルで共有します。
+     * 入力はprocess()ごとに一度だけチャンネル別の領域(チャンネル数 * VadConfig::frame_length())に並べ替え、
+     * VADとMFCCの両方で用います。MFCCは音声区間の候補(Silence以降)のチャンネルのみ算出します。
+     * いずれかのチャンネルで音声区間が確定すると、その時点で音声区間(Speech以降)にある全てのチャンネルを照合し、
+     * 最もDTW距離の小さいチャンネルの結果を通知します。２つ目以降のチャンネルはそれまでの最小の距離で
+     * DTWを打ち切ります。判定後は全チャンネルのVADと特徴量をリセットします。
+     * 照合に用いる領域は全てinit()およびsetTemplates()で確保されるため、process()はヒープの確保を行いません。
+     * @note KwsConfig::incrementalは使用できません
+     */
+    class MultiKeywordSpotter
+    {
+    private:
+        KwsConfig config_;
+        int channel_num_ = 0;
+        MfccEngine mfcc_engine_;
+        std::unique_ptr<VadEngine[]> vad_engines_;
+        std::unique_ptr<VadState[]> states_;
+        std::unique_ptr<detail::FeatureRing[]> feature_rings_;
+        std::unique_ptr<int16_t[]> frames_;     ///< チャンネル別に並べ替えた入力(チャンネル数 * frame_length())
+        detail::TemplateSet templates_;         ///< テンプレートとしきい値, 距離は照合中のチャンネルのもの
+        std::unique_ptr<uint32_t[]> best_distances_;    ///< matched_channel_の各テンプレートとの距離
+        MfccArena arena_;
+        DtwWorkspace dtw_workspace_;
+        int matched_channel_ = -1;
+        int matched_index_ = -1;
+        uint32_t distance_ = UINT32_MAX;
+
+        template <class T>
+        bool assignTemplates(const T* const* templates, int num);
+        void deinterleave(const int16_t* data);
+        KwsEvent match();
+    public:
+        ~MultiKeywordSpotter() { deinit(); }
+
+        KwsConfig config() const { return config_; }
+
+        int channelNum() const { return channel_num_; }
+
+        /**
+         * @brief   内部のMfccEngine(テンプレートの作成などで直接利用する場合)
+         */
+        MfccEngine& mfcc() { return mfcc_engine_; }
+
+        /**
+         * @brief   指定したコンフィグに沿って初期化処理を行います
+         * @param[in]   config      コンフィグ(全チャンネル共通)
+         * @param[in]   channel_num チャンネル数(マイクの数)
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         */
+        bool init(const KwsConfig& config, int channel_num);
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   判定状況をリセットします(全チャンネルのVADの状態も含む)
+         */
+        void reset();
+
+        /**
+         * @brief   照合に用いるテンプレートを設定します
+         * @param[in]   templates   テンプレートの配列
+         * @param[in]   num         テンプレートの個数
+         * @return 設定成功ならtrue, 失敗ならfalse
+         * @note    テンプレートは所有されないため、使用している間は有効である必要があります
+         */
+        bool setTemplates(const MfccFeature* const* templates, int num);
+
+        /**
+         * @brief   フラッシュ等に配置したテンプレートを設定します
+         * @param[in]   templates   テンプレートの配列
+         * @param[in]   num         テンプレートの個数
+         * @return 設定成功ならtrue, 失敗ならfalse
+         * @note    テンプレートの参照先は使用している間は有効である必要があります
+         */
+        bool setTemplates(const MfccFeatureView* const* templates, int num);
+
+        /**
+         * @brief   テンプレートごとのしきい値を設定します(KeywordSpotter::setThresholds()と同じ)
+         * @param[in]   thresholds  setTemplates()で設定した個数のしきい値, nullptrの場合はKwsConfig::thresholdに戻します
+         * @return 設定成功ならtrue, 失敗ならfalse
+         */
+        bool setThresholds(const uint32_t* thresholds);
+
+        /**
+         * @brief   全チャンネルの音声区間の検出と照合を行います
+         * @param[in]   data    インターリーブされた１フレーム分のサウンドデータ(チャンネル数 * VadConfig::frame_length())
+         * @return  判定結果(最も距離の小さいチャンネルのもの), None以外の場合は全チャンネルのVADもリセットされます
+         */
+        KwsEvent process(const int16_t* data);
+
+        /**
+         * @brief   直近のprocess()におけるチャンネルのVADの状態
+         */
+        VadState state(int channel) const { return states_[channel]; }
+
+        /**
+         * @brief   直近の判定で最も距離が小さかったチャンネル(照合したチャンネルがない場合は-1)
+         */
+        int matchedChannel() const { return matched_channel_; }
+
+        /**
+         * @brief   直近の判定で最も距離が小さかったテンプレートの番号(テンプレートがない場合は-1)
+         */
+        int matchedIndex() const { return matched_index_; }
+
+        /**
+         * @brief   直近の判定で最も小さかったDTW距離
+         */
+        uint32_t distance() const { return distance_; }
+
+        /**
+         * @brief   直近の判定におけるmatchedChannel()の各テンプレートとのDTW距離(打ち切ったものはUINT32_MAX)
+         */
+        const uint32_t* distances() const { return best_distances_.get(); }
+    };
+} // namespace simplevox
+
+#endif // SIMPLEVOX_MULTI_KWS_H_
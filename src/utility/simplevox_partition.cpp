@@ -0,0 +1,73 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#include "simplevox_partition.h"
+
+#include <stdio.h>
+
+#include <esp_idf_version.h>
+#include <esp_partition.h>
+
+namespace
+{
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+    using MmapHandle = esp_partition_mmap_handle_t;
+    constexpr auto kMmapData = ESP_PARTITION_MMAP_DATA;
+#else
+    using MmapHandle = spi_flash_mmap_handle_t;
+    constexpr auto kMmapData = SPI_FLASH_MMAP_DATA;
+#endif
+}
+
+namespace simplevox
+{
+    bool MappedPartition::map(const char* label, size_t offset, size_t size)
+    {
+        if (data_ != nullptr || label == nullptr)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+
+        const auto* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        if (partition == nullptr)
+        {
+            printf("Partition not found: %s\n", label);
+            return false;
+        }
+        if (offset >= partition->size || size > partition->size - offset)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+        if (size == 0) { size = partition->size - offset; }
+
+        const void* data = nullptr;
+        MmapHandle handle;
+        if (esp_partition_mmap(partition, offset, size, kMmapData, &data, &handle) != ESP_OK)
+        {
+            printf("Failed to map partition\n");
+            return false;
+        }
+        data_ = data;
+        size_ = size;
+        handle_ = handle;
+        return true;
+    }
+
+    void MappedPartition::unmap()
+    {
+        if (data_ == nullptr) { return; }
+        esp_partition_munmap(static_cast<MmapHandle>(handle_));
+        data_ = nullptr;
+        size_ = 0;
+        handle_ = 0;
+    }
+
+} // namespace simplevox
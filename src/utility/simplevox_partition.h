@@ -0,0 +1,60 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef SIMPLEVOX_PARTITION_H_
+#define SIMPLEVOX_PARTITION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace simplevox
+{
+    /**
+     * @brief フラッシュのデータパーティションをアドレス空間にマップします(読み出し専用)
+     * @details
+     * マップした領域はキャッシュ経由で直接読み出せるため、MfccFeatureViewと組み合わせると
+     * テンプレートをSRAMに読み込まずに照合できます。
+     * マップはunmap()またはデストラクタで解除されるため、参照している間は保持してください。
+     */
+    class MappedPartition
+    {
+    private:
+        const void* data_ = nullptr;
+        size_t size_ = 0;
+        uint32_t handle_ = 0;
+    public:
+        ~MappedPartition() { unmap(); }
+
+        /**
+         * @brief   指定したラベルのデータパーティションをマップします
+         * @param[in]   label   パーティションテーブルのラベル
+         * @param[in]   offset  パーティション先頭からのオフセット(バイト)
+         * @param[in]   size    マップするバイト数, 0の場合はoffset以降の全て
+         * @return  マップに成功したらtrue, 失敗したらfalse
+         */
+        bool map(const char* label, size_t offset = 0, size_t size = 0);
+
+        /**
+         * @brief   マップを解除します
+         */
+        void unmap();
+
+        /**
+         * @brief   マップした領域の先頭(パーティションのoffsetの位置), マップしていなければnullptr
+         */
+        const void* data() const { return data_; }
+
+        /**
+         * @brief   マップした領域のバイト数
+         */
+        size_t size() const { return size_; }
+    };
+} // namespace simplevox
+
+#endif // SIMPLEVOX_PARTITION_H_
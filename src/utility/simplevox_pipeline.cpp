@@ -0,0 +1,235 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#include "simplevox_pipeline.h"
+
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+namespace
+{
+    /**
+     * @brief キューの各要素の先頭に付加する情報(この後ろにサウンドデータが続く)
+     */
+    struct FrameHeader
+    {
+        uint32_t generation;        ///< 録音時のVADの世代(判定ごとに増加)
+        simplevox::VadState state;  ///< サウンドデータに対するVADの状態
+        bool is_discontinuous;      ///< 直前に音声区間の候補以降のフレームを破棄した(照合タスクの特徴量を破棄する)
+    };
+
+    constexpr TickType_t kReceiveTimeout = pdMS_TO_TICKS(100);
+}
+
+namespace simplevox
+{
+    bool KwsPipeline::start(KeywordSpotter& spotter, CaptureCallback capture, ResultCallback result,
+                            void* user_data, const PipelineConfig& config)
+    {
+        if (is_running_ || capture == nullptr || result == nullptr || config.queue_length <= 0)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+
+        const auto& vad_config = spotter.config().vad_config;
+        const int input_rate = (config.input_rate > 0) ? config.input_rate : vad_config.sample_rate;
+        if (input_rate != vad_config.sample_rate)
+        {
+            // 10msの入力から常に１フレーム分が出力されるレートに限る
+            DecimatorConfig decimator_config;
+            decimator_config.input_rate = input_rate;
+            decimator_config.output_rate = vad_config.sample_rate;
+            decimator_config.tap_num = config.decimator_tap_num;
+            if (input_rate * vad_config.frame_time_ms % 1000 != 0 || !decimator_.init(decimator_config))
+            {
+                printf("Unsupported input rate: %d\n", input_rate);
+                return false;
+            }
+            input_frame_.reset(new (std::nothrow) int16_t[input_rate * vad_config.frame_time_ms / 1000]);
+            if (!input_frame_)
+            {
+                printf("Failed to create heap\n");
+                release();
+                return false;
+            }
+        }
+
+        const int item_size = sizeof(FrameHeader) + sizeof(int16_t) * vad_config.frame_length();
+        capture_item_.reset(new (std::nothrow) uint8_t[item_size]);
+        process_item_.reset(new (std::nothrow) uint8_t[item_size]);
+        queue_ = xQueueCreate(config.queue_length, item_size);
+        if (!capture_item_ || !process_item_ || queue_ == nullptr)
+        {
+            printf("Failed to create heap\n");
+            release();
+            return false;
+        }
+
+        config_ = config;
+        spotter_ = &spotter;
+        capture_ = capture;
+        result_ = result;
+        user_data_ = user_data;
+        generation_ = 0;
+        requested_generation_ = 0;
+        dropped_frames_ = 0;
+        spotter_->reset();
+
+        is_running_ = true;
+        task_num_ = 2;
+        if (xTaskCreatePinnedToCore(ProcessTask, "svx_process", config.process_stack_size, this,
+                                    config.process_priority, NULL, config.process_core) != pdPASS)
+        {
+            printf("Failed to create task\n");
+            is_running_ = false;
+            task_num_ = 0;
+            release();
+            return false;
+        }
+        if (xTaskCreatePinnedToCore(CaptureTask, "svx_capture", config.capture_stack_size, this,
+                                    config.capture_priority, NULL, config.capture_core) != pdPASS)
+        {
+            printf("Failed to create task\n");
+            task_num_--;
+            stop();
+            return false;
+        }
+        return true;
+    }
+
+    void KwsPipeline::stop()
+    {
+        is_running_ = false;
+        while (task_num_ > 0)
+        {
+            vTaskDelay(1);
+        }
+        release();
+    }
+
+    void KwsPipeline::release()
+    {
+        if (queue_ != nullptr)
+        {
+            vQueueDelete(static_cast<QueueHandle_t>(queue_));
+            queue_ = nullptr;
+        }
+        capture_item_.reset();
+        process_item_.reset();
+        input_frame_.reset();
+        decimator_.deinit();
+    }
+
+    void KwsPipeline::CaptureTask(void* arg)
+    {
+        auto* pipeline = static_cast<KwsPipeline*>(arg);
+        pipeline->captureLoop();
+        pipeline->task_num_--;
+        vTaskDelete(NULL);
+    }
+
+    void KwsPipeline::ProcessTask(void* arg)
+    {
+        auto* pipeline = static_cast<KwsPipeline*>(arg);
+        pipeline->processLoop();
+        pipeline->task_num_--;
+        vTaskDelete(NULL);
+    }
+
+    void KwsPipeline::captureLoop()
+    {
+        auto& vad = spotter_->vad();
+        const auto& vad_config = spotter_->config().vad_config;
+        const int frame_length = vad_config.frame_length();
+        auto* data = reinterpret_cast<int16_t*>(&capture_item_[sizeof(FrameHeader)]);
+        // 変換する場合は録音したフレームから直接キューの要素に書き込む
+        const bool is_decimated = (input_frame_ != nullptr);
+        int16_t* input = is_decimated ? input_frame_.get() : data;
+        const int input_length = is_decimated
+                               ? decimator_.config().input_rate * vad_config.frame_time_ms / 1000
+                               : frame_length;
+        const TickType_t send_timeout = pdMS_TO_TICKS(vad_config.frame_time_ms);
+        bool is_discontinuous = false;
+        while (is_running_)
+        {
+            if (!capture_(input, input_length, user_data_))
+            {
+                vTaskDelay(1);
+                continue;
+            }
+            if (is_decimated)
+            {
+                decimator_.process(input, input_length, data);
+            }
+
+            // 照合タスクで判定が行われた場合はVADをリセットして次の音声区間に備える
+            const uint32_t requested_generation = requested_generation_;
+            if (generation_ != requested_generation)
+            {
+                vad.reset();
+                generation_ = requested_generation;
+            }
+
+            const auto state = vad.process(data);
+            const FrameHeader header = { generation_, state, is_discontinuous };
+            memcpy(capture_item_.get(), &header, sizeof(header));
+
+            // 音声区間の候補以降(Silence以降)のフレームは特徴量になるため、１フレーム分まで空きを待つ
+            const TickType_t timeout = (state >= VadState::Silence) ? send_timeout : 0;
+            if (xQueueSend(static_cast<QueueHandle_t>(queue_), capture_item_.get(), timeout) == pdTRUE)
+            {
+                is_discontinuous = false;
+            }
+            else
+            {
+                dropped_frames_++;
+                if (state >= VadState::Silence)
+                {
+                    // 照合タスクが途切れた音声区間を保持し続けないよう、VADをリセットして次のフレームで通知する
+                    vad.reset();
+                    is_discontinuous = true;
+                }
+            }
+        }
+    }
+
+    void KwsPipeline::processLoop()
+    {
+        const auto* data = reinterpret_cast<const int16_t*>(&process_item_[sizeof(FrameHeader)]);
+        while (is_running_)
+        {
+            if (xQueueReceive(static_cast<QueueHandle_t>(queue_), process_item_.get(), kReceiveTimeout) != pdTRUE)
+            {
+                continue;
+            }
+
+            FrameHeader header;
+            memcpy(&header, process_item_.get(), sizeof(header));
+            if (header.generation != requested_generation_) { continue; }   // リセット前のVADによるフレーム
+            if (header.is_discontinuous)
+            {
+                spotter_->clearFeatures();
+            }
+
+            const auto event = spotter_->process(data, header.state);
+            if (event != KwsEvent::None)
+            {
+                requested_generation_++;
+                result_(event, *spotter_, user_data_);
+            }
+        }
+    }
+
+} // namespace simplevox
@@ -0,0 +1,141 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef SIMPLEVOX_PIPELINE_H_
+#define SIMPLEVOX_PIPELINE_H_
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+#include "simplevox_decimator.h"
+#include "simplevox_kws.h"
+
+namespace simplevox
+{
+    struct PipelineConfig
+    {
+        /**
+         * @brief 録音タスクから照合タスクへ渡すフレーム(VadConfig::frame_length())のキューの長さ
+         * @note 照合(DTW)の間に録音されるフレームを保持できる長さが必要です(16 -> 160ms)
+         */
+        int queue_length = 16;
+
+        /**
+         * @brief 録音のサンプリングレート(32000Hz, 44100Hz, 48000Hzなど), 0の場合はVadConfig::sample_rate
+         * @note VadConfig::sample_rateと異なる場合、録音タスクでDecimatorにより変換してからVADに渡します
+         */
+        int input_rate = 0;
+
+        /**
+         * @brief input_rateから変換する際のデシメータの各フェーズのタップ数(DecimatorConfig::tap_num)
+         */
+        int decimator_tap_num = 64;
+
+        /**
+         * @brief 録音とVADを行うタスクのコア, 優先度, スタックサイズ
+         */
+        int capture_core = 0;
+        int capture_priority = 5;
+        uint32_t capture_stack_size = 4096;
+
+        /**
+         * @brief MFCCの算出と照合を行うタスクのコア, 優先度, スタックサイズ
+         */
+        int process_core = 1;
+        int process_priority = 4;
+        uint32_t process_stack_size = 8192;
+    };
+
+    /**
+     * @brief １フレーム分のサウンドデータを取得するコールバック(録音タスクから呼ばれる)
+     * @param[out]  dest        サウンドデータの格納先
+     * @param[in]   length      サウンドデータの長さ(PipelineConfig::input_rateにおける10ms分, 既定ではVadConfig::frame_length())
+     * @param[in]   user_data   start()で指定したユーザーデータ
+     * @return  取得できた場合はtrue, そうでなければfalse
+     * @note ノイズ抑制などの前処理もここで行います
+     */
+    using CaptureCallback = bool (*)(int16_t* dest, int length, void* user_data);
+
+    /**
+     * @brief 判定結果を通知するコールバック(照合タスクから呼ばれる)
+     * @param[in]   event       判定結果(None以外)
+     * @param[in]   spotter     判定を行ったKeywordSpotter(distance()などの参照用)
+     * @param[in]   user_data   start()で指定したユーザーデータ
+     * @note VADは録音タスクで使用中のため、spotter.reset()やspotter.vad()は呼び出さないでください
+     */
+    using ResultCallback = void (*)(KwsEvent event, KeywordSpotter& spotter, void* user_data);
+
+    using queue_handle_t = void*;
+
+    /**
+     * @brief 録音+VADと、MFCC+DTWを別々のコアのタスクで実行します
+     * @details
+     * 録音タスクはフレームごとにVADを行い、サウンドデータとVADの状態をキューに渡します。
+     * 照合タスクはキューから受け取ったフレームでKeywordSpotter::process(data, state)を呼び出し、
+     * 判定結果をコールバックで通知します。照合に時間がかかっても録音は止まりません。
+     * 判定後のVADのリセットは録音タスクで行われ、リセット前に録音されたフレームは破棄されます。
+     * キューが一杯の場合、音声区間の候補以降(Silence以降)のフレームは１フレーム分まで空きを待ち、それでも破棄した場合は
+     * VADをリセットし、照合タスクは次のフレームで保持している特徴量を破棄します(途切れた音声区間は照合しません)。
+     */
+    class KwsPipeline
+    {
+    private:
+        PipelineConfig config_;
+        KeywordSpotter* spotter_ = nullptr;
+        CaptureCallback capture_ = nullptr;
+        ResultCallback result_ = nullptr;
+        void* user_data_ = nullptr;
+        queue_handle_t queue_ = nullptr;
+        std::unique_ptr<uint8_t[]> capture_item_;
+        std::unique_ptr<uint8_t[]> process_item_;
+        Decimator decimator_;
+        std::unique_ptr<int16_t[]> input_frame_;    ///< 変換前の１フレーム(input_rateがVADと異なる場合のみ)
+        std::atomic<bool> is_running_{false};
+        std::atomic<int> task_num_{0};
+        std::atomic<uint32_t> requested_generation_{0};
+        std::atomic<uint32_t> dropped_frames_{0};
+        uint32_t generation_ = 0;
+
+        static void CaptureTask(void* arg);
+        static void ProcessTask(void* arg);
+        void captureLoop();
+        void processLoop();
+        void release();
+    public:
+        ~KwsPipeline() { stop(); }
+
+        /**
+         * @brief   録音タスクと照合タスクを開始します
+         * @param[in]   spotter     初期化済みのKeywordSpotter(テンプレート設定済みであること)
+         * @param[in]   capture     サウンドデータを取得するコールバック
+         * @param[in]   result      判定結果を通知するコールバック
+         * @param[in]   user_data   コールバックに渡すユーザーデータ
+         * @param[in]   config      コンフィグ
+         * @return 開始に成功したらtrue, 失敗したらfalse
+         * @note    spotterはstop()するまで有効である必要があり、他のタスクから操作しないでください
+         */
+        bool start(KeywordSpotter& spotter, CaptureCallback capture, ResultCallback result,
+                   void* user_data = nullptr, const PipelineConfig& config = PipelineConfig());
+
+        /**
+         * @brief   タスクを終了します(終了するまで待機します)
+         */
+        void stop();
+
+        bool isRunning() const { return is_running_; }
+
+        /**
+         * @brief   キューが一杯で破棄したフレーム数(音声区間の候補以降のフレームを含む場合は音声区間ごと破棄されます)
+         */
+        uint32_t droppedFrames() const { return dropped_frames_; }
+    };
+} // namespace simplevox
+
+#endif // SIMPLEVOX_PIPELINE_H_
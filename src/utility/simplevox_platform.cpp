@@ -0,0 +1,60 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#include "simplevox_platform.h"
+
+#include <stdlib.h>
+
+namespace
+{
+    void* DefaultAllocate(size_t size, uint32_t caps)
+    {
+#if defined(ESP_PLATFORM)
+        return heap_caps_malloc(size, caps);
+#else
+        (void)caps;
+        return malloc(size);
+#endif
+    }
+
+    void DefaultDeallocate(void* ptr)
+    {
+#if defined(ESP_PLATFORM)
+        heap_caps_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+
+    simplevox::platform::Allocator allocator = {DefaultAllocate, DefaultDeallocate};
+}
+
+namespace simplevox
+{
+namespace platform
+{
+    void setAllocator(const Allocator& hook)
+    {
+        allocator.allocate = (hook.allocate != nullptr) ? hook.allocate : DefaultAllocate;
+        allocator.deallocate = (hook.deallocate != nullptr) ? hook.deallocate : DefaultDeallocate;
+    }
+
+    void* allocate(size_t size, uint32_t caps)
+    {
+        return allocator.allocate(size, caps);
+    }
+
+    void deallocate(void* ptr)
+    {
+        if (ptr == nullptr) { return; }
+        allocator.deallocate(ptr);
+    }
+
+} // namespace platform
+} // namespace simplevox
@@ -0,0 +1,185 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef SIMPLEVOX_PLATFORM_H_
+#define SIMPLEVOX_PLATFORM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ESP_PLATFORM)
+#include <esp_heap_caps.h>
+#else
+// ホスト環境ではcapsは区別しないが、コンフィグ等との互換のため同じ値を定義する
+#define MALLOC_CAP_32BIT    (1 << 1)
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT  (1 << 12)
+#endif
+
+/**
+ * @brief プラットフォーム依存の処理(メモリ確保, FFT, VAD, ワーカー)
+ * @details
+ * ESP32(ESP_PLATFORM)ではesp-dsp, ESP-SRおよびheap_caps_malloc()を用い、
+ * それ以外(Linux等のホスト)では移植可能な実装を用います。
+ * MFCCやDTWの演算はプラットフォームによらず共通です。
+ */
+namespace simplevox
+{
+namespace platform
+{
+    /**
+     * @brief メモリ確保のフック
+     * @note いずれかがnullptrの場合は既定の関数(ESP32ではheap_caps_malloc()/heap_caps_free())を用います
+     */
+    struct Allocator
+    {
+        void* (*allocate)(size_t size, uint32_t caps);
+        void (*deallocate)(void* ptr);
+    };
+
+    /**
+     * @brief   ライブラリが用いるメモリ確保の関数を差し替えます
+     * @param[in]   allocator   メモリ確保のフック
+     * @note    確保済みの領域の解放にも用いられるため、各エンジンの初期化前に設定してください
+     */
+    void setAllocator(const Allocator& allocator);
+
+    /**
+     * @brief   メモリを確保します
+     * @param[in]   size    バイト数
+     * @param[in]   caps    メモリの種類(heap_caps_malloc()のcaps)
+     * @return  確保した領域, 失敗したらnullptr
+     */
+    void* allocate(size_t size, uint32_t caps);
+
+    /**
+     * @brief   allocate()で確保したメモリを解放します
+     */
+    void deallocate(void* ptr);
+
+    /**
+     * @brief   実数FFT(fc32)の初期化済みか
+     */
+    bool isFftFc32Initialized();
+
+    /**
+     * @brief   実数FFT(fc32)のテーブルを作成します
+     * @param[in]   max_fft_num 最大のFFT点数(2のべき乗)
+     * @return  成功したらtrue, 失敗したらfalse
+     */
+    bool initFftFc32(int max_fft_num);
+
+    /**
+     * @brief   実数FFT(fc32)のテーブルを破棄します
+     */
+    void deinitFftFc32();
+
+    /**
+     * @brief   実数信号のFFTを行います
+     * @details
+     * 結果はfft_num / 2個の複素数(実部, 虚部の順)としてdataに格納されます(スケーリングなし)。
+     * ただし直流成分の虚部(data[1])にはナイキスト周波数の成分が格納されます。
+     * @param[in,out]   data    fft_num点の実数信号
+     * @param[in]       fft_num FFT点数(initFftFc32()に指定した値以下)
+     */
+    void calcRealFftFc32(float* data, int fft_num);
+
+    /**
+     * @brief   複素FFT(sc16)の初期化済みか
+     */
+    bool isFftSc16Initialized();
+
+    /**
+     * @brief   複素FFT(sc16)のテーブルを作成します
+     * @param[in]   max_point_num   最大の複素数の点数(2のべき乗)
+     * @return  成功したらtrue, 失敗したらfalse
+     */
+    bool initFftSc16(int max_point_num);
+
+    /**
+     * @brief   複素FFT(sc16)のテーブルを破棄します
+     */
+    void deinitFftSc16();
+
+    /**
+     * @brief   16bit固定小数点の複素FFTを行います
+     * @details 各段で1/2にスケーリングされ, 結果は周波数順に並べ直されて格納されます
+     * @param[in,out]   data        point_num個の複素数(実部, 虚部の順)
+     * @param[in]       point_num   複素数の点数(initFftSc16()に指定した値以下)
+     */
+    void calcFftSc16(int16_t* data, int point_num);
+
+    /**
+     * @brief   処理時間の計測に用いるカウンタ(ESP32ではCPUのサイクル数)
+     * @note    ホスト環境ではx86のTSCまたはナノ秒のため、周波数の異なる環境間では比較できません
+     */
+    uint32_t cycleCount();
+
+    /**
+     * @brief   VADを作成します
+     * @param[in]   mode        判定の厳しさ(0から4)
+     * @param[in]   sample_rate サンプリングレート
+     * @return  VADのハンドル, 失敗したらnullptr
+     */
+    void* createVad(int mode, int sample_rate);
+
+    /**
+     * @brief   VADを破棄します
+     */
+    void destroyVad(void* handle);
+
+    /**
+     * @brief   １フレームの音声判定を行います
+     * @param[in]   handle          createVad()で作成したハンドル
+     * @param[in]   data            サウンドデータ
+     * @param[in]   sample_rate     サンプリングレート
+     * @param[in]   frame_time_ms   フレームの時間
+     * @return  音声ありならtrue
+     */
+    bool detectVoice(void* handle, const int16_t* data, int sample_rate, int frame_time_ms);
+
+    /**
+     * @brief   ワーカーで実行する処理
+     */
+    using WorkerJob = void (*)(void* arg);
+
+    /**
+     * @brief   処理を並列に実行するワーカー(ESP32ではコアを指定したタスク, ホスト環境ではスレッド)を作成します
+     * @param[in]   core        タスクを実行するコア(コア数で剰余をとる), 負の場合は指定なし(ホスト環境では無視)
+     * @param[in]   priority    タスクの優先度(ホスト環境では無視)
+     * @param[in]   stack_size  タスクのスタックサイズ(ホスト環境では無視)
+     * @return  ワーカーのハンドル, 失敗したらnullptr
+     */
+    void* createWorker(int core, int priority, uint32_t stack_size);
+
+    /**
+     * @brief   ワーカーを破棄します(実行中の処理があれば完了を待ちます)
+     */
+    void destroyWorker(void* worker);
+
+    /**
+     * @brief   ワーカーで処理を開始します(完了はwaitWorker()で待ちます)
+     * @param[in]   worker  createWorker()で作成したハンドル
+     * @param[in]   job     実行する処理
+     * @param[in]   arg     jobに渡す引数
+     */
+    void startWorker(void* worker, WorkerJob job, void* arg);
+
+    /**
+     * @brief   startWorker()で開始した処理の完了を待ちます(完了を待っていない処理がない場合は何もしません)
+     */
+    void waitWorker(void* worker);
+
+} // namespace platform
+} // namespace simplevox
+
+#endif // SIMPLEVOX_PLATFORM_H_
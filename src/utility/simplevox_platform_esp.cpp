@@ -0,0 +1,187 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#if defined(ESP_PLATFORM)
+
+#include "simplevox_platform.h"
+
+#include <new>
+
+#include <esp_cpu.h>
+#include <esp_dsp.h>
+#include <esp_idf_version.h>
+#include <esp_vad.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+namespace
+{
+    constexpr vad_mode_t kVadModes[] = {VAD_MODE_0, VAD_MODE_1, VAD_MODE_2, VAD_MODE_3, VAD_MODE_4};
+}
+
+namespace simplevox
+{
+namespace platform
+{
+    bool isFftFc32Initialized()
+    {
+        return dsps_fft4r_initialized != 0;
+    }
+
+    bool initFftFc32(int max_fft_num)
+    {
+        return dsps_fft4r_init_fc32(NULL, max_fft_num / 2) == ESP_OK;
+    }
+
+    void deinitFftFc32()
+    {
+        dsps_fft4r_deinit_fc32();
+    }
+
+    void calcRealFftFc32(float* data, int fft_num)
+    {
+        dsps_fft4r_fc32(data, fft_num / 2);
+        dsps_bit_rev4r_fc32(data, fft_num / 2);
+        dsps_cplx2real_fc32(data, fft_num / 2);
+    }
+
+    bool isFftSc16Initialized()
+    {
+        return dsps_fft2r_sc16_initialized != 0;
+    }
+
+    bool initFftSc16(int max_point_num)
+    {
+        return dsps_fft2r_init_sc16(NULL, max_point_num) == ESP_OK;
+    }
+
+    void deinitFftSc16()
+    {
+        dsps_fft2r_deinit_sc16();
+    }
+
+    void calcFftSc16(int16_t* data, int point_num)
+    {
+        dsps_fft2r_sc16(data, point_num);
+        dsps_bit_rev_sc16_ansi(data, point_num);
+    }
+
+    uint32_t cycleCount()
+    {
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+        return esp_cpu_get_cycle_count();
+#else
+        return esp_cpu_get_ccount();
+#endif
+    }
+
+    void* createVad(int mode, int sample_rate)
+    {
+        (void)sample_rate;
+        if (mode < 0 || mode >= (int)(sizeof(kVadModes) / sizeof(kVadModes[0])))
+        {
+            return nullptr;
+        }
+        return vad_create(kVadModes[mode]);
+    }
+
+    void destroyVad(void* handle)
+    {
+        vad_destroy((vad_handle_t)handle);
+    }
+
+    bool detectVoice(void* handle, const int16_t* data, int sample_rate, int frame_time_ms)
+    {
+        return VAD_SPEECH == vad_process((vad_handle_t)handle, (int16_t*)data, sample_rate, frame_time_ms);
+    }
+
+    /**
+     * @brief ワーカーのタスク, startの通知ごとにjobを実行し、doneで完了を通知する
+     */
+    struct EspWorker
+    {
+        TaskHandle_t task = nullptr;
+        SemaphoreHandle_t start = nullptr;
+        SemaphoreHandle_t done = nullptr;
+        WorkerJob job = nullptr;
+        void* arg = nullptr;
+        bool is_pending = false;    ///< startWorker()後にwaitWorker()していない処理があるか(呼び出し側のみが使用)
+    };
+
+    void WorkerTask(void* arg)
+    {
+        auto* worker = static_cast<EspWorker*>(arg);
+        while (true)
+        {
+            xSemaphoreTake(worker->start, portMAX_DELAY);
+            if (worker->job == nullptr) { break; }     // destroyWorker()
+            worker->job(worker->arg);
+            xSemaphoreGive(worker->done);
+        }
+        xSemaphoreGive(worker->done);
+        vTaskDelete(NULL);
+    }
+
+    void* createWorker(int core, int priority, uint32_t stack_size)
+    {
+        auto* worker = new (std::nothrow) EspWorker();
+        if (worker == nullptr) { return nullptr; }
+        worker->start = xSemaphoreCreateBinary();
+        worker->done = xSemaphoreCreateBinary();
+        if (worker->start == nullptr || worker->done == nullptr
+            || xTaskCreatePinnedToCore(WorkerTask, "svx_worker", stack_size, worker, priority, &worker->task,
+                                       (core < 0) ? tskNO_AFFINITY : core % portNUM_PROCESSORS) != pdPASS)
+        {
+            if (worker->start != nullptr) { vSemaphoreDelete(worker->start); }
+            if (worker->done != nullptr) { vSemaphoreDelete(worker->done); }
+            delete worker;
+            return nullptr;
+        }
+        return worker;
+    }
+
+    void destroyWorker(void* handle)
+    {
+        auto* worker = static_cast<EspWorker*>(handle);
+        if (worker == nullptr) { return; }
+        // doneはバイナリセマフォのため、実行中の処理の完了を受け取ってから終了を指示する
+        if (worker->is_pending)
+        {
+            waitWorker(worker);
+        }
+        worker->job = nullptr;
+        xSemaphoreGive(worker->start);
+        xSemaphoreTake(worker->done, portMAX_DELAY);
+        vSemaphoreDelete(worker->start);
+        vSemaphoreDelete(worker->done);
+        delete worker;
+    }
+
+    void startWorker(void* handle, WorkerJob job, void* arg)
+    {
+        auto* worker = static_cast<EspWorker*>(handle);
+        worker->job = job;
+        worker->arg = arg;
+        worker->is_pending = true;
+        xSemaphoreGive(worker->start);
+    }
+
+    void waitWorker(void* handle)
+    {
+        auto* worker = static_cast<EspWorker*>(handle);
+        if (!worker->is_pending) { return; }
+        xSemaphoreTake(worker->done, portMAX_DELAY);
+        worker->is_pending = false;
+    }
+
+} // namespace platform
+} // namespace simplevox
+
+#endif // defined(ESP_PLATFORM)
@@ -0,0 +1,392 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#if !defined(ESP_PLATFORM)
+
+#include "simplevox_platform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace
+{
+    constexpr double kPi = 3.14159265358979323846;
+
+    /**
+     * @brief 実数FFT(fc32)の回転因子 e^{-2πik/N} (cos, sinの順, k = 0..N/2-1)
+     */
+    std::unique_ptr<float[]> fc32_table;
+    int fc32_table_size = 0;
+
+    /**
+     * @brief 複素FFT(sc16)の回転因子(Q15, ビット反転順, esp-dspのdsps_gen_w_r2_sc16()と同じ)
+     */
+    std::unique_ptr<int16_t[]> sc16_table;
+    int sc16_table_size = 0;
+
+    template <typename T>
+    void BitReverse(T* data, int point_num)
+    {
+        for (int i = 1, j = 0; i < point_num - 1; i++)
+        {
+            int k = point_num >> 1;
+            while (k <= j)
+            {
+                j -= k;
+                k >>= 1;
+            }
+            j += k;
+            if (i < j)
+            {
+                std::swap(data[2 * i], data[2 * j]);
+                std::swap(data[2 * i + 1], data[2 * j + 1]);
+            }
+        }
+    }
+
+    /**
+     * @brief esp-dspのANSI実装(dsps_fft2r_sc16_ansi)と同じバタフライ演算
+     * @details a0 * 2^15 ± (a1 * a2 ± a3 * a4) を2^16で割る(各段で1/2にスケーリング)
+     */
+    inline int16_t Butterfly(int16_t a0, int32_t product)
+    {
+        const int32_t result = (int32_t)((int64_t)a0 * (1 << 15) + product);
+        return (int16_t)(result >> 16);
+    }
+
+    // 雑音レベルの追従の速さ(1/2^shift), 音声判定中もごく緩やかに上昇させて定常的な雑音の変化に追従する
+    constexpr int kNoiseRiseShift = 7;
+    constexpr int kNoiseFallShift = 2;
+    constexpr int kSpeechRiseShift = 10;
+    constexpr uint32_t kMinSpeechEnergy = 1000; ///< 音声とみなす最小の平均二乗値
+    constexpr int kMarginDb[] = {6, 9, 12, 15, 18};
+
+    /**
+     * @brief ホスト用のVAD(雑音レベルに対するフレームのエネルギー比で判定する)
+     */
+    struct EnergyVad
+    {
+        uint32_t ratio;         ///< 雑音レベルに対するしきい値の比(256倍したもの)
+        uint32_t noise_energy;  ///< 推定した雑音レベル(フレームの平均二乗値)
+        bool has_noise_energy;
+    };
+
+    void TrackNoise(EnergyVad* vad, uint32_t energy, int rise_shift)
+    {
+        if (energy > vad->noise_energy)
+        {
+            vad->noise_energy += (energy - vad->noise_energy + (1u << rise_shift) - 1) >> rise_shift;
+        }
+        else
+        {
+            vad->noise_energy -= (vad->noise_energy - energy) >> kNoiseFallShift;
+        }
+    }
+}
+
+namespace simplevox
+{
+namespace platform
+{
+    bool isFftFc32Initialized()
+    {
+        return fc32_table != nullptr;
+    }
+
+    bool initFftFc32(int max_fft_num)
+    {
+        if (fc32_table || max_fft_num < 4 || (max_fft_num & (max_fft_num - 1)) != 0)
+        {
+            return false;
+        }
+        fc32_table.reset(new (std::nothrow) float[max_fft_num]);
+        if (!fc32_table) { return false; }
+        for (int k = 0; k < max_fft_num / 2; k++)
+        {
+            const double angle = 2 * kPi * k / max_fft_num;
+            fc32_table[2 * k] = cos(angle);
+            fc32_table[2 * k + 1] = sin(angle);
+        }
+        fc32_table_size = max_fft_num;
+        return true;
+    }
+
+    void deinitFftFc32()
+    {
+        fc32_table.reset();
+        fc32_table_size = 0;
+    }
+
+    void calcRealFftFc32(float* data, int fft_num)
+    {
+        // 実数信号をfft_num / 2点の複素信号とみなしてFFTを行い, 偶数番目と奇数番目のスペクトルに分離する
+        const int point_num = fft_num / 2;
+        const int stride = fc32_table_size / fft_num;
+        const float* w = fc32_table.get();
+        BitReverse(data, point_num);
+        for (int length = 2; length <= point_num; length <<= 1)
+        {
+            const int half = length / 2;
+            const int step = 2 * stride * (point_num / length);
+            for (int i = 0; i < point_num; i += length)
+            {
+                for (int k = 0; k < half; k++)
+                {
+                    const float c = w[2 * k * step];
+                    const float s = w[2 * k * step + 1];
+                    float* a = &data[2 * (i + k)];
+                    float* b = &data[2 * (i + k + half)];
+                    const float re = c * b[0] + s * b[1];
+                    const float im = c * b[1] - s * b[0];
+                    b[0] = a[0] - re;
+                    b[1] = a[1] - im;
+                    a[0] += re;
+                    a[1] += im;
+                }
+            }
+        }
+
+        const float dc_re = data[0];
+        const float dc_im = data[1];
+        data[0] = dc_re + dc_im;
+        data[1] = dc_re - dc_im;    // ナイキスト周波数の成分
+        for (int k = 1; k <= point_num / 2; k++)
+        {
+            float* x0 = &data[2 * k];
+            float* x1 = &data[2 * (point_num - k)];
+            // even = (Z[k] + conj(Z[N-k])) / 2, odd = (Z[k] - conj(Z[N-k])) / 2j
+            const float even_re = 0.5f * (x0[0] + x1[0]);
+            const float even_im = 0.5f * (x0[1] - x1[1]);
+            const float odd_re = 0.5f * (x0[1] + x1[1]);
+            const float odd_im = -0.5f * (x0[0] - x1[0]);
+            const float c = w[2 * k * stride];
+            const float s = w[2 * k * stride + 1];
+            const float re = c * odd_re + s * odd_im;
+            const float im = c * odd_im - s * odd_re;
+            // X[k] = even + W^k odd, X[N-k] = conj(even - W^k odd)
+            x1[0] = even_re - re;
+            x1[1] = im - even_im;
+            x0[0] = even_re + re;
+            x0[1] = even_im + im;
+        }
+    }
+
+    bool isFftSc16Initialized()
+    {
+        return sc16_table != nullptr;
+    }
+
+    bool initFftSc16(int max_point_num)
+    {
+        if (sc16_table || max_point_num < 2 || (max_point_num & (max_point_num - 1)) != 0)
+        {
+            return false;
+        }
+        sc16_table.reset(new (std::nothrow) int16_t[max_point_num]);
+        if (!sc16_table) { return false; }
+        const float e = kPi * 2.0 / max_point_num;
+        for (int i = 0; i < max_point_num / 2; i++)
+        {
+            sc16_table[2 * i] = (int16_t)(INT16_MAX * cosf(i * e));
+            sc16_table[2 * i + 1] = (int16_t)(INT16_MAX * sinf(i * e));
+        }
+        BitReverse(sc16_table.get(), max_point_num / 2);
+        sc16_table_size = max_point_num;
+        return true;
+    }
+
+    void deinitFftSc16()
+    {
+        sc16_table.reset();
+        sc16_table_size = 0;
+    }
+
+    void calcFftSc16(int16_t* data, int point_num)
+    {
+        // ビット反転順の回転因子を用いるため先頭から必要な個数を参照すればよい(テーブルの大きさによらない)
+        const int16_t* w = sc16_table.get();
+        int group_num = 1;
+        for (int half = point_num / 2; half > 0; half >>= 1)
+        {
+            int a = 0;
+            for (int j = 0; j < group_num; j++)
+            {
+                const int16_t c = w[2 * j];
+                const int16_t s = w[2 * j + 1];
+                for (int i = 0; i < half; i++)
+                {
+                    const int m = a + half;
+                    const int16_t a_re = data[2 * a];
+                    const int16_t a_im = data[2 * a + 1];
+                    const int16_t m_re = data[2 * m];
+                    const int16_t m_im = data[2 * m + 1];
+                    const int32_t re = (int32_t)c * m_re + (int32_t)s * m_im;
+                    const int32_t im = (int32_t)c * m_im - (int32_t)s * m_re;
+                    data[2 * m] = Butterfly(a_re, -re);
+                    data[2 * m + 1] = Butterfly(a_im, -im);
+                    data[2 * a] = Butterfly(a_re, re);
+                    data[2 * a + 1] = Butterfly(a_im, im);
+                    a++;
+                }
+                a += half;
+            }
+            group_num <<= 1;
+        }
+        BitReverse(data, point_num);
+    }
+
+    uint32_t cycleCount()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return (uint32_t)__rdtsc();
+#else
+        return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    void* createVad(int mode, int sample_rate)
+    {
+        (void)sample_rate;
+        if (mode < 0 || mode >= (int)(sizeof(kMarginDb) / sizeof(kMarginDb[0])))
+        {
+            return nullptr;
+        }
+        auto* vad = new (std::nothrow) EnergyVad();
+        if (vad == nullptr) { return nullptr; }
+        vad->ratio = 256 * powf(10.0f, kMarginDb[mode] / 10.0f);
+        vad->noise_energy = 0;
+        vad->has_noise_energy = false;
+        return vad;
+    }
+
+    void destroyVad(void* handle)
+    {
+        delete static_cast<EnergyVad*>(handle);
+    }
+
+    bool detectVoice(void* handle, const int16_t* data, int sample_rate, int frame_time_ms)
+    {
+        auto* vad = static_cast<EnergyVad*>(handle);
+        const int length = frame_time_ms * sample_rate / 1000;
+        uint64_t sum = 0;
+        for (int i = 0; i < length; i++)
+        {
+            sum += (int32_t)data[i] * data[i];
+        }
+        const uint32_t energy = sum / std::max(length, 1);
+        if (!vad->has_noise_energy)
+        {
+            vad->noise_energy = energy;
+            vad->has_noise_energy = true;
+            return false;
+        }
+
+        const bool is_speech = energy >= kMinSpeechEnergy
+                            && (uint64_t)energy * 256 > (uint64_t)vad->noise_energy * vad->ratio;
+        TrackNoise(vad, energy, is_speech ? kSpeechRiseShift : kNoiseRiseShift);
+        return is_speech;
+    }
+
+    /**
+     * @brief ワーカーのスレッド, jobが設定されるごとに実行し、完了したらnullptrに戻す
+     */
+    struct HostWorker
+    {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cond;
+        WorkerJob job = nullptr;
+        void* arg = nullptr;
+        bool is_exiting = false;
+    };
+
+    void WorkerThread(HostWorker* worker)
+    {
+        std::unique_lock<std::mutex> lock(worker->mutex);
+        while (true)
+        {
+            worker->cond.wait(lock, [worker]() { return worker->job != nullptr || worker->is_exiting; });
+            if (worker->job == nullptr) { break; }
+
+            const WorkerJob job = worker->job;
+            void* arg = worker->arg;
+            lock.unlock();
+            job(arg);
+            lock.lock();
+            worker->job = nullptr;
+            worker->cond.notify_all();
+        }
+    }
+
+    void* createWorker(int core, int priority, uint32_t stack_size)
+    {
+        (void)core;
+        (void)priority;
+        (void)stack_size;
+        auto* worker = new (std::nothrow) HostWorker();
+        if (worker == nullptr) { return nullptr; }
+        try
+        {
+            worker->thread = std::thread(WorkerThread, worker);
+        }
+        catch (...)
+        {
+            delete worker;
+            return nullptr;
+        }
+        return worker;
+    }
+
+    void destroyWorker(void* handle)
+    {
+        auto* worker = static_cast<HostWorker*>(handle);
+        if (worker == nullptr) { return; }
+        waitWorker(worker);
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->is_exiting = true;
+        }
+        worker->cond.notify_all();
+        worker->thread.join();
+        delete worker;
+    }
+
+    void startWorker(void* handle, WorkerJob job, void* arg)
+    {
+        auto* worker = static_cast<HostWorker*>(handle);
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->job = job;
+            worker->arg = arg;
+        }
+        worker->cond.notify_all();
+    }
+
+    void waitWorker(void* handle)
+    {
+        auto* worker = static_cast<HostWorker*>(handle);
+        std::unique_lock<std::mutex> lock(worker->mutex);
+        worker->cond.wait(lock, [worker]() { return worker->job == nullptr; });
+    }
+
+} // namespace platform
+} // namespace simplevox
+
+#endif // !defined(ESP_PLATFORM)
@@ -0,0 +1,158 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#include "simplevox_ring.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+#include "simplevox_platform.h"
+
+namespace simplevox
+{
+    bool AudioRing::init(int capacity, int max_span, uint32_t caps)
+    {
+        if (buffer_ != nullptr || capacity <= 0 || max_span <= 0 || max_span > capacity)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+
+        buffer_ = (int16_t*)platform::allocate(sizeof(*buffer_) * (capacity + max_span), caps);
+        if (buffer_ == nullptr)
+        {
+            printf("Failed to create heap\n");
+            return false;
+        }
+        capacity_ = capacity;
+        max_span_ = max_span;
+        reset();
+        return true;
+    }
+
+    void AudioRing::deinit()
+    {
+        if (buffer_ == nullptr) { return; }
+        platform::deallocate(buffer_);
+        buffer_ = nullptr;
+        capacity_ = 0;
+        max_span_ = 0;
+    }
+
+    void AudioRing::reset()
+    {
+        write_count_ = 0;
+        read_count_ = 0;
+        overrun_count_ = 0;
+        reservation_num_ = 0;
+        reserved_length_ = 0;
+    }
+
+    // 位置は0 ~ 2 * capacity_ - 1で巡回させ、満杯(差がcapacity_)と空(差が0)を区別する
+    int AudioRing::advance(int count, int length) const
+    {
+        count += length;
+        return (count >= 2 * capacity_) ? count - 2 * capacity_ : count;
+    }
+
+    int AudioRing::usedLength(int write_count, int read_count) const
+    {
+        const int used = write_count - read_count;
+        return (used < 0) ? used + 2 * capacity_ : used;
+    }
+
+    int AudioRing::available() const
+    {
+        return usedLength(write_count_.load(std::memory_order_acquire), read_count_.load(std::memory_order_acquire));
+    }
+
+    int16_t* AudioRing::acquireWrite(int length)
+    {
+        if (buffer_ == nullptr || length <= 0 || length > max_span_
+            || reservation_num_ >= kMaxReservationNum)
+        {
+            return nullptr;
+        }
+
+        const int write_count = write_count_.load(std::memory_order_relaxed);
+        const int read_count = read_count_.load(std::memory_order_acquire);
+        if (capacity_ - usedLength(write_count, read_count) - reserved_length_ < length)
+        {
+            overrun_count_.fetch_add(length, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        const int position = advance(write_count, reserved_length_) % capacity_;
+        reservations_[reservation_num_++] = length;
+        reserved_length_ += length;
+        return &buffer_[position];
+    }
+
+    void AudioRing::commitWrite()
+    {
+        if (reservation_num_ <= 0) { return; }
+        const int length = reservations_[0];
+
+        const int write_count = write_count_.load(std::memory_order_relaxed);
+        const int begin = write_count % capacity_;
+        const int end = begin + length;
+        if (end > capacity_)
+        {
+            // ミラー領域に書き込まれた折り返し部分を先頭に複製する
+            std::copy(&buffer_[capacity_], &buffer_[end], buffer_);
+        }
+        if (begin < max_span_)
+        {
+            // 先頭max_span_の範囲は折り返しをまたいで読み出せるようにミラー領域に複製する
+            std::copy(&buffer_[begin], &buffer_[std::min(std::min(end, capacity_), max_span_)], &buffer_[capacity_ + begin]);
+        }
+
+        std::copy(&reservations_[1], &reservations_[reservation_num_], reservations_);
+        reservation_num_--;
+        reserved_length_ -= length;
+        write_count_.store(advance(write_count, length), std::memory_order_release);
+    }
+
+    void AudioRing::cancelWrite()
+    {
+        if (reservation_num_ <= 0) { return; }
+        reservation_num_--;
+        reserved_length_ -= reservations_[reservation_num_];
+    }
+
+    bool AudioRing::write(const int16_t* data, int length)
+    {
+        if (reservation_num_ > 0) { return false; }    // 予約中の領域より先には書き込めない
+        auto* dest = acquireWrite(length);
+        if (dest == nullptr) { return false; }
+        std::copy_n(data, length, dest);
+        commitWrite();
+        return true;
+    }
+
+    int16_t* AudioRing::acquireRead(int length)
+    {
+        if (buffer_ == nullptr || length <= 0 || length > max_span_) { return nullptr; }
+
+        const int read_count = read_count_.load(std::memory_order_relaxed);
+        const int write_count = write_count_.load(std::memory_order_acquire);
+        if (usedLength(write_count, read_count) < length) { return nullptr; }
+        return &buffer_[read_count % capacity_];
+    }
+
+    void AudioRing::releaseRead(int length)
+    {
+        const int read_count = read_count_.load(std::memory_order_relaxed);
+        const int write_count = write_count_.load(std::memory_order_acquire);
+        length = std::min(length, usedLength(write_count, read_count));
+        if (length <= 0) { return; }
+        read_count_.store(advance(read_count, length), std::memory_order_release);
+    }
+
+} // namespace simplevox
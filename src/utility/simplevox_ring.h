@@ -0,0 +1,119 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef SIMPLEVOX_RING_H_
+#define SIMPLEVOX_RING_H_
+
+#include <atomic>
+#include <stdint.h>
+
+namespace simplevox
+{
+    /**
+     * @brief 単一の書き込み側と単一の読み出し側で共有するロックフリーのリングバッファ
+     * @details
+     * 書き込み側(I2SのDMAやISR、録音タスク)と読み出し側(VADやMFCCの処理タスク)が
+     * それぞれ１つであれば、ロックなしで同時に使用できます。
+     * リングの末尾にmax_span分のミラー領域を持つため、max_span以下の範囲は
+     * 折り返し位置をまたぐ場合でも連続した領域として書き込み及び読み出しができます(コピー不要)。
+     * 書き込み側と読み出し側の関数はそれぞれ同じタスク(またはISR)から呼び出してください。
+     */
+    class AudioRing
+    {
+    private:
+        int16_t* buffer_ = nullptr;
+        int capacity_ = 0;
+        int max_span_ = 0;
+        std::atomic<int> write_count_{0};   ///< 書き込み済みの位置(0 ~ 2 * capacity_ - 1)
+        std::atomic<int> read_count_{0};    ///< 読み出し済みの位置(0 ~ 2 * capacity_ - 1)
+        std::atomic<uint32_t> overrun_count_{0};
+        // 以下は書き込み側のみが使用する
+        static constexpr int kMaxReservationNum = 4;
+        int reservations_[kMaxReservationNum];  ///< 予約の長さ(古い順)
+        int reservation_num_ = 0;
+        int reserved_length_ = 0;
+
+        int advance(int count, int length) const;
+        int usedLength(int write_count, int read_count) const;
+    public:
+        ~AudioRing() { deinit(); }
+
+        /**
+         * @brief   初期化処理を行います
+         * @param[in]   capacity    保持できるサンプル数
+         * @param[in]   max_span    一度に書き込み及び読み出しを行う最大のサンプル数(capacity以下)
+         * @param[in]   caps        heap_caps_malloc()に指定するメモリの種類(DMAで書き込む場合はMALLOC_CAP_DMAを含める)
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         */
+        bool init(int capacity, int max_span, uint32_t caps);
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   保持しているデータと予約を破棄します(書き込み側, 読み出し側ともに停止中に呼び出すこと)
+         */
+        void reset();
+
+        int capacity() const { return capacity_; }
+
+        /**
+         * @brief   読み出し可能なサンプル数
+         */
+        int available() const;
+
+        /**
+         * @brief   空きがなく書き込めなかったサンプル数の累計
+         */
+        uint32_t overrunCount() const { return overrun_count_; }
+
+        /**
+         * @brief   [書き込み側] 書き込み先の領域を予約します
+         * @param[in]   length  サンプル数(max_span以下)
+         * @return  書き込み先(length個の連続した領域), 空きが足りない場合はnullptr(overrunCount()に加算)
+         * @note
+         * 予約は4つまで重ねることができ(DMAのダブルバッファなど)、commitWrite()で予約した順に確定されます。
+         * 予約数の上限を超える場合もnullptrを返します(overrunCount()には加算しない)。
+         */
+        int16_t* acquireWrite(int length);
+
+        /**
+         * @brief   [書き込み側] 最も古い予約を確定し、読み出し側に公開します
+         */
+        void commitWrite();
+
+        /**
+         * @brief   [書き込み側] 最も新しい予約を取り消します
+         */
+        void cancelWrite();
+
+        /**
+         * @brief   [書き込み側] データをコピーして書き込みます
+         * @return  書き込めた場合はtrue, 空きが足りない場合はfalse(overrunCount()に加算)
+         */
+        bool write(const int16_t* data, int length);
+
+        /**
+         * @brief   [読み出し側] 最も古いデータを参照します
+         * @param[in]   length  サンプル数(max_span以下)
+         * @return  データ(length個の連続した領域), 足りない場合はnullptr
+         * @note    releaseRead()するまでは書き込み側に上書きされないため、その場で加工しても構いません
+         */
+        int16_t* acquireRead(int length);
+
+        /**
+         * @brief   [読み出し側] 最も古いデータからlength個を解放し、書き込み側に返却します
+         */
+        void releaseRead(int length);
+    };
+} // namespace simplevox
+
+#endif // SIMPLEVOX_RING_H_
@@ -0,0 +1,451 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#include "simplevox_sdtw.h"
+
+#include <algorithm>
+#include <math.h>
+#include <new>
+#include <stdio.h>
+
+#include "simplevox_dtw.h"
+
+namespace
+{
+    constexpr uint32_t kUnreachable = UINT32_MAX;
+    constexpr int kNormalizeCoef = 1000;
+}
+
+namespace simplevox
+{
+    bool SubsequenceDtw::init(const MfccFeature* const* templates, int num, const SubsequenceDtwConfig& config)
+    {
+        return initTemplates(templates, num, config);
+    }
+
+    bool SubsequenceDtw::init(const MfccFeatureView* const* templates, int num, const SubsequenceDtwConfig& config)
+    {
+        return initTemplates(templates, num, config);
+    }
+
+    template <class T>
+    bool SubsequenceDtw::initTemplates(const T* const* templates, int num, const SubsequenceDtwConfig& config)
+    {
+        if (num <= 0 || templates == nullptr || config.normalize_frame_num <= 0)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+
+        const int coef_num = templates[0]->dimension();
+        int total_length = 0;
+        int max_length = 0;
+        for (int k = 0; k < num; k++)
+        {
+            if (templates[k]->dimension() != coef_num || templates[k]->size() <= 0)
+            {
+                printf("Argument error\n");
+                return false;
+            }
+            total_length += templates[k]->size();
+            max_length = std::max(max_length, templates[k]->size());
+        }
+
+        templates_.reset(new (std::nothrow) MfccFeatureView[num]);
+        offsets_.reset(new (std::nothrow) int[num]);
+        inverse_norms_.reset(new (std::nothrow) float[total_length]);
+        step_distances_.reset(new (std::nothrow) uint32_t[total_length]);
+        step_counts_.reset(new (std::nothrow) int16_t[total_length]);
+        begin_frames_.reset(new (std::nothrow) int32_t[total_length]);
+        inner_row_.reset(new (std::nothrow) int[max_length]);
+        frame_.reset(new (std::nothrow) int16_t[coef_num]);
+        if (!templates_ || !offsets_ || !inverse_norms_ || !step_distances_
+            || !step_counts_ || !begin_frames_ || !inner_row_ || !frame_)
+        {
+            printf("Failed to create heap\n");
+            deinit();
+            return false;
+        }
+
+        int offset = 0;
+        for (int k = 0; k < num; k++)
+        {
+            templates_[k] = MfccFeatureView(*templates[k]);
+            offsets_[k] = offset;
+            detail::SetupInverseNorms(*templates[k], &inverse_norms_[offset]);
+            offset += templates[k]->size();
+        }
+
+        config_ = config;
+        template_num_ = num;
+        coef_num_ = coef_num;
+        reset();
+        return true;
+    }
+
+    void SubsequenceDtw::deinit()
+    {
+        templates_.reset();
+        offsets_.reset();
+        inverse_norms_.reset();
+        step_distances_.reset();
+        step_counts_.reset();
+        begin_frames_.reset();
+        inner_row_.reset();
+        frame_.reset();
+        template_num_ = 0;
+    }
+
+    void SubsequenceDtw::reset()
+    {
+        if (template_num_ > 0)
+        {
+            const int total_length = offsets_[template_num_ - 1] + templates_[template_num_ - 1].size();
+            std::fill_n(step_distances_.get(), total_length, kUnreachable);
+            std::fill_n(step_counts_.get(), total_length, 0);
+            std::fill_n(begin_frames_.get(), total_length, 0);
+        }
+        frame_count_ = 0;
+        mean_ = 0;
+        square_mean_ = 0;
+    }
+
+    int SubsequenceDtw::push(const float* mfcc)
+    {
+        if (template_num_ <= 0) { return -1; }
+
+        // 指数移動平均で平均と二乗平均を更新する(入力が時定数に満たない間は累積平均)
+        float sum_val = 0;
+        float square_sum = 0;
+        for (int i = 0; i < coef_num_; i++)
+        {
+            sum_val += mfcc[i];
+            square_sum += mfcc[i] * mfcc[i];
+        }
+        const float rate = 1.0f / std::min(frame_count_ + 1, config_.normalize_frame_num);
+        mean_ += rate * (sum_val / coef_num_ - mean_);
+        square_mean_ += rate * (square_sum / coef_num_ - square_mean_);
+
+        const float variance = square_mean_ - mean_ * mean_;
+        const float stddev = (variance < __FLT_EPSILON__) ? 1 : sqrtf(variance);
+        for (int i = 0; i < coef_num_; i++)
+        {
+            const float normalized_val = kNormalizeCoef * (mfcc[i] - mean_) / stddev;
+            frame_[i] = std::min<float>(INT16_MAX, std::max<float>(INT16_MIN, normalized_val));
+        }
+        return push(frame_.get());
+    }
+
+    int SubsequenceDtw::push(const int16_t* feature)
+    {
+        using namespace simplevox::detail;
+        if (template_num_ <= 0) { return -1; }
+
+        const int32_t frame = frame_count_++;
+        const float inverse_norm = kDistanceCoef * calcInverseNorm(feature, coef_num_);
+        int best_index = -1;
+        uint32_t best_distance = UINT32_MAX;
+        for (int k = 0; k < template_num_; k++)
+        {
+            const auto& tmpl = templates_[k];
+            const int size = tmpl.size();
+            const float* inverse_norms = &inverse_norms_[offsets_[k]];
+            uint32_t* step_distances = &step_distances_[offsets_[k]];
+            int16_t* step_counts = &step_counts_[offsets_[k]];
+            int32_t* begin_frames = &begin_frames_[offsets_[k]];
+            InnerProductRow(feature, tmpl, 0, size, inner_row_.get());
+
+            // 列を更新する(i: テンプレートのフレーム)
+            // 左: 前の列の同じi, 上: 更新後の列のi - 1, 斜め: 前の列のi - 1(calcDTW()と同じ優先順位)
+            uint32_t diag_dist = kUnreachable;
+            int diag_count = 0;
+            int32_t diag_begin = 0;
+            for (int i = 0; i < size; i++)
+            {
+                const uint32_t distance = CosineDistance(inner_row_[i], inverse_norm * inverse_norms[i]);
+                const uint32_t left_dist = step_distances[i];
+                const int left_count = step_counts[i];
+                const int32_t left_begin = begin_frames[i];
+
+                uint32_t step_dist;
+                int step_count;
+                int32_t step_begin;
+                if (i == 0)
+                {
+                    // テンプレートの先頭は任意のフレームから開始できる(calcDTW()の始点と同じく２倍の重み)
+                    if (left_dist != kUnreachable && left_dist + distance < 2 * distance)
+                    {
+                        step_dist = left_dist + distance;
+                        step_count = left_count + 1;
+                        step_begin = left_begin;
+                    }
+                    else
+                    {
+                        step_dist = 2 * distance;
+                        step_count = 0;
+                        step_begin = frame;
+                    }
+                }
+                else
+                {
+                    const uint32_t up_dist = step_distances[i - 1];
+                    if (up_dist < left_dist)
+                    {
+                        step_dist = up_dist;
+                        step_count = step_counts[i - 1];
+                        step_begin = begin_frames[i - 1];
+                    }
+                    else
+                    {
+                        step_dist = left_dist;
+                        step_count = left_count;
+                        step_begin = left_begin;
+                    }
+                    if (diag_dist < step_dist)
+                    {
+                        step_dist = diag_dist;
+                        step_count = diag_count;
+                        step_begin = diag_begin;
+                    }
+                    // 経路が長すぎる(テンプレートの3倍を超える)場合は到達不可とする
+                    if (step_dist != kUnreachable && frame - step_begin >= 3 * size)
+                    {
+                        step_dist = kUnreachable;
+                    }
+                    if (step_dist != kUnreachable)
+                    {
+                        step_dist += distance;
+                        step_count += 1;
+                    }
+                }
+
+                diag_dist = left_dist;
+                diag_count = left_count;
+                diag_begin = left_begin;
+                step_distances[i] = step_dist;
+                step_counts[i] = step_count;
+                begin_frames[i] = step_begin;
+            }
+
+            // テンプレートの末尾に到達した経路の平均移動距離で判定する
+            const int last = size - 1;
+            const int span = frame - begin_frames[last] + 1;
+            if (step_distances[last] == kUnreachable || 3 * span < size) { continue; }
+            const uint32_t average = (step_counts[last] > 0)
+                                    ? step_distances[last] / step_counts[last]
+                                    : step_distances[last] / 2;
+            if (average < config_.threshold && average < best_distance)
+            {
+                best_index = k;
+                best_distance = average;
+            }
+        }
+
+        if (best_index >= 0)
+        {
+            matched_index_ = best_index;
+            distance_ = best_distance;
+            const int total_length = offsets_[template_num_ - 1] + templates_[template_num_ - 1].size();
+            std::fill_n(step_distances_.get(), total_length, kUnreachable);
+        }
+        return best_index;
+    }
+
+    bool IncrementalDtw::init(const MfccFeature* const* templates, int num, const DtwConfig& config)
+    {
+        return initTemplates(templates, num, config);
+    }
+
+    bool IncrementalDtw::init(const MfccFeatureView* const* templates, int num, const DtwConfig& config)
+    {
+        return initTemplates(templates, num, config);
+    }
+
+    template <class T>
+    bool IncrementalDtw::initTemplates(const T* const* templates, int num, const DtwConfig& config)
+    {
+        if (num <= 0 || templates == nullptr)
+        {
+            printf("Argument error\n");
+            return false;
+        }
+
+        const int coef_num = templates[0]->dimension();
+        int total_length = 0;
+        int max_length = 0;
+        for (int k = 0; k < num; k++)
+        {
+            if (templates[k]->dimension() != coef_num || templates[k]->size() <= 0)
+            {
+                printf("Argument error\n");
+                return false;
+            }
+            total_length += templates[k]->size();
+            max_length = std::max(max_length, templates[k]->size());
+        }
+
+        templates_.reset(new (std::nothrow) MfccFeatureView[num]);
+        offsets_.reset(new (std::nothrow) int[num]);
+        inverse_norms_.reset(new (std::nothrow) float[total_length]);
+        step_distances_.reset(new (std::nothrow) uint32_t[total_length]);
+        step_counts_.reset(new (std::nothrow) int16_t[total_length]);
+        is_abandoned_.reset(new (std::nothrow) bool[num]);
+        inner_row_.reset(new (std::nothrow) int[max_length]);
+        if (!templates_ || !offsets_ || !inverse_norms_ || !step_distances_
+            || !step_counts_ || !is_abandoned_ || !inner_row_)
+        {
+            printf("Failed to create heap\n");
+            deinit();
+            return false;
+        }
+
+        int offset = 0;
+        for (int k = 0; k < num; k++)
+        {
+            templates_[k] = MfccFeatureView(*templates[k]);
+            offsets_[k] = offset;
+            detail::SetupInverseNorms(*templates[k], &inverse_norms_[offset]);
+            offset += templates[k]->size();
+        }
+
+        config_ = config;
+        template_num_ = num;
+        coef_num_ = coef_num;
+        reset();
+        return true;
+    }
+
+    void IncrementalDtw::deinit()
+    {
+        templates_.reset();
+        offsets_.reset();
+        inverse_norms_.reset();
+        step_distances_.reset();
+        step_counts_.reset();
+        is_abandoned_.reset();
+        inner_row_.reset();
+        template_num_ = 0;
+    }
+
+    void IncrementalDtw::reset()
+    {
+        if (template_num_ > 0)
+        {
+            std::fill_n(is_abandoned_.get(), template_num_, false);
+        }
+        frame_count_ = 0;
+    }
+
+    void IncrementalDtw::push(const int16_t* feature)
+    {
+        using namespace simplevox::detail;
+        if (template_num_ <= 0) { return; }
+
+        const int j = frame_count_++;  // 追加する列(queryのフレーム)
+        const float inverse_norm = kDistanceCoef * calcInverseNorm(feature, coef_num_);
+        const bool can_abandon = config_.abandon_distance != UINT32_MAX;
+        const uint64_t abandon_distance = config_.abandon_distance;
+        for (int k = 0; k < template_num_; k++)
+        {
+            if (is_abandoned_[k]) { continue; }
+
+            const auto& tmpl = templates_[k];
+            const int size = tmpl.size();
+            const float* inverse_norms = &inverse_norms_[offsets_[k]];
+            uint32_t* step_distances = &step_distances_[offsets_[k]];
+            int16_t* step_counts = &step_counts_[offsets_[k]];
+            InnerProductRow(feature, tmpl, 0, size, inner_row_.get());
+
+            // 列を更新する(i: テンプレートのフレーム)
+            // 左: 前の列の同じi, 上: 更新後の列のi - 1, 斜め: 前の列のi - 1(calcDTW()と同じ優先順位)
+            uint32_t diag_dist = 0;
+            int diag_count = 0;
+            bool is_alive = false;
+            for (int i = 0; i < size; i++)
+            {
+                const uint32_t distance = CosineDistance(inner_row_[i], inverse_norm * inverse_norms[i]);
+                const uint32_t left_dist = step_distances[i];
+                const int left_count = step_counts[i];
+
+                uint32_t step_dist;
+                int step_count;
+                if (j == 0)
+                {
+                    step_dist = (i == 0) ? distance : step_distances[i - 1];  // 始点は２倍の重み
+                    step_count = (i == 0) ? -1 : step_counts[i - 1];
+                }
+                else if (i == 0)
+                {
+                    step_dist = left_dist;
+                    step_count = left_count;
+                }
+                else
+                {
+                    if (step_distances[i - 1] < left_dist)
+                    {
+                        step_dist = step_distances[i - 1];
+                        step_count = step_counts[i - 1];
+                    }
+                    else
+                    {
+                        step_dist = left_dist;
+                        step_count = left_count;
+                    }
+                    if (diag_dist < step_dist)
+                    {
+                        step_dist = diag_dist;
+                        step_count = diag_count;
+                    }
+                }
+
+                diag_dist = left_dist;
+                diag_count = left_count;
+                step_distances[i] = step_dist + distance;
+                step_counts[i] = step_count + 1;
+
+                // 入力の長さはテンプレートの3倍までのため、残りのステップ数は(size - 1 - i) + (3 * size - 1 - j)以下
+                if (can_abandon && !is_alive)
+                {
+                    const uint64_t rest_steps = step_counts[i] + (size - 1 - i) + std::max(0, 3 * size - 1 - j);
+                    is_alive = step_distances[i] < abandon_distance * rest_steps;
+                }
+            }
+            if (can_abandon && !is_alive)
+            {
+                is_abandoned_[k] = true;
+            }
+        }
+    }
+
+    int IncrementalDtw::result(uint32_t* distances) const
+    {
+        int best_index = -1;
+        for (int k = 0; k < template_num_; k++)
+        {
+            distances[k] = UINT32_MAX;
+            const int size = templates_[k].size();
+            if (is_abandoned_[k] || frame_count_ <= 0
+                || size > 3 * frame_count_ || 3 * size < frame_count_)
+            {
+                continue;
+            }
+
+            const int last = offsets_[k] + size - 1;
+            distances[k] = (step_counts_[last] > 0)
+                            ? step_distances_[last] / step_counts_[last]
+                            : step_distances_[last] / 2;
+            if (best_index < 0 || distances[k] < distances[best_index])
+            {
+                best_index = k;
+            }
+        }
+        return best_index;
+    }
+
+} // namespace simplevox
@@ -0,0 +1,197 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef SIMPLEVOX_SDTW_H_
+#define SIMPLEVOX_SDTW_H_
+
+#include <memory>
+#include <stdint.h>
+
+#include "simplevox_dtw.h"
+#include "simplevox_mfcc.h"
+
+namespace simplevox
+{
+    struct SubsequenceDtwConfig
+    {
+        /**
+         * @brief 一致と判定するDTW距離(この値未満で一致), しきい値は要調整
+         */
+        uint32_t threshold = 180;
+
+        /**
+         * @brief push(const float*)で入力したMFCCの標準化に用いる統計量の時定数(フレーム数)
+         * @note 既定値はhop_length() = 16msで約2秒
+         */
+        int normalize_frame_num = 125;
+    };
+
+    /**
+     * @brief 連続した音声の中からテンプレートに一致する区間を逐次的に検出します(Subsequence DTW)
+     * @details
+     * テンプレートごとにDPの１列(テンプレートのフレーム数分)のみを保持し、
+     * MFCCが１フレーム入力されるごとに列を更新します。
+     * 経路はテンプレートの先頭であれば任意のフレームから開始でき(open-begin)、
+     * テンプレートの末尾に到達した経路の平均移動距離がしきい値を下回った時点で一致と判定します(open-end)。
+     * VADによる区間の確定を待たないため、判定の遅延は単語の長さのみで決まります。
+     * 経路の長さ(入力のフレーム数)はcalcDTW()と同様にテンプレートの1/3倍から3倍までに制限されます。
+     * 判定後は全ての列をリセットし、以降のフレームから検出をやり直します。
+     */
+    class SubsequenceDtw
+    {
+    private:
+        SubsequenceDtwConfig config_;
+        std::unique_ptr<MfccFeatureView[]> templates_;
+        std::unique_ptr<int[]> offsets_;            ///< 各テンプレートの列の開始位置
+        std::unique_ptr<float[]> inverse_norms_;    ///< テンプレートの各フレームのノルムの逆数
+        std::unique_ptr<uint32_t[]> step_distances_;
+        std::unique_ptr<int16_t[]> step_counts_;
+        std::unique_ptr<int32_t[]> begin_frames_;   ///< 経路の開始フレーム
+        std::unique_ptr<int[]> inner_row_;
+        std::unique_ptr<int16_t[]> frame_;
+        int template_num_ = 0;
+        int coef_num_ = 0;
+        int32_t frame_count_ = 0;
+        float mean_ = 0;
+        float square_mean_ = 0;
+        int matched_index_ = -1;
+        uint32_t distance_ = UINT32_MAX;
+
+        template <class T>
+        bool initTemplates(const T* const* templates, int num, const SubsequenceDtwConfig& config);
+    public:
+        /**
+         * @brief   照合するテンプレートを設定して初期化します
+         * @param[in]   templates   テンプレートの配列(全て同じ次元数であること)
+         * @param[in]   num         テンプレートの個数
+         * @param[in]   config      コンフィグ
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         * @note    テンプレートは所有されないため、使用している間は有効である必要があります
+         */
+        bool init(const MfccFeature* const* templates, int num,
+                  const SubsequenceDtwConfig& config = SubsequenceDtwConfig());
+
+        /**
+         * @brief   フラッシュ等に配置したテンプレートを設定して初期化します
+         * @note    テンプレートの参照先は使用している間は有効である必要があります
+         */
+        bool init(const MfccFeatureView* const* templates, int num,
+                  const SubsequenceDtwConfig& config = SubsequenceDtwConfig());
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   照合中の経路と標準化の統計量を破棄します
+         */
+        void reset();
+
+        /**
+         * @brief   標準化前のMFCCを１フレーム入力します
+         * @details 直近normalize_frame_numフレーム程度の平均と標準偏差で標準化してから照合します。
+         * @param[in]   mfcc    MfccEngine::calculate()またはMfccStream::push()で算出したMFCC(coef_num個)
+         * @return  一致したテンプレートの番号, 一致しなければ-1
+         */
+        int push(const float* mfcc);
+
+        /**
+         * @brief   標準化済みの特徴量を１フレーム入力します
+         * @param[in]   feature 標準化済みの特徴量(MfccEngine::normalize()と同じく1000倍したもの, coef_num個)
+         * @return  一致したテンプレートの番号, 一致しなければ-1
+         */
+        int push(const int16_t* feature);
+
+        /**
+         * @brief   直近に一致したテンプレートの番号(一致していない場合は-1)
+         */
+        int matchedIndex() const { return matched_index_; }
+
+        /**
+         * @brief   直近に一致したときのDTW距離
+         */
+        uint32_t distance() const { return distance_; }
+    };
+
+    /**
+     * @brief 特徴量を１フレームずつ入力しながら複数のテンプレートとのDTW距離を計算します
+     * @details
+     * テンプレートごとにDPの１列(テンプレートのフレーム数分)を保持し、
+     * 入力(calcDTWBatch()のquery)のフレームが追加されるごとに列を更新します。
+     * 音声区間の検出中に計算を進めておくことで、区間の確定時にはすぐに結果が得られます。
+     * 同じ特徴量を入力した場合、結果はバンドなしのcalcDTWBatch()と一致します。
+     * 打ち切り距離を指定した場合、以降の入力でも打ち切り距離未満にならないことが確定したテンプレートは計算を打ち切ります。
+     * 入力の長さがテンプレートの3倍までであることを利用するため、打ち切りの判定はcalcDTW()より緩くなります。
+     */
+    class IncrementalDtw
+    {
+    private:
+        DtwConfig config_;
+        std::unique_ptr<MfccFeatureView[]> templates_;
+        std::unique_ptr<int[]> offsets_;            ///< 各テンプレートの列の開始位置
+        std::unique_ptr<float[]> inverse_norms_;    ///< テンプレートの各フレームのノルムの逆数
+        std::unique_ptr<uint32_t[]> step_distances_;
+        std::unique_ptr<int16_t[]> step_counts_;
+        std::unique_ptr<bool[]> is_abandoned_;
+        std::unique_ptr<int[]> inner_row_;
+        int template_num_ = 0;
+        int coef_num_ = 0;
+        int frame_count_ = 0;
+
+        template <class T>
+        bool initTemplates(const T* const* templates, int num, const DtwConfig& config);
+    public:
+        /**
+         * @brief   照合するテンプレートを設定して初期化します
+         * @param[in]   templates   テンプレートの配列(全て同じ次元数であること)
+         * @param[in]   num         テンプレートの個数
+         * @param[in]   config      コンフィグ(abandon_distanceのみ有効, band_widthは無視されます)
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         * @note    テンプレートは所有されないため、使用している間は有効である必要があります
+         */
+        bool init(const MfccFeature* const* templates, int num, const DtwConfig& config = DtwConfig());
+
+        /**
+         * @brief   フラッシュ等に配置したテンプレートを設定して初期化します
+         * @note    テンプレートの参照先は使用している間は有効である必要があります
+         */
+        bool init(const MfccFeatureView* const* templates, int num, const DtwConfig& config = DtwConfig());
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit();
+
+        /**
+         * @brief   入力を破棄して最初のフレームから計算し直します
+         */
+        void reset();
+
+        /**
+         * @brief   入力したフレーム数
+         */
+        int size() const { return frame_count_; }
+
+        /**
+         * @brief   標準化済みの特徴量を１フレーム追加し、各テンプレートのDPの列を更新します
+         * @param[in]   feature 標準化済みの特徴量(coef_num個)
+         */
+        void push(const int16_t* feature);
+
+        /**
+         * @brief   これまでに入力したフレームと各テンプレートとのDTW距離を求めます
+         * @param[out]  distances   各テンプレートとの距離(num個, 比較できない場合や打ち切った場合はUINT32_MAX)
+         * @return  最も距離が小さいテンプレートの番号, いずれとも比較できない場合は-1
+         */
+        int result(uint32_t* distances) const;
+    };
+} // namespace simplevox
+
+#endif // SIMPLEVOX_SDTW_H_
@@ -0,0 +1,246 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef SIMPLEVOX_STATIC_MFCC_H_
+#define SIMPLEVOX_STATIC_MFCC_H_
+
+// テーブルをconstexprのループで算出するため、C++14以降が必要
+#if __cplusplus < 201402L
+#error "simplevox_static_mfcc.h requires C++14 or later (-std=gnu++14)"
+#endif
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
+#include "simplevox_mfcc.h"
+#include "simplevox_platform.h"
+#include "detail/simplevox_mfcc_tables.h"
+
+namespace simplevox
+{
+    /**
+     * @brief 構成をコンパイル時に固定したMfccEngine(MfccArithmetic::Floatのみ)
+     * @details
+     * 窓関数, Mel-FilterおよびDCTのテーブルはconstexprで算出されて読み出し専用領域(フラッシュ)に配置され、
+     * 作業領域もメンバとして保持するため、init()はヒープを確保しません(FFTのテーブルはMfccEngineと共有)。
+     * 各ループの回数がコンパイル時に決まるため、コンパイラによる展開やベクトル化が効きやすくなります。
+     * 算出結果は同じ構成のMfccEngineと一致します。
+     * C++14以降が必要です(simplevox.hはC++14以降の場合のみこのヘッダを含めます)。
+     * @tparam  FftNum      FFTのデータ点数
+     * @tparam  MelChannel  メルフィルタバンクのチャンネル数
+     * @tparam  CoefNum     MFCCの係数の数
+     * @tparam  SampleRate  サンプリングレート(8000Hz or 16000Hz)
+     * @tparam  FrameTimeMs １フレームの時間
+     * @tparam  Normalize   メルフィルタバンクの重みの正規化方法
+     */
+    template <int FftNum, int MelChannel, int CoefNum, int SampleRate,
+              int FrameTimeMs = 32, MelNormalize Normalize = MelNormalize::None>
+    class StaticMfccEngine
+    {
+    public:
+        static constexpr int kFrameLength = FrameTimeMs * SampleRate / 1000;
+        static constexpr int kHopLength = kFrameLength / 2;
+
+        static_assert(FftNum >= 4 && (FftNum & (FftNum - 1)) == 0, "FftNum must be a power of two");
+        static_assert(kFrameLength > 1 && kFrameLength <= FftNum, "frame length must not exceed FftNum");
+        static_assert(SampleRate == 8000 || SampleRate == 16000, "SampleRate must be 8000 or 16000");
+        static_assert(MelChannel > 0 && CoefNum > 0, "MelChannel and CoefNum must be positive");
+
+    private:
+        using Tables = detail::MfccTables<FftNum, MelChannel, CoefNum, SampleRate, FrameTimeMs, Normalize>;
+        static constexpr Tables kTables = {};
+
+        alignas(16) float fft_data_[FftNum];
+        float mel_data_[MelChannel];
+        int pre_emphasis_ = 97;
+        bool fast_log_ = false;
+        bool is_initialized_ = false;
+
+        template <typename T>
+        void calculateFrame(const int16_t* frame, int prev_val, T* mfcc)
+        {
+            {
+                for (int i = 0; i < kFrameLength; i++)
+                {
+                    const int curt_val = frame[i];
+                    const float pre_emphasised = curt_val - pre_emphasis_ * prev_val / 100;
+                    fft_data_[i] = pre_emphasised * kTables.window[i] / detail::kConstWindowCoef;
+                    prev_val = curt_val;
+                }
+                for (int i = kFrameLength; i < FftNum; i++)
+                {
+                    fft_data_[i] = 0;
+                }
+            }
+
+            platform::calcRealFftFc32(fft_data_, FftNum);
+
+            float* power_spectrum = fft_data_;
+            for (int i = 0; i < FftNum / 2; i++)
+            {
+                const float re = fft_data_[2 * i];
+                const float im = fft_data_[2 * i + 1];
+                power_spectrum[i] = re*re + im*im;
+            }
+
+            const float* weight = kTables.mel_weight;
+            for (int i = 0; i < MelChannel; i++)
+            {
+                const float* spectrum = &power_spectrum[kTables.mel_begin[i]];
+                float mel_val = 0;
+                for (int j = 0; j < kTables.mel_length[i]; j++)
+                {
+                    mel_val += weight[j] * spectrum[j];
+                }
+                mel_data_[i] = mel_val;
+                weight += kTables.mel_length[i];
+            }
+
+            // 無音のフレームで-infとならないように下限(0dB)を設ける
+            float* logmel_spectrum = mel_data_;
+            if (fast_log_)
+            {
+                for (int i = 0; i < MelChannel; i++)
+                {
+                    logmel_spectrum[i] = 3.01029996f * detail::FastLog2(std::max(mel_data_[i], 1.0f));
+                }
+            }
+            else
+            {
+                for (int i = 0; i < MelChannel; i++)
+                {
+                    logmel_spectrum[i] = 10.0f * log10f(std::max(mel_data_[i], 1.0f));
+                }
+            }
+
+            for (int i = 0; i < CoefNum; i++)
+            {
+                const int16_t* dct = &kTables.dct[i * MelChannel];
+                float mfcc_val = 0;
+                for (int j = 0; j < MelChannel; j++)
+                {
+                    mfcc_val += logmel_spectrum[j] * dct[j] / detail::kConstDctCoef;
+                }
+                store(mfcc_val, &mfcc[i]);
+            }
+        }
+
+        static void store(float value, float* dest) { *dest = value; }
+        static void store(float value, int16_t* dest)
+        {
+            *dest = std::min<float>(INT16_MAX, std::max<float>(INT16_MIN, roundf(value * 16)));
+        }
+
+    public:
+        StaticMfccEngine() = default;
+        StaticMfccEngine(const StaticMfccEngine&) = delete;
+        StaticMfccEngine& operator=(const StaticMfccEngine&) = delete;
+        ~StaticMfccEngine() { deinit(); }
+
+        /**
+         * @brief   初期化処理を行います(FFTのテーブルの取得のみ)
+         * @param[in]   pre_emphasis    プリエンファシス係数[%]
+         * @param[in]   fast_log        対数メルスペクトルの算出に近似を用いるか(MfccConfig::fast_log)
+         * @return 初期化成功ならtrue, 失敗ならfalse
+         */
+        bool init(int pre_emphasis = 97, bool fast_log = false)
+        {
+            if (is_initialized_ || pre_emphasis < 0)
+            {
+                return false;
+            }
+            if (!detail::AcquireMfccFftTable(MfccArithmetic::Float, FftNum))
+            {
+                return false;
+            }
+            pre_emphasis_ = pre_emphasis;
+            fast_log_ = fast_log;
+            is_initialized_ = true;
+            return true;
+        }
+
+        /**
+         * @brief   リソースを開放します
+         */
+        void deinit()
+        {
+            if (!is_initialized_) { return; }
+            detail::ReleaseMfccFftTable(MfccArithmetic::Float);
+            is_initialized_ = false;
+        }
+
+        /**
+         * @brief   同じ算出結果となるMfccEngineのコンフィグ
+         */
+        MfccConfig config() const
+        {
+            MfccConfig config;
+            config.fft_num = FftNum;
+            config.mel_channel = MelChannel;
+            config.mel_normalize = Normalize;
+            config.coef_num = CoefNum;
+            config.pre_emphasis = pre_emphasis_;
+            config.sample_rate = SampleRate;
+            config.frame_time_ms = FrameTimeMs;
+            config.arithmetic = MfccArithmetic::Float;
+            config.fast_log = fast_log_;
+            return config;
+        }
+
+        /**
+         * @brief MFCCを算出します
+         * @param[in]   frame   １フレーム(kFrameLength)分のサウンドデータ
+         * @param[out]  mfcc    算出した特徴量(MFCC, CoefNum個)
+         */
+        void calculate(const int16_t* frame, float* mfcc) { calculateFrame(frame, 0, mfcc); }
+
+        /**
+         * @brief MFCCを固定小数点数で算出します
+         * @param[in]   frame   １フレーム(kFrameLength)分のサウンドデータ
+         * @param[out]  mfcc    算出した特徴量(MFCCを16倍した値, CoefNum個)
+         */
+        void calculate(const int16_t* frame, int16_t* mfcc) { calculateFrame(frame, 0, mfcc); }
+
+        /**
+         * @brief 音声データの各フレーム(kHopLengthずつずらす)のMFCCを算出します
+         * @details プリエンファシスの状態はフレーム間で引き継ぎます(MfccEngine::create()と同じ)
+         * @param[in]   raw_audio   サウンドデータ
+         * @param[in]   length      サウンドデータの長さ
+         * @param[out]  mfccs       算出した特徴量(frameNum(length) * CoefNum個)
+         * @return  算出したフレーム数
+         * @note    標準化はMfccNormalizerで行えます(MfccEngine::create()と同じくconfig().per_coef_normalizeはfalse)
+         */
+        int calculate(const int16_t* raw_audio, int length, float* mfccs)
+        {
+            const int frame_num = frameNum(length);
+            for (int i = 0; i < frame_num; i++)
+            {
+                const int16_t* frame = &raw_audio[i * kHopLength];
+                calculateFrame(frame, (i > 0) ? frame[-1] : 0, &mfccs[i * CoefNum]);
+            }
+            return frame_num;
+        }
+
+        /**
+         * @brief 指定した長さの音声データから算出されるフレーム数
+         */
+        static constexpr int frameNum(int length)
+        {
+            return (length < kFrameLength) ? 0 : (length - (kFrameLength - kHopLength)) / kHopLength;
+        }
+    };
+
+    // kTablesは実行時の添字で参照する(ODR使用)ため、C++14では名前空間スコープの定義が必要
+    template <int FftNum, int MelChannel, int CoefNum, int SampleRate, int FrameTimeMs, MelNormalize Normalize>
+    constexpr typename StaticMfccEngine<FftNum, MelChannel, CoefNum, SampleRate, FrameTimeMs, Normalize>::Tables
+        StaticMfccEngine<FftNum, MelChannel, CoefNum, SampleRate, FrameTimeMs, Normalize>::kTables;
+} // namespace simplevox
+
+#endif // SIMPLEVOX_STATIC_MFCC_H_
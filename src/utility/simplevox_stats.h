@@ -0,0 +1,88 @@
+/*!
+ * SimpleVox
+ *
+ * Copyright (c) 2023 MechaUma
+ *
+ * This software is released under the MIT.
+ * see https://opensource.org/licenses/MIT
+ */
+
+#ifndef SIMPLEVOX_STATS_H_
+#define SIMPLEVOX_STATS_H_
+
+#include <stdint.h>
+
+/**
+ * @brief 処理時間などの計測(stats())を有効にするか
+ * @details
+ * 1を定義するとMfccEngine, VadEngineおよびcalcDTW()の各段の処理時間(サイクル数)や回数を積算します。
+ * クラスの構成が変わるため、ライブラリを含む全てのソースで同じ値を定義してください(build_flags等)。
+ * 0(既定)の場合、計測のコードはコンパイルされず、stats()は常に0を返します。
+ */
+#ifndef SIMPLEVOX_ENABLE_STATS
+#define SIMPLEVOX_ENABLE_STATS 0
+#endif
+
+#if SIMPLEVOX_ENABLE_STATS
+#include "simplevox_platform.h"
+
+/// 区間の計測を開始する(同じスコープ内で1回)
+#define SIMPLEVOX_STATS_BEGIN() uint32_t simplevox_stats_cycles_ = simplevox::platform::cycleCount()
+/// 直前の計測点からのサイクル数をcounterに加え、次の区間を開始する
+#define SIMPLEVOX_STATS_LAP(counter) \
+    do { \
+        const uint32_t simplevox_stats_now_ = simplevox::platform::cycleCount(); \
+        (counter) += (uint32_t)(simplevox_stats_now_ - simplevox_stats_cycles_); \
+        simplevox_stats_cycles_ = simplevox_stats_now_; \
+    } while (0)
+/// counterにvalueを加える
+#define SIMPLEVOX_STATS_ADD(counter, value) ((counter) += (value))
+#else
+#define SIMPLEVOX_STATS_BEGIN() do {} while (0)
+#define SIMPLEVOX_STATS_LAP(counter) do {} while (0)
+#define SIMPLEVOX_STATS_ADD(counter, value) do {} while (0)
+#endif
+
+namespace simplevox
+{
+    /**
+     * @brief MfccEngine::calculate()の各段の積算サイクル数
+     * @note  FixedPointでは対数変換はメルフィルタと同時に行うため、logはmelに含まれます
+     */
+    struct MfccStats
+    {
+        uint32_t frame_count = 0;       ///< 算出したフレーム数
+        uint64_t window_cycles = 0;     ///< プリエンファシスと窓関数
+        uint64_t fft_cycles = 0;        ///< FFT
+        uint64_t power_cycles = 0;      ///< パワースペクトル
+        uint64_t mel_cycles = 0;        ///< メルフィルタバンク
+        uint64_t log_cycles = 0;        ///< 対数変換
+        uint64_t dct_cycles = 0;        ///< DCT
+    };
+
+    /**
+     * @brief VadEngine::process()の統計
+     */
+    struct VadStats
+    {
+        static constexpr int kStateNum = 8;     ///< VadStateの個数
+        uint32_t frame_count = 0;       ///< process()の呼び出し回数
+        uint32_t classify_count = 0;    ///< 音声判定器(ESP-SRなど)の呼び出し回数
+        uint64_t classify_cycles = 0;   ///< 音声判定器の積算サイクル数
+        uint32_t transition_count = 0;  ///< 状態が変化した回数
+        uint32_t entered_count[kStateNum] = {};     ///< 各状態(VadStateの値)に遷移した回数
+    };
+
+    /**
+     * @brief calcDTW()およびcalcDTWBatch()の統計(全スレッドの合計)
+     */
+    struct DtwStats
+    {
+        uint64_t call_count = 0;        ///< DPの計算回数
+        uint64_t cell_count = 0;        ///< 評価したセルの数
+        uint64_t abandon_count = 0;     ///< 打ち切った回数
+        uint64_t pruned_count = 0;      ///< 下限値によりDPを省略したテンプレートの数
+    };
+} // namespace simplevox
+
+#endif // SIMPLEVOX_STATS_H_
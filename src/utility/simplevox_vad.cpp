@@ -11,9 +11,10 @@
 
 #include <algorithm>
 #include <atomic>
+#include <math.h>
 #include <new>
 
-#include <esp_vad.h>
+#include "simplevox_platform.h"
 
 namespace
 {
@@ -21,13 +22,33 @@ namespace
     {
         return (dividend + divisor - 1) / divisor;
     }
+
+    // 雑音レベルの追従の速さ(1/2^shift), 上昇は緩やかに(約1.3秒)、下降は速やかに追従する
+    constexpr int kNoiseRiseShift = 7;
+    constexpr int kNoiseFallShift = 2;
+
+    /**
+     * @brief フレームの平均二乗値とゼロ交差数を求める
+     */
+    uint32_t FrameEnergy(const int16_t* data, int length, int* crossing_num)
+    {
+        uint64_t energy = (int32_t)data[0] * data[0];
+        int crossings = 0;
+        for (int i = 1; i < length; i++)
+        {
+            energy += (int32_t)data[i] * data[i];
+            crossings += ((data[i - 1] < 0) != (data[i] < 0));
+        }
+        *crossing_num = crossings;
+        return energy / length;
+    }
 }
 
 namespace simplevox
 {
     bool VadEngine::init(const VadConfig &config)
     {
-        if (vad_inst_ != nullptr)
+        if (is_initialized_)
         {
             return false;
         }
@@ -47,47 +68,44 @@ namespace simplevox
             return false;
         }
 
-        switch (config.vad_mode)
+        if (config.gate_margin_db < 0 || config.gate_zcr_percent < 0)
         {
-        case VadMode::Aggression_LV0:
-            vad_inst_ = vad_create(VAD_MODE_0);
-            break;
-        case VadMode::Aggression_LV1:
-            vad_inst_ = vad_create(VAD_MODE_1);
-            break;
-        case VadMode::Aggression_LV2:
-            vad_inst_ = vad_create(VAD_MODE_2);
-            break;
-        case VadMode::Aggression_LV3:
-            vad_inst_ = vad_create(VAD_MODE_3);
-            break;
-        case VadMode::Aggression_LV4:
-            vad_inst_ = vad_create(VAD_MODE_4);
-            break;
-        default:
-            vad_inst_ = nullptr;
-            break;
+            return false;
         }
 
-        if (vad_inst_ == nullptr)
+        if (config.classifier == nullptr)
         {
-            return false;
+            vad_inst_ = platform::createVad(static_cast<int>(config.vad_mode), config.sample_rate);
+            if (vad_inst_ == nullptr)
+            {
+                return false;
+            }
         }
 
+        is_initialized_ = true;
         reset();
         vad_config_ = config;
+        gate_ratio_ = 256 * powf(10.0f, config.gate_margin_db / 10.0f);
+        noise_energy_ = 0;
+        has_noise_energy_ = false;
         return true;
     }
 
     void VadEngine::deinit()
     {
-        vad_destroy(vad_inst_);
-        vad_inst_ = nullptr;
+        if (!is_initialized_) { return; }
+        if (vad_inst_ != nullptr)
+        {
+            platform::destroyVad(vad_inst_);
+            vad_inst_ = nullptr;
+        }
+        is_initialized_ = false;
     }
 
     void VadEngine::reset()
     {
         this->frame_count_ = 0;
+        this->head_frame_ = 0;
         this->state_count_ = 0;
         this->has_satisfied_hangbefore_ = false;
         this->vad_state_ = VadState::Warmup;
@@ -98,11 +116,13 @@ namespace simplevox
         const auto& config = vad_config_;
         const int frame_length = config.frame_length();
 
+        SIMPLEVOX_STATS_ADD(stats_.frame_count, 1);
+#if SIMPLEVOX_ENABLE_STATS
+        const auto prev_state = vad_state_;
+#endif
         state_count_++;
         const int state_length = frame_length * state_count_;
-        const bool IsSpeech = (has_satisfied_hangbefore_)
-                            ? VAD_SPEECH == vad_process(vad_inst_, (int16_t*)data, config.sample_rate, config.frame_time_ms)
-                            : false;
+        const bool IsSpeech = (has_satisfied_hangbefore_) ? isSpeech(data) : false;
         switch (vad_state_)
         {
         case VadState::Warmup:
@@ -183,51 +203,127 @@ namespace simplevox
         default:
             state_count_ = 0;
             frame_count_ = 0;
+            head_frame_ = 0;
             vad_state_ = VadState::Warmup;
             break;
         }
+#if SIMPLEVOX_ENABLE_STATS
+        if (vad_state_ != prev_state)
+        {
+            stats_.transition_count++;
+            stats_.entered_count[static_cast<int>(vad_state_)]++;
+        }
+#endif
         return vad_state_;
     }
 
+    bool VadEngine::classify(const int16_t* data)
+    {
+        const auto& config = vad_config_;
+        SIMPLEVOX_STATS_BEGIN();
+        const bool is_speech = (config.classifier != nullptr)
+            ? config.classifier(data, config.frame_length(), config.sample_rate, config.classifier_arg)
+            : platform::detectVoice(vad_inst_, data, config.sample_rate, config.frame_time_ms);
+        SIMPLEVOX_STATS_LAP(stats_.classify_cycles);
+        SIMPLEVOX_STATS_ADD(stats_.classify_count, 1);
+        return is_speech;
+    }
+
+    bool VadEngine::isSpeech(const int16_t* data)
+    {
+        const auto& config = vad_config_;
+        if (!config.energy_gate)
+        {
+            return classify(data);
+        }
+
+        const int frame_length = config.frame_length();
+        int crossing_num;
+        const uint32_t energy = FrameEnergy(data, frame_length, &crossing_num);
+        if (!has_noise_energy_)
+        {
+            noise_energy_ = energy;
+            has_noise_energy_ = true;
+        }
+
+        const bool is_quiet = (uint64_t)energy * 256 <= (uint64_t)noise_energy_ * gate_ratio_;
+        // 全てのサンプル間でゼロ交差するフレームも100%となるため、100以上は比較せずに無効とする
+        const bool is_noisy = config.gate_zcr_percent < 100
+                            && 100 * crossing_num >= config.gate_zcr_percent * (frame_length - 1);
+        const bool is_speech = (is_quiet && !is_noisy)
+                            ? false
+                            : classify(data);
+
+        // 音声なしのフレームで雑音レベルを更新する
+        if (!is_speech)
+        {
+            if (energy > noise_energy_)
+            {
+                noise_energy_ += (energy - noise_energy_ + (1u << kNoiseRiseShift) - 1) >> kNoiseRiseShift;
+            }
+            else
+            {
+                noise_energy_ -= (noise_energy_ - energy) >> kNoiseFallShift;
+            }
+        }
+        return is_speech;
+    }
+
+    void VadEngine::linearize(int16_t* dest, int ring_frame_num)
+    {
+        const int frame_length = vad_config_.frame_length();
+        if (head_frame_ + frame_count_ > ring_frame_num)
+        {
+            std::rotate(dest, &dest[head_frame_ * frame_length], &dest[ring_frame_num * frame_length]);
+        }
+        else if (head_frame_ > 0)
+        {
+            std::copy_n(&dest[head_frame_ * frame_length], frame_count_ * frame_length, dest);
+        }
+        head_frame_ = 0;
+    }
+
     int VadEngine::detect(int16_t* dest, int length, const int16_t* data)
     {
         const auto frame_length = vad_config_.frame_length();
         const auto sound_length = frame_length * frame_count_;
+        // destはフレーム単位のリングとして使用し、音声の開始前に古いフレームを破棄する際はシフトせずに先頭を進める
+        const int ring_frame_num = length / frame_length;
 
         if (vad_state_ == VadState::Detected)
         {
+            linearize(dest, ring_frame_num);
             return sound_length;
         }
         else if (length < sound_length + frame_length)
         {
-            return (vad_state_ >= VadState::Speech)
-                    ? sound_length
-                    : -1;
+            if (vad_state_ < VadState::Speech) { return -1; }
+            linearize(dest, ring_frame_num);
+            return sound_length;
         }
         else
         {
             const auto prev_frame_count = frame_count_;
             const auto state = process(data);
-            
+
             if (prev_frame_count + 1 == frame_count_)
             {
-                std::copy_n(data, frame_length, &dest[sound_length]);
+                const int tail = (head_frame_ + prev_frame_count) % ring_frame_num;
+                std::copy_n(data, frame_length, &dest[tail * frame_length]);
             }
             else if (state == VadState::Silence
-                    && prev_frame_count >= frame_count_)
+                    && prev_frame_count >= frame_count_ && frame_count_ > 0)  // Setup -> Silenceの場合 frame_count_ == 0
             {
-                const int shift_count = prev_frame_count - frame_count_ + 1;
-                const int shift_length = frame_length * shift_count;
-                if (sound_length > shift_length)    // Setup -> Silenceの場合 sound_length < shift_length
-                {
-                    std::copy_n(&dest[shift_length], sound_length - shift_length, dest);
-                    std::copy_n(data, frame_length, &dest[sound_length - shift_length]);
-                }
+                // 最新のframe_count_ - 1フレームを残し、現在のフレームを追加する
+                const int drop_count = prev_frame_count - frame_count_ + 1;
+                head_frame_ = (head_frame_ + drop_count) % ring_frame_num;
+                const int tail = (head_frame_ + frame_count_ - 1) % ring_frame_num;
+                std::copy_n(data, frame_length, &dest[tail * frame_length]);
             }
 
-            return (state == VadState::Detected)
-                    ? frame_length * frame_count_
-                    : -1;
+            if (state != VadState::Detected) { return -1; }
+            linearize(dest, ring_frame_num);
+            return frame_length * frame_count_;
         }
     }
 
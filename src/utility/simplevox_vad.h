@@ -12,6 +12,8 @@
 
 #include <stdint.h>
 
+#include "simplevox_stats.h"
+
 namespace simplevox
 {
     enum class VadState
@@ -35,6 +37,16 @@ namespace simplevox
         Aggression_LV4,
     };
 
+    /**
+     * @brief フレームの音声判定を行う関数(VadConfig::classifierで差し替える場合)
+     * @param[in]   data        １フレーム(VadConfig::frame_length())分のサウンドデータ
+     * @param[in]   length      データ数
+     * @param[in]   sample_rate サンプリングレート
+     * @param[in]   user_data   VadConfig::classifier_arg
+     * @return 音声ありならtrue
+     */
+    using VadClassifier = bool (*)(const int16_t* data, int length, int sample_rate, void* user_data);
+
     struct VadConfig
     {
         static const int frame_time_ms = 10;
@@ -70,6 +82,37 @@ namespace simplevox
          */
         VadMode vad_mode = VadMode::Aggression_LV0;
 
+        /**
+         * @brief フレームの音声判定器, nullptrの場合はプラットフォームの既定のVAD(ESP32ではESP-SR)を用いる
+         * @note ホスト環境の既定のVADは雑音レベルに対するエネルギー比による簡易的なもの
+         */
+        VadClassifier classifier = nullptr;
+
+        /**
+         * @brief classifierに渡す任意のデータ
+         */
+        void* classifier_arg = nullptr;
+
+        /**
+         * @brief エネルギーの小さいフレームでVADの判定を省略するか
+         * @details
+         * 無音区間で推定した雑音レベルを基準に、エネルギーがgate_margin_db未満のフレームは
+         * VAD(ESP-SRまたはclassifier)を呼び出さずに音声なしとして扱います。
+         * 無音が大半を占める環境で処理負荷を削減できます(状態遷移は変わりません)。
+         */
+        bool energy_gate = false;
+
+        /**
+         * @brief 雑音レベルに対するエネルギーの比[dB], この値未満のフレームはVADの判定を省略する
+         */
+        int gate_margin_db = 6;
+
+        /**
+         * @brief ゼロ交差率[%], エネルギーが小さくてもこの値以上のフレームはVADで判定する(100以上で無効)
+         * @note 摩擦音(s, shなど)の立ち上がりを取りこぼす場合に小さくする, ただし雑音のゼロ交差率も高いことに注意
+         */
+        int gate_zcr_percent = 100;
+
         int frame_length() const { return frame_time_ms * sample_rate / 1000; }
         int warmup_length() const { return warmup_time_ms * sample_rate / 1000; }
         int before_length() const { return hangbefore_ms * sample_rate / 1000; }
@@ -77,16 +120,28 @@ namespace simplevox
         int over_length() const { return hangover_ms * sample_rate / 1000; }
     };
 
-    using esp_vad_handle_t = void*;
     class VadEngine
     {
     private:
-        esp_vad_handle_t vad_inst_ = nullptr;
+        void* vad_inst_ = nullptr;      ///< platform::createVad()のハンドル(classifierを用いる場合はnullptr)
+        bool is_initialized_ = false;
         VadConfig vad_config_;
         VadState vad_state_;
         int state_count_;
         int frame_count_;
+        int head_frame_;    ///< detect()の格納先における先頭フレームの位置
         bool has_satisfied_hangbefore_;
+        uint32_t gate_ratio_;       ///< 雑音レベルに対するしきい値の比(256倍したもの)
+        uint32_t noise_energy_;     ///< 推定した雑音レベル(フレームの平均二乗値)
+        bool has_noise_energy_;
+#if SIMPLEVOX_ENABLE_STATS
+        VadStats stats_;
+#endif
+
+        bool classify(const int16_t* data);
+        bool isSpeech(const int16_t* data);
+
+        void linearize(int16_t* dest, int ring_frame_num);
     
     public:
         VadConfig config() { return vad_config_; }
@@ -126,13 +181,40 @@ namespace simplevox
 
         /**
          * @brief   音声区間の検出を行います
-         * @param[out]  dest    検出したサウンドデータの格納先
+         * @details
+         * 音声の開始前のデータは格納先をフレーム単位のリングとして保持するため、
+         * 無音や瞬時的なノイズが続いてもデータのシフトは発生しません。
+         * 検出した音声は戻り値が正の場合にのみ、destの先頭から連続して並べ直されます。
+         * @param[out]  dest    検出したサウンドデータの格納先(検出中は同じ領域と長さを指定すること)
          * @param[in]   length  格納先バッファ長 
          * @param[in]   data    １フレーム(frame_length())分のサウンドデータ
          * @retval >0   検出した音声の長さ（データ数）
          * @retval <0   音声未検出
          */
         int detect(int16_t* dest, int length, const int16_t* data);
+
+        /**
+         * @brief   process()の呼び出し回数, 音声判定器の処理時間および状態遷移の回数(detect()による呼び出しを含む)
+         * @note    SIMPLEVOX_ENABLE_STATSが0の場合は常に0
+         */
+        VadStats stats() const
+        {
+#if SIMPLEVOX_ENABLE_STATS
+            return stats_;
+#else
+            return VadStats();
+#endif
+        }
+
+        /**
+         * @brief   stats()の積算値をリセットします
+         */
+        void resetStats()
+        {
+#if SIMPLEVOX_ENABLE_STATS
+            stats_ = VadStats();
+#endif
+        }
     };
 
 } // namespace simplevox